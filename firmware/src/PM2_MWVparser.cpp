@@ -0,0 +1,204 @@
+#include "PM2_MWVparser.h"
+
+/*
+	MWV sentence layout (see PM2_Winddriver.cpp):
+		$--MWV,x.x,a,x.x,a*hh\r\n
+	field:  0     1   2  3  4 (5 = optional status after units on some firmware)
+	The checksum is the XOR of every character between '$' and '*' (exclusive).
+*/
+
+MWVParser::MWVParser() {
+	_stats.sentences=0;
+	_stats.checksumErrors=0;
+	_stats.formatErrors=0;
+	_stats.truncated=0;
+	_stats.overruns=0;
+	_sentence.angle=0;
+	_sentence.speed=0;
+	_sentence.reference='\0';
+	_sentence.units='\0';
+	_sentence.status='\0';
+	reset();
+}
+
+void MWVParser::reset() {
+	_state=WAIT_START;
+	_length=0;
+	_field=0;
+	_checksum=0;
+	_received=0;
+	_valid=true;
+	_tail[0]=_tail[1]=_tail[2]='\0';
+	_work.angle=0;
+	_work.speed=0;
+	_work.reference='\0';
+	_work.units='\0';
+	_work.status='\0';
+	startField();
+}
+
+void MWVParser::startField() {
+	_fieldLen=0;
+	_point=false;
+	_decimals=0;
+	_maxDecimals=(_field == 1) ? MWV_ANGLE_DECIMALS : MWV_SPEED_DECIMALS;
+	_value=0;
+	_letter='\0';
+}
+
+// abandon the current sentence and wait for the next '$'
+void MWVParser::fail(uint32_t &counter) {
+	counter++;
+	_state=WAIT_START;
+}
+
+int8_t MWVParser::hexValue(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+// store the field just completed; returns false if it is malformed
+bool MWVParser::endField() {
+	switch (_field) {
+		case 0: {	// address: $--MWV / $WIMWV
+			return (_fieldLen >= 3 && _tail[0] == 'M' && _tail[1] == 'W' && _tail[2] == 'V');
+		}
+		case 1:		// wind angle
+		case 3: {	// wind speed
+			if (_fieldLen == 0) return false;
+			while (_decimals < _maxDecimals) {		// scale to the fixed resolution of the field
+				_value *= 10;
+				_decimals++;
+			}
+			if (_field == 1) {
+				_work.angle=_value;
+			} else {
+				_work.speed=_value;
+			}
+			return true;
+		}
+		case 2: {	// reference
+			_work.reference=_letter;
+			return (_fieldLen == 1);
+		}
+		case 4: {	// units
+			_work.units=_letter;
+			return (_fieldLen == 1);
+		}
+		case 5: {	// status (may be empty); V = the sensor flags the data as invalid
+			_work.status=_letter;
+			return (_fieldLen <= 1 && _letter != 'V');
+		}
+		default: {	// any further fields are ignored
+			return true;
+		}
+	}
+}
+
+bool MWVParser::feed(char c) {
+	if (c == '$') {
+		if (_state != WAIT_START) {
+			_stats.truncated++;		// a new sentence started before the previous one was finished
+		}
+		reset();
+		_state=BODY;
+		_length=1;
+		return false;
+	}
+	switch (_state) {
+		case WAIT_START: {
+			return false;
+		}
+		case BODY: {
+			if (++_length > MWV_MAX_SENTENCE) {
+				fail(_stats.overruns);
+				return false;
+			}
+			if (c == '*') {
+				if (!endField()) _valid=false;
+				_state=CHECKSUM_HI;
+				return false;
+			}
+			if (c == '\r' || c == '\n') {	// line ended without a checksum
+				fail(_stats.truncated);
+				return false;
+			}
+			_checksum ^= (uint8_t)c;
+			if (c == ',') {
+				if (!endField()) _valid=false;
+				_field++;
+				startField();
+				return false;
+			}
+			if (++_fieldLen > MWV_MAX_FIELD) {
+				fail(_stats.overruns);
+				return false;
+			}
+			switch (_field) {
+				case 0: {
+					_tail[0]=_tail[1];
+					_tail[1]=_tail[2];
+					_tail[2]=c;
+					break;
+				}
+				case 1:
+				case 3: {
+					if (c >= '0' && c <= '9') {
+						if (_point) {
+							if (_decimals < _maxDecimals) {	// further decimals are beyond our resolution
+								_value = _value*10 + (c - '0');
+								_decimals++;
+							}
+						} else if (_value < 100000) {
+							_value = _value*10 + (c - '0');
+						} else {
+							_valid=false;			// more than 6 integer digits
+						}
+					} else if (c == '.' && !_point) {
+						_point=true;
+					} else {
+						_valid=false;
+					}
+					break;
+				}
+				default: {
+					_letter=c;
+					break;
+				}
+			}
+			return false;
+		}
+		case CHECKSUM_HI:
+		case CHECKSUM_LO: {
+			int8_t v = hexValue(c);
+			if (v < 0) {
+				fail(_stats.formatErrors);
+				return false;
+			}
+			_received = (_received << 4) | (uint8_t)v;
+			_state = (_state == CHECKSUM_HI) ? CHECKSUM_LO : WAIT_END;
+			return false;
+		}
+		case WAIT_END: {
+			_state=WAIT_START;
+			if (c != '\r' && c != '\n') {
+				_stats.formatErrors++;
+				return false;
+			}
+			if (_received != _checksum) {
+				_stats.checksumErrors++;
+				return false;
+			}
+			if (!_valid || _field < 4) {
+				_stats.formatErrors++;
+				return false;
+			}
+			_sentence=_work;
+			_stats.sentences++;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Incremental NMEA0183 MWV sentence parser for the Calypso ULP anemometer.
+
+	Bytes are pushed in one at a time (typically straight from the SERCOM1 receive path) and the parser
+	keeps only a few bytes of state; there is no line buffer and no heap use.
+	Numeric fields are converted on the fly into the scaled integers used for readings (deci-degrees and
+	hundredths of the speed unit), so no String or float conversion is needed to decode a sentence.
+
+	A sentence is only accepted when:
+		- it starts with '$' and the address field ends in "MWV"
+		- it contains the angle, reference, speed and units fields
+		- the status field, if sent, is not 'V' (data invalid)
+		- the "*hh" checksum matches the XOR of all characters between '$' and '*'
+		- it is terminated by CR and/or LF
+	A '$' in the middle of a sentence restarts the parser (the previous sentence was truncated);
+	a sentence or field longer than the NMEA limits is discarded (overrun).
+*/
+
+#define MWV_MAX_SENTENCE 82		// NMEA0183 maximum sentence length including '$' and CR LF
+#define MWV_MAX_FIELD 10		// longest numeric field we accept eg "360.000000"
+#define MWV_ANGLE_DECIMALS 1	// angle resolution kept: 0.1 deg
+#define MWV_SPEED_DECIMALS 2	// speed resolution kept: 0.01 m/s
+
+struct MWVSentence {
+	int32_t angle;		// wind angle in tenths of a degree (0 - 3600)
+	int32_t speed;		// wind speed in hundredths of the units below
+	char reference;		// R = Relative, T = True
+	char units;			// N (Knots) / M (Metres/s) / K (KM/Hr)
+	char status;		// A = Data Valid (or '\0' if the field is not sent)
+};
+
+struct MWVParserStats {
+	uint32_t sentences;			// valid sentences decoded
+	uint32_t checksumErrors;	// complete sentences with a bad checksum
+	uint32_t formatErrors;		// complete sentences that are not MWV, have bad / missing fields or status V
+	uint32_t truncated;			// sentences restarted by a new '$' before they were complete
+	uint32_t overruns;			// sentences or fields that exceeded the maximum length
+};
+
+class MWVParser {
+	public:
+		MWVParser();
+		void reset();
+		bool feed(char c);			// returns true when c completed a valid sentence
+		const MWVSentence &sentence() const { return _sentence; }
+		const MWVParserStats &stats() const { return _stats; }
+
+	private:
+		enum State : uint8_t {
+			WAIT_START,		// discarding until '$'
+			BODY,			// between '$' and '*'
+			CHECKSUM_HI,	// first hex digit after '*'
+			CHECKSUM_LO,	// second hex digit after '*'
+			WAIT_END		// expecting CR / LF
+		};
+		void startField();
+		bool endField();
+		void fail(uint32_t &counter);
+		static int8_t hexValue(char c);
+
+		State _state;
+		uint8_t _length;		// characters in the current sentence
+		uint8_t _field;			// index of the current comma separated field
+		uint8_t _fieldLen;		// characters in the current field
+		uint8_t _checksum;		// running XOR
+		uint8_t _received;		// checksum value received after '*'
+		bool _valid;			// false once a field was found to be malformed
+		bool _point;			// decimal point seen in the current field
+		uint8_t _decimals;		// digits kept after the decimal point
+		uint8_t _maxDecimals;	// resolution of the current field
+		int32_t _value;			// fixed point value being accumulated
+		char _tail[3];			// last 3 characters of the address field (must be "MWV")
+		char _letter;			// single letter field being accumulated
+
+		MWVSentence _work;		// fields of the sentence being decoded
+		MWVSentence _sentence;	// last valid sentence
+		MWVParserStats _stats;
+};
@@ -0,0 +1,193 @@
+#include "PM2_RG15parser.h"
+
+/*
+	The test strings from the development notes in PM2_Raindriver.cpp, and the other cases below, are checked by
+	`program rg15` in the native build (native/rg15_bench.cpp).
+*/
+
+static bool isLetter(char c) {
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static bool matches(const char *text, uint8_t len, const char *word) {
+	uint8_t i=0;
+	while (i < len && word[i] != '\0' && text[i] == word[i]) i++;
+	return (i == len && word[i] == '\0');
+}
+
+RG15Parser::RG15Parser() {
+	_stats.lines=0;
+	_stats.readings=0;
+	_stats.rejected=0;
+	_stats.overruns=0;
+	_reading.fields=0;
+	_reading.imperial=false;
+	_reading.acc=0;
+	_reading.eventAcc=0;
+	_reading.totalAcc=0;
+	_reading.rInt=0;
+	_reading.xtbTips=0;
+	_reading.xtbEventAcc=0;
+	_reading.xtbTotalAcc=0;
+	_reading.xtbInt=0;
+	_reading.baud=0;
+	reset();
+}
+
+void RG15Parser::reset() {
+	_len=0;
+	_overrun=false;
+	_line[0]='\0';
+}
+
+uint16_t RG15Parser::keyField(const char *key, uint8_t len) {
+	if (matches(key, len, "Acc")) return RG15_ACC;
+	if (matches(key, len, "EventAcc")) return RG15_EVENTACC;
+	if (matches(key, len, "TotalAcc")) return RG15_TOTALACC;
+	if (matches(key, len, "RInt")) return RG15_RINT;
+	if (matches(key, len, "XTBTips")) return RG15_XTBTIPS;
+	if (matches(key, len, "XTBEventAcc")) return RG15_XTBEVENTACC;
+	if (matches(key, len, "XTBTotalAcc")) return RG15_XTBTOTALACC;
+	if (matches(key, len, "XTBInt")) return RG15_XTBINT;
+	if (matches(key, len, "Baud")) return RG15_BAUD;
+	return 0;
+}
+
+/*
+	Parse "ddddd.ddd" into thousandths. At most 5 integer digits (99999.999) are accepted;
+	decimals beyond the third are ignored.
+*/
+bool RG15Parser::parseValue(const char *&p, const char *end, int32_t &value) {
+	uint8_t digits=0;
+	uint8_t decimals=0;
+	bool point=false;
+	value=0;
+	while (p < end) {
+		char c = *p;
+		if (c >= '0' && c <= '9') {
+			if (!point) {
+				if (++digits > 5) return false;
+				value = value*10 + (c - '0');
+			} else if (decimals < 3) {
+				value = value*10 + (c - '0');
+				decimals++;
+			}
+		} else if (c == '.' && !point) {
+			point=true;
+		} else {
+			break;
+		}
+		p++;
+	}
+	if (digits == 0) return false;
+	while (decimals < 3) {
+		value *= 10;
+		decimals++;
+	}
+	return true;
+}
+
+/*
+	Single pass over the line: [key][':'] value [unit] separated by ','
+*/
+bool RG15Parser::decode() {
+	const char *p = _line;
+	const char *end = _line + _len;
+	RG15Reading r = _reading;
+	r.fields=0;
+	bool imperial=false;
+	bool metric=false;
+
+	while (p < end) {
+		while (p < end && *p == ' ') p++;
+		const char *key = p;
+		while (p < end && isLetter(*p)) p++;
+		uint16_t field = keyField(key, (uint8_t)(p - key));
+		if (field == 0 || (r.fields & field)) {
+			return false;		// unknown or repeated key
+		}
+		if (p < end && *p == ':') p++;
+		while (p < end && *p == ' ') p++;
+		int32_t value;
+		if (!parseValue(p, end, value)) {
+			return false;
+		}
+		while (p < end && *p == ' ') p++;
+		const char *unit = p;
+		while (p < end && isLetter(*p)) p++;
+		uint8_t unitLen = (uint8_t)(p - unit);
+		bool rate = (field == RG15_RINT || field == RG15_XTBINT);
+		if (field == RG15_XTBTIPS || field == RG15_BAUD) {
+			if (unitLen != 0) return false;
+			value /= 1000;		// a count, not a fixed point value
+		} else if (matches(unit, unitLen, rate ? "iph" : "in")) {
+			imperial=true;
+			int64_t um = (int64_t)value * 254 / 10;		// thousandths of an inch to uM
+			if (um > INT32_MAX) return false;
+			value = (int32_t)um;
+		} else if (matches(unit, unitLen, rate ? "mmph" : "mm")) {
+			metric=true;		// thousandths of a mm are uM already
+		} else {
+			return false;
+		}
+		switch (field) {
+			case RG15_ACC:			r.acc=value; break;
+			case RG15_EVENTACC:		r.eventAcc=value; break;
+			case RG15_TOTALACC:		r.totalAcc=value; break;
+			case RG15_RINT:			r.rInt=value; break;
+			case RG15_XTBTIPS:		r.xtbTips=value; break;
+			case RG15_XTBEVENTACC:	r.xtbEventAcc=value; break;
+			case RG15_XTBTOTALACC:	r.xtbTotalAcc=value; break;
+			case RG15_XTBINT:		r.xtbInt=value; break;
+			case RG15_BAUD:			r.baud=value; break;
+		}
+		r.fields |= field;
+		while (p < end && *p == ' ') p++;
+		if (p < end) {
+			if (*p != ',') return false;
+			p++;
+		}
+	}
+	if (r.fields == 0 || (imperial && metric)) {
+		return false;
+	}
+	r.imperial=imperial;
+	_reading=r;
+	return true;
+}
+
+bool RG15Parser::feed(char c) {
+	if (c == '\n') {
+		bool decoded=false;
+		_stats.lines++;
+		if (_overrun) {
+			_stats.overruns++;
+		} else {
+			_line[_len]='\0';
+			// only lines that start with a key are worth decoding; single letter command
+			// responses ("p", "h", "m", "c") and banners are ignored
+			if (_len > 1 && isLetter(_line[0]) && isLetter(_line[1])) {
+				decoded=decode();
+				if (decoded) {
+					_stats.readings++;
+				} else {
+					_stats.rejected++;
+				}
+			} else if (_len > 0 && ((uint8_t)_line[0] < ' ' || (uint8_t)_line[0] > '~')) {
+				_stats.rejected++;		// line noise: usually a baud rate mismatch
+			}
+		}
+		_len=0;
+		_overrun=false;
+		return decoded;
+	}
+	if (c == '\r' || _overrun) {
+		return false;
+	}
+	if (_len >= RG15_MAX_LINE) {
+		_overrun=true;
+		return false;
+	}
+	_line[_len++]=c;
+	return false;
+}
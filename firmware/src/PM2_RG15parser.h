@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Line decoder for the Radeon RG-15 rain gauge.
+
+	Bytes are collected into a bounded line buffer; when the line feed arrives the line is tokenized in a
+	single pass into (key, fixed point value, unit) triples. No String, sscanf or atof is used.
+	Recognised lines (keys may appear in any order):
+		"Acc 0.000 in, EventAcc 0.000 in, TotalAcc 0.000 in, RInt 0.000 iph"
+		"XTBTips: 0, XTBEventAcc: 0.00 in, XTBTotalAcc: 0.000 in, XTBInt: 0.00 iph"
+		"Acc 0.000 mm"		(response to the 'A' command)
+		"Baud 9600"			(response to the 'B' command)
+	Both imperial (in / iph) and metric (mm / mmph) units are accepted; all values are converted to
+	micro-metres (accumulations) and micro-metres per hour (intensities).
+	Any line with an unknown key or unit, a repeated key, or a malformed number is rejected as a whole;
+	this is how the "two readings jumbled together" responses are discarded. A line that overflows the
+	buffer is dropped up to the next line feed, so the decoder always resynchronises on the next line.
+*/
+
+#define RG15_MAX_LINE 96		// "Acc 99999.999 mm, EventAcc 99999.999 mm, TotalAcc 99999.999 mm, RInt 99999.999 mmph" + CR
+
+// bits in RG15Reading.fields
+#define RG15_ACC			0x01
+#define RG15_EVENTACC		0x02
+#define RG15_TOTALACC		0x04
+#define RG15_RINT			0x08
+#define RG15_XTBTIPS		0x10
+#define RG15_XTBEVENTACC	0x20
+#define RG15_XTBTOTALACC	0x40
+#define RG15_XTBINT			0x80
+#define RG15_BAUD			0x100
+#define RG15_READING		(RG15_ACC | RG15_EVENTACC | RG15_TOTALACC | RG15_RINT)
+#define RG15_XTB			(RG15_XTBTIPS | RG15_XTBEVENTACC | RG15_XTBTOTALACC | RG15_XTBINT)
+
+struct RG15Reading {
+	uint16_t fields;		// which of the values below were present in the line
+	bool imperial;			// the gauge reported in inches
+	int32_t acc;			// uM accumulation since the previous message
+	int32_t eventAcc;		// uM
+	int32_t totalAcc;		// uM
+	int32_t rInt;			// uM per hour
+	int32_t xtbTips;		// tips of the external tipping bucket since the previous message
+	int32_t xtbEventAcc;	// uM
+	int32_t xtbTotalAcc;	// uM
+	int32_t xtbInt;			// uM per hour
+	int32_t baud;			// baud rate reported by the gauge
+};
+
+struct RG15ParserStats {
+	uint32_t lines;			// lines terminated by a line feed
+	uint32_t readings;		// lines decoded into a reading
+	uint32_t rejected;		// lines that looked like a reading but could not be decoded, or were line noise
+	uint32_t overruns;		// lines longer than RG15_MAX_LINE
+};
+
+class RG15Parser {
+	public:
+		RG15Parser();
+		void reset();
+		bool feed(char c);		// returns true when c completed a line holding a reading
+		const RG15Reading &reading() const { return _reading; }
+		const char *line() const { return _line; }		// last complete line (null terminated)
+		const RG15ParserStats &stats() const { return _stats; }
+
+	private:
+		bool decode();
+		static uint16_t keyField(const char *key, uint8_t len);
+		static bool parseValue(const char *&p, const char *end, int32_t &value);
+
+		char _line[RG15_MAX_LINE + 1];
+		uint8_t _len;
+		bool _overrun;			// discarding until the next line feed
+		RG15Reading _reading;
+		RG15ParserStats _stats;
+};
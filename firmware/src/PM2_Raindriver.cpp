@@ -1,5 +1,7 @@
 
 #include "PM2_Raindriver.h"
+#include "PM2_metrics.h"
+#include "PM2_log.h"
 
 /*
 Radeon RG15 Rain Gauge:  Commands and responses documentation taken from User Guide leaflet.
@@ -54,32 +56,29 @@ Y Disable External TB Input
 
 */
 
-RadeonRain::RadeonRain(HardwareSerial *serial) {
+static const uint32_t RG15BaudRates[RG15_BAUD_CODES] = {1200, 2400, 4800, 9600, 19200, 38400, 57600};
+
+RadeonRain::RadeonRain(SerialPort *serial) {
 	_rainSerial = serial;
-	myreading.accum.f=0.00;
-    myreading.totalacc.f=0.00;
-    myreading.totalacc.f=0.00;
-    myreading.intervalacc.f=0.00;
+	myreading.accum=0;
+    myreading.eventacc=0;
+    myreading.totalacc=0;
+    myreading.intervalacc=0;
+	snapshot.publish(myreading);
 }
-bool RadeonRain::begin(HardwareSerial *serial)
+bool RadeonRain::begin(SerialPort *serial)
 {
 	//bool response = false;
 	_rainSerial = serial;
 	
 	
-	myreading.accum.f=0.00;
-    myreading.totalacc.f=0.00;
-    myreading.totalacc.f=0.00;
-    myreading.intervalacc.f=0.00;
+	myreading.accum=0;
+    myreading.eventacc=0;
+    myreading.totalacc=0;
+    myreading.intervalacc=0;
 
-	if (slowStart()) {
-		 SerialUSB.print("Rain  sensor was started:..");
-		started=true;
-	} else {
-		SerialUSB.print("Rain  sensor did not respond to start command:..");
-		started=false;
-	}
-	return started;
+	bringup.restart();	// the rain task finds and configures the gauge (see probe): nothing waits here
+	return true;
 }
 /*
 To begin we set the operating mode that we require, assuming the device had a complete reset prior.
@@ -87,6 +86,7 @@ To begin we set the operating mode that we require, assuming the device had a co
 2. Set High Resolutiuon
 3. Set Metric
 4. Reset Accumulation Counter
+5. Set Continuous Mode (unless polling was selected)
 */
 bool RadeonRain::slowStart()
 {
@@ -103,23 +103,30 @@ bool RadeonRain::slowStart()
 		myCommand=StartupCommandResponseAry[i].command;
 		// send the command
 		_rainSerial->println(myCommand);
-		delay(1);		// allow a 1 byte-time (937 uS ~ 1 mS) moment for the device to respond
+		halDelay(1);		// allow a 1 byte-time (937 uS ~ 1 mS) moment for the device to respond
 		// really; we do not care what the response is.
-		if (_rainSerial->available()) {
-			// if the read buffer gets stuff in it; empty the buffer
-			while (_rainSerial->available()) {
-				_rainSerial->read();		// read the data and discard it.
-			}
-		}
+		emptyReadBuffer();
+	}
+	mode=_requestedMode;
+	if (mode == RAIN_CONTINUOUS) {
+		_rainSerial->println('C');	// response "c" is ignored by the line decoder
+		halDelay(1);
 	}
 	return true;	
 	
 }
+/*
+	Called from receiveEvent (START_RAIN), so it never waits: a gauge that has been configured is simply
+	started again; otherwise the bring-up starts over without its backoff.
+*/
 bool RadeonRain::start()
 {
-	started = true;
-	
-	return true;
+	if (bringup.state == SENSOR_READY) {
+		started = true;
+		return true;
+	}
+	bringup.restart();
+	return false;
 }
 bool RadeonRain::checkStarted()
 {
@@ -132,27 +139,62 @@ bool RadeonRain::stop()
 	return true;
 }
 
+/*
+	If the Serial.Read still has characters in the buffer from a previous command
+	then the rain gauge may send the contents instead of the new request Found during testing).
+	serviceRx consumes the same ring from the UART handler, so it is emptied with interrupts off.
+*/
 void RadeonRain::emptyReadBuffer() {
-	// if the Serial.Read still has characters in the buffer from a previous command
-	// then the rain gauge may send the contents instead of the new request Found during testing).
-	//char tmp;  In practice this does not always have the desired effect;
-	while (_rainSerial->available() > 0){
-		_rainSerial->read();
+	const uint8_t *data;
+	uint16_t count;
+	halInterruptsOff();
+	while ((count = _rainSerial->rxSpan(data)) > 0) {
+		_rainSerial->rxConsume(count);
 	}
-	_rainSerial->read();
-	return;
-
+	halInterruptsOn();
 }
 
+/*
+	Called from the I2C handler (RAIN_RESETACCUM): only records the request; the rain task clears the gauge.
+*/
 void RadeonRain::resetAccum() {
-	char commandString='O';
+	_resetPending=true;
+}
 
+/*
+	Clear the gauge's accumulation and the totals carried on top of it (main context). Applied once no reply
+	is on the wire; continuous mode readings already queued are merged first, against the old bases.
+*/
+void RadeonRain::applyReset() {
+	if (mode == RAIN_CONTINUOUS) {
+		drainRing();
+	}
+	_resetPending=false;
 	emptyReadBuffer();
-	delayMicroseconds(1);
-	_rainSerial->println(commandString); 	// send the 'Read' command to the device
+	_rainSerial->println('O');		// we are not expecting any response back from this command
+	_totalBase=0;
+	_eventBase=0;
+}
+
+/*
+	Carry on from the totals saved before the last reset: the gauge counts from zero again after slowStart,
+	so its totals are offset by these from now on. The restored event lasts until the gauge reports the
+	event over (no event accumulation and no intensity).
+*/
+void RadeonRain::restoreTotals(int32_t totalacc, int32_t eventacc) {
+	_totalBase=totalacc;
+	_eventBase=eventacc;
+	myreading.totalacc=totalacc;
+	myreading.eventacc=eventacc;
+	snapshot.publish(myreading);
+}
 
-	// we are not expecting any response back from this command
-	delayMicroseconds(10);
+void RadeonRain::mergeTotals(const RG15Reading &reading) {
+	if ((reading.fields & (RG15_EVENTACC | RG15_RINT)) == (RG15_EVENTACC | RG15_RINT) && reading.eventAcc == 0 && reading.rInt == 0) {
+		_eventBase=0;
+	}
+	if (reading.fields & RG15_EVENTACC) myreading.eventacc = reading.eventAcc + _eventBase;
+	if (reading.fields & RG15_TOTALACC) myreading.totalacc = reading.totalAcc + _totalBase;
 }
 
 /*
@@ -160,7 +202,7 @@ bool RadeonRain::sendCommand(char commandString, char responseString)
 {
 	bool response = false;
 	uint32_t timer3;
-	timer3=millis();
+	timer3=halMillis();
 	char myReading;
 	const uint32_t timeout=50;
 	_rainSerial->println(commandString);   // send a polling command to begin including CR LF
@@ -179,10 +221,10 @@ bool RadeonRain::sendCommand(char commandString, char responseString)
 		}
 		default: {  
 			while (!_rainSerial->available()) {
-				if (millis() - timer3 > timeout) {
+				if (halMillis() - timer3 > timeout) {
 					break;
 				}
-				delayMicroseconds(100);
+				halDelayMicroseconds(100);
 			}
 			myReading=0;
 			if (_rainSerial->available() > 0) {
@@ -193,7 +235,7 @@ bool RadeonRain::sendCommand(char commandString, char responseString)
 					} else {
 						response= false;
 					}
-					delayMicroseconds(100);
+					halDelayMicroseconds(100);
 					break;
 				}
 			}
@@ -202,68 +244,483 @@ bool RadeonRain::sendCommand(char commandString, char responseString)
 	return response;
 }
 */
+uint32_t RadeonRain::baudRate() const {
+	return RG15BaudRates[baudCode];
+}
+
+void RadeonRain::portBegin(uint8_t code) {
+	if (_portBegin) {
+		_portBegin(RG15BaudRates[code]);	// the board also has to route the pins to the SERCOM again
+	} else {
+		_rainSerial->begin(RG15BaudRates[code]);
+	}
+}
+
+/*
+	Send 'B' (code < 0: report the rate) or 'B<code>' (change the rate) with the UART at listenCode.
+	The "Baud <rate>" reply, which the gauge sends at its current rate just before changing, is decoded by
+	serviceRx() into _baudReply. Returns the uS to allow for the command to go out and the reply to come back;
+	nothing waits here.
+*/
+uint32_t RadeonRain::sendBaudCommand(int8_t code, uint8_t listenCode) {
+	_baudReply=0;
+	_rainSerial->print('B');
+	if (code >= 0) {
+		_rainSerial->print((char)('0' + code));
+	}
+	_rainSerial->println();
+	// "B6" + CR LF out and "Baud 57600" + CR LF back: 16 bytes of 10 bits
+	return RAIN_BAUD_LATENCY * 1000UL + 16 * 10 * 1000000UL / RG15BaudRates[listenCode];
+}
+
+/*
+	Fall back to a slower rate when the link fails: RAIN_LINK_FAILURES poll timeouts (keepalives in continuous
+	mode, see runContinuous) or undecodable lines with no good reading in between. The gauge goes back to the bring-up (see probe), which finds it again
+	one query per task run and negotiates a rate below the one that failed; a gauge that no longer answers
+	at all is retried with the bring-up backoff and reported by GET_SENSOR_STATUS.
+	Returns true if the link was given up.
+*/
+bool RadeonRain::checkLink() {
+	const RG15ParserStats &parser = _parser.stats();
+	uint32_t errors = parser.rejected + parser.overruns + pollTimeouts;
+	if (parser.readings != _linkReadings) {
+		_linkReadings=parser.readings;
+		_linkErrors=errors;
+		return false;
+	}
+	if (errors - _linkErrors < RAIN_LINK_FAILURES) {
+		return false;
+	}
+	LOG_WARN(LOG_RAIN_LINK_FAILED, baudRate());
+	linkFallbacks++;
+	awaitingReply=false;
+	_taskState=TASK_IDLE;
+	_relink=true;
+	_maxBeforeFallback=maxBaudCode;
+	if (baudCode > 0 && maxBaudCode >= baudCode) {
+		maxBaudCode = baudCode - 1;		// do not go back to the rate that failed
+	}
+	bringup.lost();
+	return true;
+}
+
+/*
+	Request a new reading. The reply is decoded by serviceRx() as it arrives (~66 mS at 9600 baud)
+	so nothing waits here. A poll still unanswered after responseTimeout is counted and replaced.
+*/
 void RadeonRain::getReading() {
-	readingInProgress=true;
-	//emptyReadBuffer();
 	char commandString='R';
-	uint32_t timer5=0;
-	uint32_t timeout=1000;
-	String response;
-	
+
+	if (awaitingReply) {
+		if (halMillis() - _pollTime < responseTimeout) {
+			return;		// previous poll is still in flight
+		}
+		pollTimeouts++;
+	}
 	_rainSerial->println(commandString); 	// send the 'Read' command to the device
-	delay(1);					// wait for it to start sending and transmission delay ( calcuated to be 66562.5 uS overall )
-	// it is assumed there is a certain finite time following a command until the device sends its response (937.5 uS per byte for 1st byte).
-	while (!_rainSerial->available()) {
-		if (micros() - timer5 > timeout) {
-			break;
+	_pollTime=halMillis();
+	sampleTime=halMicros();
+	awaitingReply=true;
+}
+
+/*
+	Bring-up (rain task, until the gauge is ready), one 'B' query per task run with the CPU halted in between,
+	so the other tasks keep running:
+		PROBE_FIND		query each rate for the one the gauge answers on: the rate last used first, then the others
+						fastest first. A pass without an answer is retried with an exponential backoff
+						(see PM2_bringup.h).
+		PROBE_SWITCH	'B<target>' sent at the gauge's rate (retried RAIN_BAUD_RETRIES times if the reply is lost);
+						targets are tried from maxBaudCode down to the rate found
+		PROBE_SETTLE	RAIN_BAUD_LATENCY for the gauge to switch
+		PROBE_VERIFY	the new rate has to answer RAIN_BAUD_ROUND_TRIPS queries in a row to count as reliable
+		PROBE_RETURN	a target failed: 'B<rate found>' sent at the target to send the gauge back, then it is found
+						again (it may be on either rate by then) and the next target down is tried
+	Then the startup commands are sent (slowStart: ~5 mS in the task) or, after a link failure, only the modes a
+	power cycled gauge would have lost (its accumulation is kept: no 'O'). probeTime (GET_RAIN_LINK) is the time
+	from the first query of the successful pass to the rate being settled.
+*/
+uint32_t RadeonRain::probe(uint32_t now) {
+	if (_taskState != TASK_PROBE) {
+		_taskState=TASK_PROBE;
+		return findRate(now);
+	}
+	uint32_t waited = now - _probeStart;
+	if ((_baudReply == 0 || _probeState == PROBE_SETTLE) && waited < _probeTimeout) {
+		return _probeTimeout - waited;		// woken early (START_RAIN): keep waiting
+	}
+	bool answered = (_baudReply == (int32_t)RG15BaudRates[_probeExpect]);
+	switch (_probeState) {
+		case PROBE_FIND: {
+			if (answered) {
+				baudCode=_probeCode;
+				return switchRate();
+			}
+			if (++_probeStep >= RG15_BAUD_CODES) {
+				_taskState=TASK_IDLE;
+				portBegin(baudCode);
+				if (_relink) {
+					maxBaudCode=_maxBeforeFallback;		// not answering at all (unplugged?): not the rate's fault
+				}
+				uint32_t retry = bringup.failed();
+				LOG_WARN(LOG_RAIN_NO_RESPONSE, bringup.failures);
+				return retry;
+			}
+			return sendQuery();
+		}
+		case PROBE_SWITCH: {
+			if (answered) {
+				_probeState=PROBE_SETTLE;
+				_probeStart=now;
+				_probeTimeout=RAIN_BAUD_LATENCY * 1000UL;
+				return _probeTimeout;
+			}
+			if (++_probeAttempts < RAIN_BAUD_RETRIES) {
+				return sendProbe(_targetCode, baudCode);
+			}
+			return targetFailed();
+		}
+		case PROBE_SETTLE: {
+			_probeState=PROBE_VERIFY;
+			_probeAttempts=0;
+			portBegin(_targetCode);
+			return sendProbe(-1, _targetCode);
+		}
+		case PROBE_VERIFY: {
+			if (!answered) {
+				return targetFailed();
+			}
+			if (++_probeAttempts < RAIN_BAUD_ROUND_TRIPS) {
+				return sendProbe(-1, _targetCode);
+			}
+			baudCode=_targetCode;
+			return configured(now);
 		}
-		delayMicroseconds(10);		// waiting a little longer (perhaps its busy)
-	}
-	if (_rainSerial->available()) {
-		response = _rainSerial->readStringUntil('\n');		// read the whole line of data at once until the end of line char
-
-		//SerialUSB.print("Rain Reading received (raw)|");
-		//SerialUSB.print(response);
-		//SerialUSB.println("|");
-
-		if (response.startsWith("Acc")) {							// just checking ...
-			char acc[10], eventAcc[10], totalAcc[10], rInt[10], unit[5],unit2[5], unit3[5], unit4[5];
-			char A[9], B[9],C[9],D[9];
-			// split the string using sscanf
-			// the compiler doth protest too much: it seems to work anyway
-			sscanf (response.c_str(), "%s %s %[^,] , %s %s %[^,] , %s %s %[^,] , %s %[0-9.]s %[mmph|mh|mAcc^\n]",&A, &acc, &unit, &B,&eventAcc,&unit2, &C,&totalAcc,&unit3, &D, &rInt,&unit4);
-
-			//SerialUSB.println(acc);
-			//SerialUSB.println(eventAcc);
-			//SerialUSB.println(totalAcc);
-			//SerialUSB.println(rInt);
-
-			// “Acc 0.000 in, EventAcc 0.000 in, TotalAcc 0.000 in, RInt 0.000 iph\r(\n)”
-			/*  Test strings
-			String response1 = "Acc 1 mm, EventAcc 2 xm, TotalAcc 3 mm, RInt 4 mmph\r";
-			String response2 = "Acc 0.01 mm, EventAcc 0.02 xm, TotalAcc 0.03 mm, RInt 0.04 mmph\r";
-			String response3 = "Acc 99.010 mm, EventAcc 999.202 mm, TotalAcc 9998.033 mm, RInt 199.201 mmph\r";
-			String response4 = "Acc 1.010 mm, EventAcc 199.202 mm, TotalAcc 898.033 mm, RInt 50.201 mmph\r";
-			String response5 = "Acc 9999.010 mm, EventAcc 9999.202 mm, TotalAcc 9999.033 mm, RInt 9999.201 mmph\r";
-			*/
-
-			// copy received data into myreading buffer
-			myreading.accum.f=atof(acc);
-			myreading.eventacc.f=atof(eventAcc);
-			myreading.totalacc.f=atof(totalAcc);
-			myreading.intervalacc.f=atof(rInt);
-				
+		default: {		// PROBE_RETURN: whether or not the gauge answered, look for it again
+			return findRate(now);
 		}
-	/*  Do NOT set the reading to zero; just leave it there (do not do this below)
+	}
+}
+
+// start a pass of PROBE_FIND
+uint32_t RadeonRain::findRate(uint32_t now) {
+	if (_probeState != PROBE_RETURN) {
+		_targetCode=maxBaudCode;
+		_probeBegan=now;
+	}
+	_probeState=PROBE_FIND;
+	_probeStep=0;
+	return sendQuery();
+}
+
+// the next PROBE_FIND query: baudCode, then the other rates fastest first
+uint32_t RadeonRain::sendQuery() {
+	uint8_t code = (_probeStep == 0) ? baudCode : RG15_BAUD_CODES - _probeStep;
+	if (_probeStep > 0 && code <= baudCode) {
+		code--;			// baudCode was the first query
+	}
+	portBegin(code);
+	return sendProbe(-1, code);
+}
+
+uint32_t RadeonRain::sendProbe(int8_t code, uint8_t listenCode) {
+	_probeCode=listenCode;
+	_probeExpect = (code < 0) ? listenCode : code;
+	_probeTimeout = sendBaudCommand(code, listenCode);
+	_probeStart = halMicros();
+	return _probeTimeout;
+}
+
+// the gauge answers at baudCode: move it to the next target (if the gauge is faster than maxBaudCode every target is a step down)
+uint32_t RadeonRain::switchRate() {
+	if (_targetCode < 0 || _targetCode == (int8_t)baudCode) {
+		return configured(halMicros());
+	}
+	_probeState=PROBE_SWITCH;
+	_probeAttempts=0;
+	return sendProbe(_targetCode, baudCode);
+}
+
+uint32_t RadeonRain::targetFailed() {
+	uint8_t failed = (uint8_t)_targetCode;
+	_targetCode--;
+	_probeState=PROBE_RETURN;
+	portBegin(failed);
+	return sendProbe(baudCode, failed);
+}
+
+uint32_t RadeonRain::configured(uint32_t now) {
+	_taskState=TASK_IDLE;
+	portBegin(baudCode);
+	probeTime=now - _probeBegan;
+	if (_relink) {
+		// a gauge that was power cycled has lost its settings too (but keep its accumulation: no 'O')
+		_rainSerial->println('H');
+		_rainSerial->println('M');
+		_rainSerial->println(mode == RAIN_CONTINUOUS ? 'C' : 'P');
+		_relink=false;
 	} else {
-		myreading.accum.f=float(0);
-		myreading.eventacc.f=float(0);
-		myreading.totalacc.f=float(0);
-		myreading.intervalacc.f=float(0);
-	*/
+		slowStart();
+		started=true;
+		LOG_INFO(LOG_RAIN_STARTED, 0);
+	}
+	bringup.ready();
+	LOG_INFO(LOG_RAIN_BAUD, baudRate());
+	const RG15ParserStats &parser = _parser.stats();
+	_linkReadings=parser.readings;
+	_linkErrors=parser.rejected + parser.overruns + pollTimeouts;
+	now=halMicros();
+	_nextSample = nextSample(now);		// first poll at the next shared sample instant
+	return _nextSample - now;
+}
+
+/*
+	Scheduler task: same state machine as CalypsoWind::run()
+		TASK_IDLE:  send the 'R' poll and sleep until the reply or responseTimeout
+		TASK_AWAIT: the reply has been decoded and published by serviceRx (which wakes this task) or it timed out
+		TASK_PROBE: bring-up, until the gauge has answered and been configured (see probe)
+*/
+uint32_t RadeonRain::run(uint32_t now) {
+	if (bringup.state != SENSOR_READY) {
+		return probe(now);
+	}
+	if (checkLink()) {
+		return probe(now);
+	}
+	if (_requestedMode != mode) {
+		applyMode();
+	}
+	if (_resetPending && !awaitingReply) {
+		applyReset();
+	}
+	if (mode == RAIN_CONTINUOUS) {
+		return runContinuous(now);
+	}
+	switch (_taskState) {
+		case TASK_AWAIT: {
+			if (awaitingReply) {
+				uint32_t waited = halMillis() - _pollTime;
+				if (waited < responseTimeout) {
+					return (responseTimeout - waited) * 1000;	// woken by something else: keep waiting
+				}
+				pollTimeouts++;
+				awaitingReply=false;
+				if (_retriesLeft > 0) {
+					_retriesLeft--;
+					getReading();
+					return responseTimeout * 1000;
+				}
+			} else {
+				windows.add(halMillis(), myreading.accum);
+				adapt(myreading.accum > 0 || myreading.intervalacc > 0);
+			}
+			_taskState=TASK_IDLE;
+			return SampleClock::wait(_nextSample, now, readingInterval);
+		}
+		default: {
+			retime(now);
+			uint32_t wait = SampleClock::wait(_nextSample, now, readingInterval);
+			if (wait > 0) {
+				return wait;	// woken early: not a sample instant
+			}
+			_nextSample = nextSample(now);
+			if (!started) {
+				return _nextSample - now;
+			}
+			_retriesLeft=retries;
+			getReading();
+			_taskState=TASK_AWAIT;
+			return responseTimeout * 1000;
+		}
+	}
+}
+
+/*
+	Continuous mode task: no command is sent; the readings queued by the receive interrupt are merged here.
+	The task is woken early when the ring is half full, and publishes at the sample instants (see PM2_sampleclock.h):
+		accum		sum of the Acc values received in the interval (zero if nothing was received)
+		eventacc / totalacc		latest values received
+		intervalacc	latest RInt. The gauge is silent while the accumulation does not change, so it never
+					reports the intensity falling back to zero itself: once nothing has arrived for twice the
+					time the last intensity needs to add one RAIN_RESOLUTION step, it is taken as zero.
+	A dry gauge is silent too, so a dry interval in which nothing arrived ends with an 'R' keepalive: its reply is
+	queued like any other reading (its Acc is the rain since the last message, so nothing is counted twice) and
+	one still unanswered at the next silent interval is a poll timeout for checkLink, as in polled mode.
+*/
+uint32_t RadeonRain::runContinuous(uint32_t now) {
+	drainRing();
+	retime(now);
+	uint32_t wait = SampleClock::wait(_nextSample, now, readingInterval);
+	if (wait > 0) {
+		return wait;	// woken early just to empty the ring
+	}
+	if (myreading.intervalacc > 0) {
+		uint64_t expected = (uint64_t)RAIN_RESOLUTION * 3600000000ULL / (uint32_t)myreading.intervalacc;
+		if ((uint64_t)(now - _lastReadingTime) > 2 * expected) {
+			myreading.intervalacc=0;
+		}
+	}
+	bool raining = _windowAcc > 0 || myreading.intervalacc > 0;
+	bool silent = _windowReadings == 0 && myreading.intervalacc == 0;
+	windows.add(halMillis(), _windowAcc);
+	publishWindow();
+	if (silent && started) {
+		getReading();		// keepalive
+	}
+	sampleTime=now;
+	adapt(raining);
+	_nextSample = nextSample(now);
+	return _nextSample - now;
+}
+
+/*
+	Adaptive sampling: rain is falling while the gauge reports any accumulation or intensity (see PM2_adaptive.h).
+	A change of interval moves the next poll to the new interval's next sample instant.
+*/
+void RadeonRain::adapt(bool raining) {
+	uint32_t interval = rate.update(raining);
+	if (interval != readingInterval) {
+		readingInterval=interval;
+		_nextSample = nextSample(sampleTime);
+	}
+}
+
+/*
+	New sampling limits (SET_SAMPLING, SET_CONFIG) restart the sampling at their minimum interval from now,
+	rather than after the next reading.
+*/
+void RadeonRain::retime(uint32_t now) {
+	if (rate.changed()) {
+		readingInterval=rate.update(true);
+		_nextSample = nextSample(now);
+	}
+}
+
+void RadeonRain::drainRing() {
+	while (_ringTail != _ringHead) {
+		const RG15Reading &reading = _ring[_ringTail].reading;
+		if (reading.fields & RG15_ACC) {
+			_windowAcc += reading.acc;
+			_windowReadings++;
+			_lastReadingTime = _ring[_ringTail].time;
+		}
+		mergeTotals(reading);
+		if (reading.fields & RG15_RINT) myreading.intervalacc = reading.rInt;
+		SNAPSHOT_BARRIER();			// finished with the slot before handing it back
+		_ringTail = (_ringTail + 1) & (RAIN_LINE_RING - 1);
 	}
-	readingInProgress=false;
 }
+
+void RadeonRain::publishWindow() {
+	myreading.accum=_windowAcc;
+	snapshot.publish(myreading);
+	_windowAcc=0;
+	_windowReadings=0;
+	if (_onReading) {
+		_onReading();
+	}
+}
+
+/*
+	Called from the I2C handler: only records the request; the rain task sends the mode command.
+*/
+bool RadeonRain::setMode(uint8_t newMode) {
+	if (newMode > RAIN_CONTINUOUS) {
+		return false;
+	}
+	_requestedMode=(RainMode)newMode;
+	return true;
+}
+
+/*
+	Switch the gauge to the requested mode (main context). Whatever continuous readings are queued are
+	published first so no accumulation is lost; a poll still in flight is abandoned without counting a timeout.
+*/
+void RadeonRain::applyMode() {
+	if (mode == RAIN_CONTINUOUS) {
+		drainRing();
+		publishWindow();
+	}
+	mode=_requestedMode;
+	awaitingReply=false;
+	_taskState=TASK_IDLE;
+	_rainSerial->println(mode == RAIN_CONTINUOUS ? 'C' : 'P');
+	sampleTime=halMicros();
+}
+
+/*
+	Drain the serial receive ring into the line decoder.
+	Called from the UART's receive handler: on the board at the end of each burst (normally one whole line)
+	or half ring, see PM2_uartdma.h.
+	“Acc 0.000 in, EventAcc 0.000 in, TotalAcc 0.000 in, RInt 0.000 iph\r\n”
+*/
+void RadeonRain::serviceRx() {
+	METRIC_START(start);
+	const uint8_t *data;
+	uint16_t count;
+	while ((count = _rainSerial->rxSpan(data)) > 0) {
+		for (uint16_t i=0; i<count; i++) {
+			if (_parser.feed((char)data[i])) {
+				publish(_parser.reading());
+			}
+		}
+		_rainSerial->rxConsume(count);
+	}
+	METRIC_STOP(METRIC_RAIN_PARSE, start);
+}
+
+/*
+	Copy the decoded values (uM and uM/hr) into myreading.
+	Only values present in the line are updated; a line without the full set (eg the XTB line)
+	does not complete the poll.
+	Do NOT set missing readings to zero; just leave them there.
+*/
+void RadeonRain::publish(const RG15Reading &reading) {
+	if (reading.fields & RG15_BAUD) {
+		_baudReply=reading.baud;		// answer to a 'B' command (see probe)
+		if (_taskState == TASK_PROBE && _onReading) {
+			_onReading();				// wake the rain task: the bring-up query was answered
+		}
+		return;
+	}
+	if (mode == RAIN_CONTINUOUS) {
+		if ((reading.fields & RG15_READING) == RG15_READING) {
+			awaitingReply=false;		// the link is up, whether or not this answers a keepalive
+		}
+		queue(reading);
+		return;
+	}
+	if (reading.fields & RG15_ACC) myreading.accum = reading.acc;
+	mergeTotals(reading);
+	if (reading.fields & RG15_RINT) myreading.intervalacc = reading.rInt;
+	snapshot.publish(myreading);
+	if ((reading.fields & RG15_READING) == RG15_READING) {
+		if (awaitingReply) {
+			METRIC_RECORD(METRIC_RAIN_ROUND_TRIP, (halMicros() - sampleTime) * HAL_CYCLES_PER_US);
+		}
+		awaitingReply=false;
+		if (_onReading) {
+			_onReading();
+		}
+	}
+}
+/*
+	Continuous mode: hand an unsolicited reading to the rain task (single producer / single consumer ring).
+*/
+void RadeonRain::queue(const RG15Reading &reading) {
+	uint8_t next = (_ringHead + 1) & (RAIN_LINE_RING - 1);
+	if (next == _ringTail) {
+		ringOverruns++;
+		return;
+	}
+	_ring[_ringHead].reading=reading;
+	_ring[_ringHead].time=halMicros();
+	SNAPSHOT_BARRIER();			// the slot is complete before the task can see it
+	_ringHead=next;
+	if (((next - _ringTail) & (RAIN_LINE_RING - 1)) >= RAIN_LINE_RING / 2 && _onReading) {
+		_onReading();			// wake the rain task to empty the ring before it fills
+	}
+}
+
 /*  This (below) is an alternative getReading function.  It is less efficient than the one adopted above */
 
 /*
@@ -275,10 +732,10 @@ void RadeonRain::getReadingOld() {
 	String temp;
 	_rainSerial->println(commandString); 
 	while (!_rainSerial->available()) {
-		if (micros() - timer5 > timeout) {
+		if (halMicros() - timer5 > timeout) {
 			break;
 		}
-		delayMicroseconds(10);
+		halDelayMicroseconds(10);
 	}
 	if (_rainSerial->available() > 0) {
 		if (getReadingArray()) {
@@ -304,25 +761,35 @@ void RadeonRain::getReadingOld() {
 	return;
 }
 */
-// Return the Reading Values"
+// Return the Reading Values (from the published snapshot; never a half updated reading)
+RainReading RadeonRain::getReadingSet(){
+	RainReading reading;
+	snapshot.read(reading);
+	return reading;
+}
+
 floatbyte RadeonRain::getAccReading(){  // eg "34"
-	
-	return myreading.accum;
+	floatbyte rdg;
+	rdg.f = (float)getReadingSet().accum / RAIN_SCALE;
+	return rdg;
 }
 
 floatbyte RadeonRain::getEventAccReading(){
-	
-	return myreading.eventacc;
+	floatbyte rdg;
+	rdg.f = (float)getReadingSet().eventacc / RAIN_SCALE;
+	return rdg;
 }
 
 floatbyte RadeonRain::getTotalAccReading() {
-	
-	return myreading.totalacc;
+	floatbyte rdg;
+	rdg.f = (float)getReadingSet().totalacc / RAIN_SCALE;
+	return rdg;
 }
 
 floatbyte RadeonRain::getIntervalReading(){
-	
-	return myreading.intervalacc;
+	floatbyte rdg;
+	rdg.f = (float)getReadingSet().intervalacc / RAIN_SCALE;
+	return rdg;
 }
 /*
 decoding: Response:
@@ -1,21 +1,62 @@
 #pragma once
 
-#include <Arduino.h>
-#include <Wire.h>
-#include "pins.h"
-#include <time.h>
+#include "PM2_hal.h"
 #include "PM2_types.h"
+#include "PM2_encoding.h"
+#include "PM2_RG15parser.h"
+#include "PM2_snapshot.h"
+#include "PM2_sampleclock.h"
+#include "PM2_adaptive.h"
+#include "PM2_bringup.h"
+#include "PM2_rainwindows.h"
 
 
 extern floatbyte fbyte;
 
+// readings are held as scaled integers (see PM2_encoding.h)
 struct RainReading{
-	floatbyte accum;
-	floatbyte eventacc;
-	floatbyte totalacc;
-	floatbyte intervalacc;
+	int32_t accum;			// uM
+	int32_t eventacc;		// uM
+	int32_t totalacc;		// uM
+	int32_t intervalacc;	// uM/hr
 };
 
+/*
+	Operating modes of the gauge (selected over I2C with SET_RAIN_MODE)
+	RAIN_POLLED:		'P' the gauge only answers an 'R' poll; one poll every readingInterval
+	RAIN_CONTINUOUS:	'C' the gauge sends a reading whenever the accumulation changes (nothing is sent while it is dry).
+						The unsolicited readings are queued by the receive interrupt and merged by the rain task
+						once every readingInterval, so the published values mean the same in both modes.
+						A dry interval without a reading ends with an 'R' keepalive, so a gauge that stops
+						answering is noticed (see checkLink) rather than read as a dry one.
+*/
+enum RainMode : uint8_t {
+	RAIN_POLLED=0,
+	RAIN_CONTINUOUS=1
+};
+
+#define RAIN_LINE_RING 8		// continuous mode readings waiting for the rain task (power of 2)
+#define RAIN_RESOLUTION 10		// uM: accumulation step of the gauge in high resolution metric mode (set by slowStart)
+
+// adaptive sampling (see PM2_adaptive.h): faster while it rains. The gauge keeps accumulating between polls,
+// so a slow rate when dry loses no rain, only the time resolution of its onset.
+#define RAIN_SAMPLING_MIN 2000000		// uS
+#define RAIN_SAMPLING_MAX 60000000		// uS
+#define RAIN_SAMPLING_HYSTERESIS 3		// dry readings before each back off
+
+/*
+	Baud rate negotiation ('B' command). The gauge may keep a rate set by an earlier run across a power cycle,
+	so the bring-up probes for the rate it answers on and moves both ends to the fastest rate up to maxBaudCode
+	that passes a round trip, one query per task run (see RadeonRain::probe). If the link later fails the gauge
+	goes back to the bring-up, which settles on a slower rate.
+*/
+#define RG15_BAUD_CODES 7
+#define RG15_DEFAULT_BAUD_CODE 3	// 9600
+#define RAIN_BAUD_LATENCY 20		// mS allowed for the gauge to start its reply to 'B'
+#define RAIN_BAUD_RETRIES 3			// attempts at each rate change
+#define RAIN_BAUD_ROUND_TRIPS 4		// queries a new rate has to answer in a row to be accepted
+#define RAIN_LINK_FAILURES 3		// timeouts / undecodable lines without a good reading before falling back
+
 struct CommandResponse {
 	char command;
 	char response;
@@ -23,22 +64,31 @@ struct CommandResponse {
 
 class RadeonRain {
 	public:
-		RadeonRain(HardwareSerial *serial); // default construcur
-		bool begin(HardwareSerial *serial);
+		RadeonRain(SerialPort *serial); // default construcur
+		bool begin(SerialPort *serial);
 		bool stop();
 		bool start();
 		bool slowStart();
 		void getReading();
+		void serviceRx();			// called from the UART receive handler (end of a burst)
+		const UartRxStats &rxStats() const { return _rainSerial->rxStats; }
+		uint32_t run(uint32_t now);	// scheduler task: send poll, await reply, publish
+		void onReading(void (*callback)()) { _onReading = callback; }	// called from the interrupt handler on publish
 		//void getReadingOld();
-		void resetAccum();
+		void resetAccum();			// called from the I2C handler: applied by the rain task
+		void restoreTotals(int32_t totalacc, int32_t eventacc);	// checkpoint recovered from flash (see PM2_flashlog.h)
 		bool checkStarted();
 		floatbyte getAccReading();
 		floatbyte getEventAccReading();
 		floatbyte getTotalAccReading();
 		floatbyte getIntervalReading();
 		bool started=false;
+		Bringup bringup;			// found and configured by the rain task (see probe); reported by GET_SENSOR_STATUS
 		
 		RainReading myreading;		// temporary storage for readings between Serial.Read and I2C fetching
+		Snapshot<RainReading> snapshot;		// myreading as published to the I2C handlers
+		RainReading getReadingSet();		// last complete reading set
+		RainWindows windows;				// rolling 1 / 10 / 60 minute totals (GET_RAIN_1MIN ..)
 		CommandResponse mycomands;
 
 		const CommandResponse StartupCommandResponseAry[4] = {
@@ -48,18 +98,100 @@ class RadeonRain {
 			{'O','\0'}		// reset accumulation counter
 		};
 		int8_t numStartupCommands=4;
-		bool readingInProgress;
+		volatile bool awaitingReply=false;	// an 'R' poll (or keepalive) was sent and no reading has been received since
+		uint32_t pollTimeouts=0;			// polls that were not answered within responseTimeout
+		uint32_t responseTimeout=1000;		// mS (a complete reply takes ~66 mS at 9600 baud)
+		uint8_t retries=0;					// polls sent again at once after a timeout (CONFIG_RAIN_RETRIES)
+		uint32_t readingInterval=RAIN_SAMPLING_MIN;	// uS between readings (set by rate)
+		AdaptiveRate rate{RAIN_SAMPLING_MIN, RAIN_SAMPLING_MAX, RAIN_SAMPLING_HYSTERESIS};
+		uint32_t sampleTime=0;				// micros() when the poll for the latest reading was sent
+		void useClock(SampleClock *clock) { _clock = clock; }	// sample instants shared with the other sensor
+		volatile RainMode mode=RAIN_CONTINUOUS;		// mode the gauge was last set to
+		bool setMode(uint8_t newMode);		// called from the I2C handler: applied by the rain task
+		RainMode requestedMode() const { return _requestedMode; }
+		uint32_t ringOverruns=0;			// continuous mode readings lost because the ring was full
+
+		void onPortBegin(void (*callback)(uint32_t baud)) { _portBegin = callback; }	// (re)start the UART at a new rate
+		uint32_t baudRate() const;			// rate the link is running at
+		uint8_t baudCode=RG15_DEFAULT_BAUD_CODE;
+		uint8_t maxBaudCode=RG15_BAUD_CODES - 1;	// fastest rate to try; lowered after a fallback
+		uint32_t probeTime=0;				// uS taken by the last negotiation (from the first query of its pass)
+		uint32_t linkFallbacks=0;			// times the link failed and the gauge went back to the bring-up
+		const RG15ParserStats &parserStats() const { return _parser.stats(); }
 	private:
-		HardwareSerial * _rainSerial;
-		
+		SerialPort * _rainSerial;
+		void publish(const RG15Reading &reading);
+		void mergeTotals(const RG15Reading &reading);
+		RG15Parser _parser;			// decodes each line as it arrives
+		uint32_t _pollTime=0;		// millis() when the last poll was sent
+		enum TaskState : uint8_t { TASK_IDLE, TASK_AWAIT, TASK_PROBE };
+		TaskState _taskState=TASK_IDLE;
+		void (*_onReading)()=nullptr;
+		SampleClock *_clock=nullptr;
+		uint32_t _nextSample=0;		// micros() of the next sample instant
+		uint32_t nextSample(uint32_t now) { return _clock ? _clock->next(now, readingInterval) : now + readingInterval; }
+		volatile RainMode _requestedMode=RAIN_CONTINUOUS;
+		void applyMode();
+		volatile bool _resetPending=false;	// RAIN_RESETACCUM received, 'O' not sent yet
+		void applyReset();
+		uint32_t runContinuous(uint32_t now);
+		void queue(const RG15Reading &reading);
+		void drainRing();
+		void publishWindow();
+		void adapt(bool raining);
+		void retime(uint32_t now);
+		uint8_t _retriesLeft=0;		// retries left for the current sample instant
+
+		// continuous mode: readings decoded by the receive interrupt and consumed by the rain task
+		struct QueuedReading {
+			RG15Reading reading;
+			uint32_t time;				// micros() when the line was decoded
+		};
+		QueuedReading _ring[RAIN_LINE_RING];
+		volatile uint8_t _ringHead=0;	// written by the interrupt handler
+		volatile uint8_t _ringTail=0;	// written by the rain task
+		int32_t _windowAcc=0;			// uM received since the last publish
+		uint16_t _windowReadings=0;		// readings received since the last publish
+		uint32_t _lastReadingTime=0;	// micros() of the latest continuous mode reading
+
+		void (*_portBegin)(uint32_t baud)=nullptr;
+		volatile int32_t _baudReply=0;	// rate in the last "Baud" line (set by the interrupt handler)
+		void portBegin(uint8_t code);
+		uint32_t sendBaudCommand(int8_t code, uint8_t listenCode);
+		bool checkLink();
+		uint32_t _linkReadings=0;		// parser readings at the last link check
+		uint32_t _linkErrors=0;			// failures counted at the last good reading
+		bool _relink=false;				// back in the bring-up after the link failed (keep the accumulation)
+		uint8_t _maxBeforeFallback=0;	// maxBaudCode before the link failed
+
+		// bring-up: one 'B' query per task run (see probe)
+		enum ProbeState : uint8_t { PROBE_FIND, PROBE_SWITCH, PROBE_SETTLE, PROBE_VERIFY, PROBE_RETURN };
+		uint32_t probe(uint32_t now);
+		uint32_t findRate(uint32_t now);
+		uint32_t sendQuery();
+		uint32_t sendProbe(int8_t code, uint8_t listenCode);
+		uint32_t switchRate();
+		uint32_t targetFailed();
+		uint32_t configured(uint32_t now);
+		ProbeState _probeState=PROBE_FIND;
+		uint8_t _probeStep=0;			// PROBE_FIND: rates queried in this pass
+		uint8_t _probeCode=0;			// rate the UART is listening at
+		uint8_t _probeExpect=0;			// rate the reply should name
+		int8_t _targetCode=0;			// rate being negotiated (-1: none left)
+		uint8_t _probeAttempts=0;		// PROBE_SWITCH: retries; PROBE_VERIFY: round trips answered
+		uint32_t _probeBegan=0;			// micros() at the first query of the pass
+		uint32_t _probeStart=0;			// micros() when the query in flight was sent
+		uint32_t _probeTimeout=0;		// uS
+
+		// the gauge is cleared with 'O' at start up: totals restored from flash are carried on top of its counters
+		int32_t _totalBase=0;			// uM
+		int32_t _eventBase=0;			// uM; dropped once the gauge reports the event over
+
 		//bool getReadingArray();
 		//char readingArray[13][10];  // “Acc 0.000 in, EventAcc 0.000 in, TotalAcc 0.000 in, RInt 0.000 iph” 
 									//  numbers from 0.000 up to 99999.999 mm (length of 9))
 		//bool sendCommand(char commandString, char responseString);
 		void emptyReadBuffer();
-		#define bufferSize 90
-		char buffer[bufferSize]=""; // Buffer that stores characters read from the RG-15
-		int8_t bufPos = 0;
 
 };
 
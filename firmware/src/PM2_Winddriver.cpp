@@ -1,5 +1,7 @@
 
 #include "PM2_Winddriver.h"
+#include "PM2_metrics.h"
+#include "PM2_log.h"
 
 /*
     The Calypson ULP UART Wind sensor provides Wind Speed and Wind direction readings.
@@ -24,183 +26,413 @@
     The particular device ordered is set to deliver wind speed in Metres/sec, 
     Relative Angle and the data rate is 38400 bits/sec 8 data bits No Parity 1 Stop Bit.
     The character set is US ASCII.
+    The device can also send the MWV sentence by itself at 1 to 4 Hz (WIND_STREAMING, see sendMode); it is
+    then timed by the sensor's own clock, so the readings are not on the SampleClock grid.
 
 */
-CalypsoWind::CalypsoWind( HardwareSerial *serial) {
+CalypsoWind::CalypsoWind( SerialPort *serial) {
     _windSerial = serial;
-    myreading.winddir.f=0.00;
-    myreading.windspeed.f=0.00; 
-   
+    myreading.winddir=0;
+    myreading.windspeed=0; 
+    snapshot.publish(myreading);
+    statsSnapshot.publish(stats.result());
 }
-bool CalypsoWind::begin(HardwareSerial *serial)
+bool CalypsoWind::begin(SerialPort *serial)
 {
 	//bool response = false;
 	_windSerial = serial;
     /*
-        send the reading command; and check for a response, then we can be certain the device is operating
+        nothing waits for the sensor here: the wind task sends the reading command and starts the
+        sensor once it answers (see probe), so setup() never blocks on an absent anemometer
     */ 
-    myreading.winddir.f=0.00;
-    myreading.windspeed.f=0.00;
-    
-    start();
-
-    started=true;
-    return started;
+    myreading.winddir=0;
+    myreading.windspeed=0;
+    bringup.restart();
+    return true;
 }
 
+/*
+    Called from receiveEvent (START_WIND), so it never waits: a sensor that has answered before is simply
+    started again; otherwise the bring-up starts over without its backoff and the master is Nacked until
+    GET_SENSOR_STATUS reports the sensor ready.
+*/
 bool CalypsoWind::start()
 {
-	bool response = false;
-    response = sendCommand();
-	if (response) {
+    if (bringup.state == SENSOR_READY) {
         started=true;
-       
-        SerialUSB.print("Wind  sensor was started:..");
-       
         return true;
-    } else {
-       
-        SerialUSB.print("Wind  sensor did not respond to start command:..");
-       
-        started=false;
-        return false;
     }
-   
-	return true;
+    bringup.restart();
+    return false;
 }
 
 bool CalypsoWind::stop()
 {
 	started = false;
-    #ifdef debug_PM2
-    SerialUSB.print("Wind  sensor was casked to stop:..");
-    #endif
+    LOG_DEBUG(LOG_WIND_STOPPED, 0);
 	return true;
 }
 
+/*
+    Send the poll; the reply is decoded as it arrives (see serviceRx) so there is no waiting here.
+*/
 bool CalypsoWind::sendCommand() 
 {
-    uint32_t timer = 100;
-     _windSerial->println(commandString);   // send a polling command to begin including CR LF
+    _windSerial->print(commandString);   // send a polling command (the string includes CR LF)
+    _pollTime = halMillis();
+    sampleTime = halMicros();
+    awaitingReply = true;
+    return true;
+}
 
-   while (_windSerial->available() == 0) {     // wait for the device to start up and send back a response.
-        delay(10);
-        if (millis() - timer > 100) {
-            break;  // timeout
+/*
+    Bring-up (wind task, until the sensor is ready): send the reading command and wait for the answer without
+    blocking. An unanswered attempt is retried with an exponential backoff (see PM2_bringup.h).
+*/
+uint32_t CalypsoWind::probe(uint32_t now) {
+    if (_taskState != TASK_PROBE) {
+        sendCommand();
+        _taskState = TASK_PROBE;
+        return responseTimeout * 1000;
+    }
+    if (awaitingReply) {
+        uint32_t waited = halMillis() - _pollTime;
+        if (waited < responseTimeout) {
+            return (responseTimeout - waited) * 1000;   // woken by START_WIND: keep waiting
         }
+        awaitingReply = false;
+        _taskState = TASK_IDLE;
+        uint32_t retry = bringup.failed();
+        LOG_WARN(LOG_WIND_NO_RESPONSE, bringup.failures);
+        return retry;
     }
-    if (_windSerial->available() > 0) {
-        return true;
-    } else {
+    _taskState = TASK_IDLE;
+    bringup.ready();
+    started = true;
+    LOG_INFO(LOG_WIND_STARTED, 0);
+    _nextSample = nextSample(now);      // the answer was the first reading: the next one on the shared grid
+    return _nextSample - now;
+}
+
+/*
+    Request a new reading. The reading is published by serviceRx() when the reply arrives;
+    a poll that is still unanswered after responseTimeout is counted as a timeout and replaced.
+*/
+void CalypsoWind::getReading() {
+    if (awaitingReply) {
+        if (halMillis() - _pollTime < responseTimeout) {
+            return;     // previous poll is still in flight
+        }
+        pollTimeouts++;
+    }
+    sendCommand();
+}
+
+/*
+    Scheduler task. The reading is a small state machine so that the CPU never waits for the sensor:
+        TASK_IDLE:  send the poll (getReading) and sleep until the reply or responseTimeout
+        TASK_AWAIT: bytes are parsed and published by serviceRx as they arrive, which wakes this task;
+                    a poll still unanswered at this point has timed out.
+        TASK_PROBE: bring-up, until the sensor has answered once (see probe).
+    Polls are sent at the sample instants of the SampleClock shared with the rain task (one every
+    readingInterval, which adapt() sets after each reading), so neither sensor drifts and both readings
+    of a set are taken together.
+*/
+uint32_t CalypsoWind::run(uint32_t now) {
+    if (bringup.state != SENSOR_READY) {
+        return probe(now);
+    }
+    if (_modePending) {
+        _modePending = false;
+        applyMode(now);
+    }
+    if (mode == WIND_STREAMING) {
+        return runStreaming(now);
+    }
+    switch (_taskState) {
+        case TASK_AWAIT: {
+            if (awaitingReply) {
+                uint32_t waited = halMillis() - _pollTime;
+                if (waited < responseTimeout) {
+                    return (responseTimeout - waited) * 1000;   // woken by something else: keep waiting
+                }
+                pollTimeouts++;
+                awaitingReply = false;
+                if (_retriesLeft > 0) {
+                    _retriesLeft--;
+                    sendCommand();
+                    return responseTimeout * 1000;
+                }
+            } else {
+                WindSample sample = { getReadingSet(), sampleTime };
+                updateStats(sample.reading, halMillis());
+                adapt((float)sample.reading.windspeed / WIND_SPEED_SCALE);
+                consume(sample);
+            }
+            _taskState = TASK_IDLE;
+            return SampleClock::wait(_nextSample, now, readingInterval);
+        }
+        default: {
+            retime(now);
+            uint32_t wait = SampleClock::wait(_nextSample, now, readingInterval);
+            if (wait > 0) {
+                return wait;    // woken early: not a sample instant
+            }
+            _nextSample = nextSample(now);
+            if (!started) {
+                return _nextSample - now;
+            }
+            _retriesLeft = retries;
+            getReading();
+            _taskState = TASK_AWAIT;
+            return responseTimeout * 1000;
+        }
+    }
+}
+
+/*
+    New sampling limits (SET_SAMPLING, SET_CONFIG) restart the sampling at their minimum interval from now,
+    rather than after the next reading, which could be up to the old maximum interval away.
+*/
+void CalypsoWind::retime(uint32_t now) {
+    if (rate.changed()) {
+        readingInterval = rate.update(true);
+        _nextSample = nextSample(now);
+    }
+}
+
+/*
+    Streaming (wind task, woken by each sentence): hand the queued samples to the statistics and the consumer.
+    The time between two samples, in periods of the requested rate, shows the sentences missing in between;
+    the total time over the total periods is the drift of the sensor's clock. A stream silent for
+    WIND_STREAM_LOST periods counts as a timeout and the mode sentence is sent again (the sensor was
+    restarted, or missed the command).
+*/
+uint32_t CalypsoWind::runStreaming(uint32_t now) {
+    uint32_t period = streamPeriod();
+    uint8_t head = _ringHead;
+    if (_ringTail != head) {
+        _lastStreamCheck = now;
+    }
+    while (_ringTail != head) {
+        WindSample sample = _ring[_ringTail & (WIND_SAMPLE_RING - 1)];
+        _ringTail++;
+        streamStats.samples++;
+        if (_streamSynced) {
+            uint32_t interval = sample.time - _lastSampleTime;
+            uint32_t periods = (interval + period / 2) / period;
+            if (periods > 0) {
+                streamStats.gaps += periods - 1;
+                _streamElapsed += interval;
+                _streamPeriods += periods;
+                int64_t nominal = (int64_t)_streamPeriods * period;
+                streamStats.driftPpm = (int32_t)(((int64_t)_streamElapsed - nominal) * 1000000 / nominal);
+            }
+            // else: under half a period after the previous one (a poll reply still in flight when the mode
+            // changed): the timing starts again from this sample
+        }
+        _lastSampleTime = sample.time;
+        _streamSynced = true;
+        if (started) {
+            updateStats(sample.reading, halMillis() - (now - sample.time) / 1000);
+            consume(sample);
+        }
+    }
+    uint32_t silent = now - _lastStreamCheck;
+    if (silent >= WIND_STREAM_LOST * period) {
+        pollTimeouts++;
+        streamStats.restarts++;
+        LOG_WARN(LOG_WIND_NO_RESPONSE, streamStats.restarts);
+        sendMode(streamRate);
+        _streamSynced = false;
+        _lastStreamCheck = now;
+        silent = 0;
+    }
+    return WIND_STREAM_LOST * period - silent;
+}
+
+void CalypsoWind::consume(const WindSample &sample) {
+    if (_onSample) {
+        _onSample(sample);
+    }
+}
+
+/*
+    Called from the I2C handler: only records the request; the wind task sends the mode sentence (again, if the
+    mode is unchanged, which also restarts the drift measurement). The rate only matters for WIND_STREAMING.
+*/
+bool CalypsoWind::setMode(uint8_t newMode, uint8_t hz) {
+    if (newMode > WIND_STREAMING || (newMode == WIND_STREAMING && (hz == 0 || hz > WIND_STREAM_RATE_MAX))) {
         return false;
     }
+    if (newMode == WIND_STREAMING) {
+        _requestedRate = hz;
+    }
+    _requestedMode = (WindMode)newMode;
+    _modePending = true;
+    return true;
+}
 
+/*
+    Switch the anemometer to the requested mode (main context). Samples still queued are consumed first; a
+    poll in flight is abandoned without counting a timeout. Back in polled mode the polls go back on the grid.
+*/
+void CalypsoWind::applyMode(uint32_t now) {
+    if (mode == WIND_STREAMING) {
+        runStreaming(now);
+    }
+    mode = _requestedMode;
+    streamRate = _requestedRate;
+    awaitingReply = false;
+    _taskState = TASK_IDLE;
+    _ringTail = _ringHead;
+    _streamSynced = false;
+    _streamElapsed = 0;
+    _streamPeriods = 0;
+    _lastStreamCheck = now;
+    sendMode(mode == WIND_STREAMING ? streamRate : 0);
+    readingInterval = (mode == WIND_STREAMING) ? streamPeriod() : rate.interval();
+    _nextSample = nextSample(now);
 }
 
-void CalypsoWind::getReading() {
-    readingInProgress=true;
-    String temp;
-    if (sendCommand()) {
-        if (_windSerial->available() > 0) {         // when we get a response; decode it and save into Buffer
-           if (getReadingArray()) {
-                // convert received values into floating point numbers for efficient transmission to the host MCU
-                temp=readingArray[1];
-                myreading.winddir.f=temp.toFloat();
-                temp=readingArray[3];
-                myreading.windspeed.f=temp.toFloat();
-            } else {
-                myreading.winddir.f=0.00;
-                myreading.windspeed.f=0.00;
+/*
+    "$ULPO,<Hz>*hh\r\n": output rate of the MWV sentence, 0 for query mode ($ULPI polls).
+    The poll goes out with a dummy checksum; this one carries the real one.
+*/
+void CalypsoWind::sendMode(uint8_t hz) {
+    static const char hex[] = "0123456789ABCDEF";
+    char sentence[] = "$ULPO,0*00\r\n";
+    sentence[6] = '0' + hz;
+    uint8_t checksum = 0;
+    for (uint8_t i=1; sentence[i] != '*'; i++) {
+        checksum ^= sentence[i];
+    }
+    sentence[8] = hex[checksum >> 4];
+    sentence[9] = hex[checksum & 0x0F];
+    _windSerial->print(sentence);
+}
+
+/*
+    Add a reading to the statistics window (in the main loop: the trigonometry is too slow for the
+    receive interrupt) and publish the results. The window restarts after the master has read it.
+*/
+void CalypsoWind::updateStats(const windreading &reading, uint32_t timeMs) {
+    if (_statsResetPending) {
+        _statsResetPending = false;
+        stats.reset();
+    }
+    stats.add(timeMs, (float)reading.winddir / WIND_DIR_SCALE, (float)reading.windspeed / WIND_SPEED_SCALE);
+    statsSnapshot.publish(stats.result());
+}
+
+/*
+    Adaptive sampling: the wind is active while it is strong, or while the speed varies (an exponentially
+    weighted variance over about WIND_ACTIVITY_READINGS readings, so a gust front shows before the mean rises).
+    A change of interval moves the next poll to the new interval's next sample instant.
+*/
+void CalypsoWind::adapt(float speed) {
+    float delta = speed - _speedMean;
+    _speedMean += delta / WIND_ACTIVITY_READINGS;
+    _speedVariance += (delta * (speed - _speedMean) - _speedVariance) / WIND_ACTIVITY_READINGS;
+    bool active = speed >= WIND_ACTIVE_SPEED || _speedVariance >= WIND_ACTIVE_STDDEV * WIND_ACTIVE_STDDEV;
+    uint32_t interval = rate.update(active);
+    if (interval != readingInterval) {
+        readingInterval = interval;
+        _nextSample = nextSample(sampleTime);
+    }
+}
+
+/*
+    Drain the serial receive ring into the MWV parser.
+    Called from the UART's receive handler (on the board at the end of each burst or half ring, see
+    PM2_uartdma.h), so each call normally consumes a whole sentence, taken as contiguous spans of the ring.
+*/
+void CalypsoWind::serviceRx() {
+    METRIC_START(start);
+    const uint8_t *data;
+    uint16_t count;
+    while ((count = _windSerial->rxSpan(data)) > 0) {
+        for (uint16_t i=0; i<count; i++) {
+            if (_parser.feed((char)data[i])) {
+                publish(_parser.sentence());
             }
         }
+        _windSerial->rxConsume(count);
     }
-    readingInProgress=false;
+    METRIC_STOP(METRIC_WIND_PARSE, start);
 }
 
-// Return the Reading Values
-floatbyte CalypsoWind::getWind_Dir(){
+void CalypsoWind::publish(const MWVSentence &sentence) {
+    int64_t speed = sentence.speed;     // hundredths of the units sent (up to 6 integer digits: widened for knots)
+    switch (sentence.units) {
+        case 'N': {     // knots
+            speed = speed * 1852 / 3600;
+            break;
+        }
+        case 'K': {     // KM/Hr
+            speed = speed * 1000 / 3600;
+            break;
+        }
+        default: {      // M (Metres/s) as configured
+            break;
+        }
+    }
+    if (sentence.angle > 3600 || speed > INT16_MAX) {
+        return;     // out of range: treated as no reply
+    }
+    myreading.winddir = (int16_t)sentence.angle;
+    myreading.windspeed = (int16_t)speed;
+    snapshot.publish(myreading);
+    if (mode == WIND_STREAMING) {
+        if ((uint8_t)(_ringHead - _ringTail) < WIND_SAMPLE_RING) {
+            WindSample &sample = _ring[_ringHead & (WIND_SAMPLE_RING - 1)];
+            sample.reading = myreading;
+            sample.time = halMicros();
+            _ringHead++;
+        } else {
+            streamStats.ringOverruns++;
+        }
+    }
+    if (awaitingReply) {
+        METRIC_RECORD(METRIC_WIND_ROUND_TRIP, (halMicros() - sampleTime) * HAL_CYCLES_PER_US);
+    }
+    awaitingReply = false;
+    if (_onReading) {
+        _onReading();
+    }
+}
+
+// Return the Reading Values (from the published snapshot; never a half updated reading)
+windreading CalypsoWind::getReadingSet(){
+    windreading reading;
+    snapshot.read(reading);
+    return reading;
+}
 
-	return (myreading.winddir); // eg 345 (deg T)  Its an integer but we handle it as a float (4 bytes)
+floatbyte CalypsoWind::getWind_Dir(){
+    floatbyte rdg;
+    rdg.f = (float)getReadingSet().winddir / WIND_DIR_SCALE;
+	return (rdg); // eg 345 (deg T)  Its an integer but we handle it as a float (4 bytes)
 }
 
 floatbyte CalypsoWind::getWind_Speed(){
-   
-	return (myreading.windspeed); // eg 000.51  (m/s)
+    floatbyte rdg;
+    rdg.f = (float)getReadingSet().windspeed / WIND_SPEED_SCALE;
+	return (rdg); // eg 000.51  (m/s)
 }
 
 /*
 this device sends back readings in the form of an NMEA0183 MVW type string (sentence).
 Input: NMEA0183 MWV Sentence = 
 $--MWV,     (0)
-x.x,        (1)
-a,          (2)
-x.x,        (3)
-a           (4)
+x.x,        (1) Wind Direction
+a,          (2) Ref ('R' or 'A')  (Always R)
+x.x,        (3) Wind Speed
+a           (4) Units (N (Knots) /M (Metres/s) / K KM/Hr) (always M)
 *hh          (5) Checksum
 \r
 \n 
 to $--MWV,999.99,a,999.99,a*hh\r\n (25 Char - 31 char)
-There needs to be two nested arrays created (an array of char arrays comprising the readings)
-char array elements of the outer array:
-    0. MVW Header= $--MWV: Discard
-    * 1. Wind Direction : (integer) Value, 
-    2. Char[1] Ref ('R' or 'A')  (Always R)
-    * 3. Wind Speed : (double/float) Value (6 digits), 
-    4. Char[1] Ref (N (Knots) /M (Metres/s) / K KM/Hr) (always M)
-    5. Checksum (*hh)
-    6. End of line \r\n
-
-The reading sentence is returned as an array of character arrays (readingArray)
-we do not compute the checksum.
+The sentence is decoded byte by byte by MWVParser (PM2_MWVparser.cpp) as it is received,
+including verification of the checksum; nothing is buffered and no String objects are used.
 */
-bool CalypsoWind::getReadingArray() 
-{
-    const char CR=13;       // characters appearing at the end of the NMEX sentence
-    const char LF=10;
-    uint8_t i=0;        // buffer position index
-    uint8_t j=0;        // outer array index
-    uint8_t k=0;        // inner char array index
-    bufPos=0;           // index of the end of the buffer
-	String tmpStr="";   // temporary holder during parsing
-
-    // read the serial line input into a buffer
-	while (_windSerial->available() > 0) {
-		buffer[bufPos++] = _windSerial->read();	// append to the buffer (array of char)
-	}
-    // parse the contents of the buffer
-    if (buffer[0] == '$') {   // check for NMEA0183 start character
-        for (i=0;i<(bufPos-1);i++) {
-            switch (buffer[i]) {
-                // any of these characters represent the end of each value within a set of readings
-                case ',': 
-                case 32: 
-                case '*':
-                case CR:
-                {
-                    // inner loop creating each char array element
-                    for (k=0; k<tmpStr.length(); k++) {
-                        readingArray[j][k] = tmpStr[k];
-                    }
-                    readingArray[j][k+1]='\0'; // add null termination for this character array, allowing numeric conversions
-                    j++;
-                    tmpStr="";
-                    if (buffer[i] == CR) i=99;  // exit the outer loop
-                    break; 
-                }
-                case '\0':
-                case LF : {  // Ignore if it is present
-                    break; 
-                }
-                default: {
-                    tmpStr.concat(buffer[i]);
-                    break;
-                }
-            } // switch
-        } // for
-    }   // if
-    if (j > 0) {
-        return true;
-    } else {
-        return false;
-    }
-}
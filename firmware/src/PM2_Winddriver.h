@@ -1,43 +1,142 @@
 #pragma once
 
-#include <Arduino.h>
-#include <Wire.h>
-#include "pins.h"
-#include <time.h>
+#include "PM2_hal.h"
 #include "PM2_types.h"
+#include "PM2_encoding.h"
+#include "PM2_MWVparser.h"
+#include "PM2_snapshot.h"
+#include "PM2_sampleclock.h"
+#include "PM2_adaptive.h"
+#include "PM2_bringup.h"
+#include "PM2_windstats.h"
 
 extern floatbyte fbyte;			// maybe unnecessary as this same line is found in PM2_types.h
 
+// adaptive sampling (see PM2_adaptive.h): faster while the wind is strong or gusty
+#define WIND_SAMPLING_MIN 1000000		// uS
+#define WIND_SAMPLING_MAX 10000000		// uS
+#define WIND_SAMPLING_HYSTERESIS 6		// quiet readings before each back off
+#define WIND_ACTIVE_SPEED 5.0			// m/s
+#define WIND_ACTIVE_STDDEV 1.0			// m/s: of the speed over the last few readings
+#define WIND_ACTIVITY_READINGS 8		// weight of the running mean and variance (about this many readings)
+
+// readings are held as scaled integers (see PM2_encoding.h)
 typedef struct WindReading {
-	floatbyte winddir;
-	floatbyte windspeed;
+	int16_t winddir;		// deci-degrees
+	int16_t windspeed;		// centi-m/s
 } windreading;
 
+/*
+	Operating modes of the anemometer (selected over I2C with SET_WIND_MODE)
+	WIND_POLLED:	one "$ULPI*00" query per reading, at the adaptive sampling rate
+	WIND_STREAMING:	the anemometer sends an MWV sentence streamRate times a second by itself. Each sentence is
+					queued by the receive interrupt and handed by the wind task to the statistics and to the
+					onSample consumer; sentences missing from the stream and the drift of its rate are counted.
+	The output mode sentence is proprietary NMEA like the query: "$ULPO,<Hz>*hh", 0 Hz for query mode.
+*/
+enum WindMode : uint8_t {
+	WIND_POLLED=0,
+	WIND_STREAMING=1
+};
+
+#define WIND_STREAM_RATE 4				// Hz: default streaming rate
+#define WIND_STREAM_RATE_MAX GUST_RATE_MAX	// Hz: fastest output rate of the ULP (the gust window is sized for it)
+#define WIND_SAMPLE_RING 8				// streamed samples waiting for the wind task (power of 2)
+#define WIND_STREAM_LOST 3				// periods without a sentence: a timeout, and the mode is sent again
+
+struct WindSample {
+	windreading reading;
+	uint32_t time;						// micros() when the sentence was decoded
+};
+
+struct WindStreamStats {
+	uint32_t samples;					// sentences received while streaming
+	uint32_t gaps;						// sentences missing from the stream (from the time between sentences)
+	uint32_t ringOverruns;				// samples lost because the wind task did not empty the ring in time
+	uint32_t restarts;					// mode sentences sent again after the stream stopped
+	int32_t driftPpm;					// measured period against the nominal one (+: the sensor is slow)
+};
+
 class CalypsoWind {
 	public:
-		CalypsoWind( HardwareSerial *serial);	// default constructor
-		bool begin(HardwareSerial *serial);
+		CalypsoWind( SerialPort *serial);	// default constructor
+		bool begin(SerialPort *serial);
 		bool stop();
 		bool start();
 		floatbyte getWind_Dir();
 		floatbyte getWind_Speed();
 
 		void getReading();
+		void serviceRx();			// called from the UART receive handler (end of a burst)
+		const UartRxStats &rxStats() const { return _windSerial->rxStats; }
+		uint32_t run(uint32_t now);	// scheduler task: send poll, await reply, publish
+		void onReading(void (*callback)()) { _onReading = callback; }	// called from the interrupt handler on publish
 		bool started=false;
+		Bringup bringup;					// found by the wind task (see probe); reported by GET_SENSOR_STATUS
 
-		windreading myreading;
+		windreading myreading;				// latest reading (written by the receive interrupt)
+		Snapshot<windreading> snapshot;		// myreading as published to the I2C handlers
+		windreading getReadingSet();		// last complete reading set
+		WindStats stats;					// statistics of the readings since the master last read them
+		Snapshot<WindStatistics> statsSnapshot;	// stats results as published to the I2C handlers
+		void requestStatsReset() { _statsResetPending = true; }	// called by the I2C handler once the results were read
 		
-		const String commandString = "$ULPI*00\r\n";
-		bool readingInProgress;
+		const char *commandString = "$ULPI*00\r\n";
+		volatile bool awaitingReply=false;	// a poll was sent and no sentence has been received since
+		uint32_t pollTimeouts=0;			// polls that were not answered within responseTimeout
+		uint32_t responseTimeout=100;		// mS
+		uint8_t retries=0;					// polls sent again at once after a timeout (CONFIG_WIND_RETRIES)
+		uint32_t readingInterval=WIND_SAMPLING_MIN;	// uS between readings (set by rate)
+		AdaptiveRate rate{WIND_SAMPLING_MIN, WIND_SAMPLING_MAX, WIND_SAMPLING_HYSTERESIS};
+		uint32_t sampleTime=0;				// micros() when the poll for the latest reading was sent
+		void useClock(SampleClock *clock) { _clock = clock; }	// sample instants shared with the other sensor
+		const MWVParserStats &parserStats() const { return _parser.stats(); }
+
+		volatile WindMode mode=WIND_POLLED;	// mode the anemometer was last set to
+		uint8_t streamRate=WIND_STREAM_RATE;	// Hz while streaming
+		bool setMode(uint8_t newMode, uint8_t hz);	// called from the I2C handler: applied by the wind task
+		WindMode requestedMode() const { return _requestedMode; }
+		void onSample(void (*consumer)(const WindSample &sample)) { _onSample = consumer; }	// every reading (wind task)
+		WindStreamStats streamStats;
 	private:
-		HardwareSerial * _windSerial;
-		bool getReadingArray();
-		char readingArray[7][10];
+		SerialPort * _windSerial;
+		void publish(const MWVSentence &sentence);
 		bool sendCommand();
+		uint32_t probe(uint32_t now);
 
-		#define bufSize 49 // 6 characters x 6 items
-		char buffer[bufSize]; // Buffer that directly stores characters read from the Calypso ULP Wind Sensor
-		uint8_t bufPos = 0;
-		
+		MWVParser _parser;			// decodes the MWV sentence as bytes arrive (no line buffer needed)
+		uint32_t _pollTime=0;		// millis() when the last poll was sent
+		enum TaskState : uint8_t { TASK_IDLE, TASK_AWAIT, TASK_PROBE };
+		TaskState _taskState=TASK_IDLE;
+		void (*_onReading)()=nullptr;
+		SampleClock *_clock=nullptr;
+		uint32_t _nextSample=0;		// micros() of the next sample instant
+		uint32_t nextSample(uint32_t now) { return _clock ? _clock->next(now, readingInterval) : now + readingInterval; }
+		void updateStats(const windreading &reading, uint32_t timeMs);
+		volatile bool _statsResetPending=false;
+		void adapt(float speed);
+		void retime(uint32_t now);
+		uint8_t _retriesLeft=0;		// retries left for the current sample instant
+		float _speedMean=0;			// running mean and variance of the speed (m/s) for adapt()
+		float _speedVariance=0;
+
+		volatile WindMode _requestedMode=WIND_POLLED;
+		volatile uint8_t _requestedRate=WIND_STREAM_RATE;
+		volatile bool _modePending=false;
+		void (*_onSample)(const WindSample &sample)=nullptr;
+		void applyMode(uint32_t now);
+		void sendMode(uint8_t hz);
+		uint32_t runStreaming(uint32_t now);
+		void consume(const WindSample &sample);
+		uint32_t streamPeriod() const { return 1000000 / streamRate; }	// uS
+		// streaming: samples decoded by the receive interrupt and consumed by the wind task
+		WindSample _ring[WIND_SAMPLE_RING];
+		volatile uint8_t _ringHead=0;	// written by the interrupt handler
+		volatile uint8_t _ringTail=0;	// written by the wind task
+		uint32_t _lastSampleTime=0;		// micros() of the previous streamed sample
+		bool _streamSynced=false;		// _lastSampleTime is valid (cleared when the stream starts over)
+		uint32_t _lastStreamCheck=0;	// micros() when the wind task last found a sample
+		uint64_t _streamElapsed=0;		// uS covered by the periods counted below
+		uint32_t _streamPeriods=0;		// periods between streamed samples, including the missing ones
 };
 
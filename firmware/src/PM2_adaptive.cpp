@@ -0,0 +1,39 @@
+#include "PM2_adaptive.h"
+
+AdaptiveRate::AdaptiveRate(uint32_t minInterval, uint32_t maxInterval, uint8_t hysteresis) {
+	SamplingLimits initial = { minInterval, maxInterval, hysteresis };
+	limits.publish(initial);
+	_interval=minInterval;
+}
+
+bool AdaptiveRate::valid(const SamplingLimits &limits) {
+	return limits.minInterval >= SAMPLING_MIN_INTERVAL && limits.maxInterval <= SAMPLING_MAX_INTERVAL
+		&& limits.minInterval <= limits.maxInterval && limits.hysteresis > 0;
+}
+
+bool AdaptiveRate::request(const SamplingLimits &requested) {
+	if (!valid(requested)) {
+		return false;
+	}
+	limits.publish(requested);
+	return true;
+}
+
+/*
+	Runs in the sensor task (main context). New limits restart the sensor at their minimum.
+*/
+uint32_t AdaptiveRate::update(bool active) {
+	SamplingLimits current;
+	uint32_t number = limits.read(current);
+	uint32_t next=_interval;
+	if (active || number != _limitsNumber) {
+		_limitsNumber=number;
+		next=current.minInterval;
+		_quiet=0;
+	} else if (++_quiet >= current.hysteresis) {
+		next = (next < current.maxInterval / 2) ? next * 2 : current.maxInterval;
+		_quiet=0;
+	}
+	_interval=next;
+	return next;
+}
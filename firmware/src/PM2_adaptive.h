@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include "PM2_snapshot.h"
+
+/*
+	Adaptive sampling interval of one sensor.
+	After each reading the driver reports whether the weather is active (wind: fast or gusty; rain: falling).
+	An active reading drops the interval straight to the minimum, so a gust front or the onset of rain is
+	sampled at once. Every run of `hysteresis` quiet readings in a row doubles it, up to the maximum, so calm
+	dry spells cost few UART transactions. The interval is always the minimum times a power of two (or the
+	maximum), so the polls still fall on the sample instants shared with the other sensor (PM2_sampleclock.h).
+
+	The limits are configuration registers (SET_SAMPLING or SET_CONFIG, PM2_config.h): the I2C handler checks
+	the block, the config task publishes the limits (their only writer), and the sensor task picks them up
+	with its next reading.
+*/
+
+#define SAMPLING_UNIT 100000				// uS: unit of the SET_SAMPLING intervals (100 mS)
+#define SAMPLING_MIN_INTERVAL 500000		// uS: fastest interval accepted (a poll is never sent before the last reply)
+#define SAMPLING_MAX_INTERVAL 600000000		// uS: slowest (scheduler deadlines must stay well inside 2^31 uS)
+
+struct SamplingLimits {
+	uint32_t minInterval;		// uS
+	uint32_t maxInterval;		// uS
+	uint8_t hysteresis;			// quiet readings in a row before each back off
+};
+
+class AdaptiveRate {
+	public:
+		AdaptiveRate(uint32_t minInterval, uint32_t maxInterval, uint8_t hysteresis);
+		static bool valid(const SamplingLimits &limits);
+		bool request(const SamplingLimits &limits);	// config task: false (and nothing changed) if not valid
+		uint32_t update(bool active);		// after each reading: returns the interval to the next one
+		uint32_t interval() const { return _interval; }
+		bool changed() const { return limits.published != _limitsNumber; }	// new limits not yet taken up by update()
+		Snapshot<SamplingLimits> limits;	// as set by the master
+	private:
+		volatile uint32_t _interval;		// uS, read by GET_SAMPLING
+		uint8_t _quiet=0;					// quiet readings since the last change
+		uint32_t _limitsNumber=1;			// limits in use (publish count)
+};
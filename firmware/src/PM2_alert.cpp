@@ -0,0 +1,57 @@
+#include "PM2_alert.h"
+#include "PM2_frame.h"
+
+bool Alert::configure(uint8_t newMode, uint16_t newGustLimit) {
+	if (newMode & ~ALERT_MODES) {
+		return false;
+	}
+	gustLimit=newGustLimit;
+	mode=newMode;
+	if (mode == 0) {
+		acknowledge();		// off: nothing left asserted
+	}
+	return true;
+}
+
+/*
+	Runs in frameTask (main context). The line is set with interrupts off so the I2C handler cannot release it
+	between the causes being recorded and the line being driven.
+*/
+void Alert::update(uint8_t status, const windreading &wind, const RainReading &rain) {
+	uint8_t causes=0;
+	bool raining = rain.intervalacc > 0;
+	bool gusting = wind.windspeed >= (int32_t)gustLimit;
+	if (status & (FRAME_STATUS_WIND_NEW | FRAME_STATUS_RAIN_NEW)) causes |= ALERT_NEW_SET;
+	if (raining && !_raining) causes |= ALERT_RAIN_ONSET;
+	if (gusting && !_gusting) causes |= ALERT_GUST;
+	_raining=raining;
+	_gusting=gusting;
+	causes &= mode;
+	if (causes) {
+		raise(causes);
+	}
+}
+
+void Alert::raise(uint8_t causes) {
+	halInterruptsOff();
+	if (_pending == 0) {
+		_raisedTime=halMicros();
+		raised++;
+	}
+	_pending |= causes;
+	halAlert(true);
+	halInterruptsOn();
+}
+
+uint8_t Alert::acknowledge() {
+	uint8_t causes=_pending;
+	if (causes) {
+		halAlert(false);
+		_pending=0;
+		uint32_t latency = halMicros() - _raisedTime;
+		if (latency > latencyMax) {
+			latencyMax=latency;
+		}
+	}
+	return causes;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "PM2_hal.h"
+#include "PM2_Winddriver.h"
+#include "PM2_Raindriver.h"
+
+/*
+	Data ready / alert line to the master (pinALERT: Groove ADC 1, open drain, active low; see halAlert).
+	Instead of polling on its own schedule the master can wait for the line: it is asserted by frameTask when
+	the GET_ALL frame is rebuilt with a new reading, or when a threshold fires, and released by the master's next
+	read (GET_ALL, a single reading or GET_ALERT). The master then reads each new sample set once, as soon as
+	it exists. SET_ALERT selects the causes (ALERT_xxx bits, 0 = off: the line stays released) and the gust limit;
+	GET_ALERT returns the causes since the previous read.
+	The thresholds are edge triggered: the line is asserted once as the value crosses, not for every set after.
+*/
+
+#define ALERT_NEW_SET		0x01	// a reading was published (the GET_ALL frame has a *_NEW status bit)
+#define ALERT_RAIN_ONSET	0x02	// the rain intensity rose from zero
+#define ALERT_GUST			0x04	// the wind speed rose to the gust limit
+#define ALERT_MODES			(ALERT_NEW_SET | ALERT_RAIN_ONSET | ALERT_GUST)
+#define ALERT_GUST_DEFAULT	1000	// centi-m/s (10 m/s)
+
+class Alert {
+	public:
+		void begin() { halAlertBegin(); }
+		bool configure(uint8_t mode, uint16_t gustLimit);	// I2C handler (SET_ALERT): false if a mode bit is unknown
+		void update(uint8_t status, const windreading &wind, const RainReading &rain);	// frameTask, after each frame
+		uint8_t acknowledge();			// I2C handler, on a read: the causes since the previous read; releases the line
+
+		volatile uint8_t mode=0;
+		volatile uint16_t gustLimit=ALERT_GUST_DEFAULT;		// centi-m/s
+		uint32_t raised=0;				// times the line was asserted
+		uint32_t latencyMax=0;			// uS from the line asserted to the master's read
+	private:
+		void raise(uint8_t causes);
+		volatile uint8_t _pending=0;	// causes not read yet (the line is asserted while non zero)
+		volatile uint32_t _raisedTime=0;	// micros() when the line was asserted
+		bool _raining=false;
+		bool _gusting=false;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "PM2_hal.h"
+
+/*
+	Background bring-up of a sensor (see CalypsoWind::probe, RadeonRain::probe).
+	setup() only starts the UARTs and the I2C slave; the sensor tasks then look for the sensors, so the master
+	finds the board on the bus within a few mS of reset whether the sensors answer or not.
+	A failed attempt is retried after BRINGUP_FIRST_RETRY, doubling up to BRINGUP_MAX_RETRY: an absent sensor
+	costs little, and one plugged in later is still found. GET_SENSOR_STATUS reports the state.
+*/
+
+#define BRINGUP_FIRST_RETRY 1000000		// uS
+#define BRINGUP_MAX_RETRY 60000000		// uS
+#define BRINGUP_FAILED_AFTER 3			// attempts in a row before the sensor is reported failed
+
+enum SensorState : uint8_t {
+	SENSOR_PROBING=0,		// looking for the sensor
+	SENSOR_READY=1,			// answered and configured
+	SENSOR_FAILED=2			// BRINGUP_FAILED_AFTER attempts went unanswered (still retried, at the backoff interval)
+};
+
+class Bringup {
+	public:
+		volatile SensorState state=SENSOR_PROBING;
+		uint8_t failures=0;			// attempts failed in a row (saturates)
+		uint32_t readyTime=0;		// millis() when the sensor was first ready (0: not yet)
+
+		void ready() {
+			state=SENSOR_READY;
+			if (readyTime == 0) {
+				readyTime = halMillis() | 1;
+			}
+			failures=0;
+			_retry=BRINGUP_FIRST_RETRY;
+		}
+
+		// an attempt went unanswered: returns uS until the next one
+		uint32_t failed() {
+			if (failures < UINT8_MAX) failures++;
+			if (failures >= BRINGUP_FAILED_AFTER) state=SENSOR_FAILED;
+			uint32_t wait=_retry;
+			_retry = (_retry < BRINGUP_MAX_RETRY / 2) ? _retry * 2 : BRINGUP_MAX_RETRY;
+			return wait;
+		}
+
+		// the sensor stopped answering after it was ready: look for it again (the task's next run), with the backoff
+		void lost() {
+			state=SENSOR_PROBING;
+		}
+
+		// look again at once, without the backoff (I2C handler: START_WIND / START_RAIN)
+		void restart() {
+			failures=0;
+			_retry=BRINGUP_FIRST_RETRY;
+			state=SENSOR_PROBING;
+		}
+	private:
+		uint32_t _retry=BRINGUP_FIRST_RETRY;
+};
@@ -0,0 +1,620 @@
+/*
+	I2C command dispatcher.
+	receiveEvent / requestEvent are registered with the I2C slave port in setup(); see PM2_driver.h for the
+	command set and README.md for the replies.
+*/
+#include "PM2_driver.h"
+#include "PM2_metrics.h"
+#include "PM2_log.h"
+
+union ibyte {				// used for I2C commands
+	uint8_t myint;
+	uint8_t b;
+};
+
+ibyte wichCommand;
+ibyte command;
+uint8_t commandArgs[I2C_MAX_ARGS];		// bytes sent after the command byte
+uint8_t commandArgCount=0;
+bool commandAccepted=false;			// result of the last SET_ command
+uint32_t i2cOnlineTime=0;
+volatile uint32_t firstRequestTime=0;	// time to first ACK (0 until then)
+
+static void replyByte(uint8_t value);
+static void replyLong(uint32_t value);
+static void replyAck(bool ack);
+static void replySlice(uint8_t offset, uint8_t size);
+static void replyMetrics(uint8_t block);
+static uint32_t argLong(uint8_t first);
+static uint16_t argShort(uint8_t first);
+
+const char * const CommandLiterals[] {		// used for debug only (kept in flash)
+	"none",
+	"START_WIND",
+	"STOP_WIND",
+	"GET_WIND_DIR",
+	"GET_WIND_SPEED",
+	"START_RAIN",
+	"STOP_RAIN",
+	"GET_RAIN_ACC",
+	"GET_RAIN_EVENTACC",
+	"GET_RAIN_TOTALACC",
+	"GET_RAIN_INTVACC",
+	"RAIN_RESETACCUM",
+	"RAIN_CHECK",
+	"GET_SNAPSHOT_STATUS",
+	"GET_ALL",
+	"GET_WIND_STATS",
+	"SET_RAIN_MODE",
+	"GET_RAIN_MODE",
+	"GET_RAIN_LINK",
+	"SET_TIME",
+	"HISTORY_STATUS",
+	"HISTORY_SEEK",
+	"HISTORY_READ",
+	"GET_POWER_STATS",
+	"GET_UART_STATS",
+	"GET_METRICS",
+	"SET_SAMPLING",
+	"GET_SAMPLING",
+	"GET_SENSOR_STATUS",
+	"SET_ALERT",
+	"GET_ALERT",
+	"GET_RAIN_1MIN",
+	"GET_RAIN_10MIN",
+	"GET_RAIN_60MIN",
+	"SET_WIND_MODE",
+	"GET_WIND_MODE",
+	"SET_CONFIG",
+	"GET_CONFIG",
+	"SAVE_CONFIG"
+};
+
+/*
+	Replies are prepared by receiveEvent, which runs after the master's STOP while the bus is free; requestEvent
+	runs while the master's clock is stretched and only streams the prepared bytes, with one bounded write.
+	The single reading replies are slices of the GET_ALL frame, which frameTask serialises whenever a sensor
+	publishes (offsets in PM2_frame.h), so selecting one is a copy of the frame and a pointer; every other reply
+	is serialised into replyBuffer. A read that does not follow a command repeats the previous reply.
+*/
+static PM2Frame replyFrame;					// the GET_ALL frame when the command arrived
+static uint8_t replyBuffer[I2C_REPLY_MAX];
+static const uint8_t *replyData=replyBuffer;
+static uint8_t replyLength=0;
+
+// receiveEvent INTERRUPT FROM I2C PORT (Master sends data to the slave)
+void receiveEvent(int howMany)
+{
+	METRIC_START(start);
+	command.myint = 99;
+	uint32_t timer=halMicros();
+	uint32_t timeout=100;
+	LOG_DEBUG(LOG_I2C_RECEIVE, howMany);		// printed later by the main loop (PM2_log.h)
+	if (howMany > 0) {
+		if (firstRequestTime == 0) {
+			firstRequestTime = halMicros() | 1;		// the master's first transaction was Acked
+		}
+		while (!i2cSlave.available()) {
+			halDelayMicroseconds(1);
+			if (halMicros()-timer > timeout) {
+				METRIC_COUNT(METRIC_I2C_RX_TIMEOUT);
+				break;
+			}
+		}
+		// the first byte is the command; any bytes after it are the command's arguments
+		commandArgCount=0;
+		if (i2cSlave.available()) {
+			command.b = i2cSlave.read();
+		}
+		while (i2cSlave.available()) {
+			uint8_t arg = i2cSlave.read();
+			if (commandArgCount < I2C_MAX_ARGS) {
+				commandArgs[commandArgCount++]=arg;
+			}
+		}
+	}
+	if (command.myint !=99) {
+		LOG_DEBUG(LOG_I2C_COMMAND, command.myint);
+		halLed(LED_RED);
+	}
+	replyData=replyBuffer;
+	replyLength=0;
+	
+	switch(command.myint) {
+		case START_WIND: {
+			// a sensor that has not answered yet is looked for again at once (see PM2_bringup.h)
+			windRunning=true;
+			bool ready = wind.start();
+			if (!ready) {
+				scheduler.wake(windTaskId);
+			}
+			LOG_INFO(ready ? LOG_WIND_ACK : LOG_WIND_NACK, 0);
+			replyAck(ready);
+			wichCommand=command;
+			break;
+		}case START_RAIN: {
+			rainRunning=true;
+			bool ready = rain.start();
+			if (!ready) {
+				scheduler.wake(rainTaskId);
+			}
+			LOG_INFO(ready ? LOG_RAIN_ACK : LOG_RAIN_NACK, 0);
+			replyAck(ready);
+			wichCommand=command;
+			break;
+		}
+		case STOP_WIND:	{
+			if (wind.stop()) {
+				windRunning=false;
+			}
+			replyAck(!wind.started);
+			wichCommand=command;
+			break;
+		}
+		case STOP_RAIN: {
+			if (rain.stop()) {
+				rainRunning=false;
+			}
+			replyAck(!rain.started);
+			wichCommand=command;
+			break;
+		}
+		
+		case RAIN_RESETACCUM: {
+			rain.resetAccum();
+			scheduler.wake(rainTaskId);		// the rain task sends 'O' to the gauge
+			replyAck(true);
+			wichCommand=command;
+			break;
+		}
+		case RAIN_CHECK: {
+			replyAck(rain.checkStarted());
+			wichCommand=command;
+			break;
+		}
+		case SET_RAIN_MODE: {
+			// argument: 0 = polled ('R' every reading interval), 1 = continuous (the gauge reports changes)
+			commandAccepted = (commandArgCount == 1) && rain.setMode(commandArgs[0]);
+			if (commandAccepted) {
+				scheduler.wake(rainTaskId);		// the rain task sends the mode command to the gauge
+			}
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case SET_SAMPLING: {
+			// arguments: sensor (0 wind, 1 rain), minimum and maximum interval (uint16, units of SAMPLING_UNIT),
+			// hysteresis (quiet readings before each back off); see PM2_adaptive.h. A write of that sensor's
+			// first 3 configuration registers, so it is checked, applied and reported (GET_CONFIG) as SET_CONFIG is.
+			commandAccepted = (commandArgCount == 6) && commandArgs[0] <= 1;
+			if (commandAccepted) {
+				uint8_t values[6] = { commandArgs[1], commandArgs[2], commandArgs[3], commandArgs[4], commandArgs[5], 0 };
+				commandAccepted = config.write((commandArgs[0] == 0) ? CONFIG_WIND_MIN : CONFIG_RAIN_MIN, values, 3);
+			}
+			if (commandAccepted) {
+				scheduler.wake(configTaskId);
+			}
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case SET_TIME: {
+			// argument: Unix time (uint32)
+			commandAccepted = (commandArgCount == 4);
+			if (commandAccepted) {
+				history.setTime(argLong(0));
+			}
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case HISTORY_SEEK: {
+			// argument: sequence number of the next record to send (uint32)
+			commandAccepted = (commandArgCount == 4);
+			if (commandAccepted) {
+				history.seek(argLong(0));
+			}
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case SET_ALERT: {
+			// arguments: causes (ALERT_xxx bits, 0 = off), optionally the gust limit (uint16 centi-m/s); PM2_alert.h
+			commandAccepted = (commandArgCount == 1 || commandArgCount == 3)
+				&& alert.configure(commandArgs[0], (commandArgCount == 3) ? argShort(1) : alert.gustLimit);
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case GET_ALERT: {
+			// causes since the previous read (releases the line), causes enabled, gust limit (uint16 centi-m/s),
+			// times asserted, worst assert to read latency (uS)
+			replyByte(alert.acknowledge());
+			replyByte(alert.mode);
+			replyByte((uint8_t)alert.gustLimit);
+			replyByte((uint8_t)(alert.gustLimit >> 8));
+			replyLong(alert.raised);
+			replyLong(alert.latencyMax);
+			wichCommand=command;
+			break;
+		}
+
+		// readings: the last complete values, from the frame (never a nack during a sample); a read releases
+		// the data ready line
+		case GET_WIND_DIR: {
+			replySlice(FRAME_WIND_DIR, WIND_VALUE_SIZE);
+			wichCommand=command;
+			break;
+		}
+		case GET_WIND_SPEED: {
+			replySlice(FRAME_WIND_SPEED, WIND_VALUE_SIZE);
+			wichCommand=command;
+			break;
+		}
+		case GET_RAIN_ACC: {
+			replySlice(FRAME_RAIN_ACC, RAIN_VALUE_SIZE);
+			wichCommand=command;
+			break;
+		}
+		case GET_RAIN_EVENTACC: {
+			replySlice(FRAME_RAIN_EVENTACC, RAIN_VALUE_SIZE);
+			wichCommand=command;
+			break;
+		}
+		case GET_RAIN_TOTALACC: {
+			replySlice(FRAME_RAIN_TOTALACC, RAIN_VALUE_SIZE);
+			wichCommand=command;
+			break;
+		}
+		case GET_RAIN_INTVACC: {
+			replySlice(FRAME_RAIN_INTVACC, RAIN_VALUE_SIZE);
+			wichCommand=command;
+			break;
+		}
+		case GET_ALL: {
+			replySlice(0, FRAME_SIZE);
+			wichCommand=command;
+			break;
+		}
+
+		case GET_RAIN_1MIN:
+		case GET_RAIN_10MIN:
+		case GET_RAIN_60MIN: {
+			// rolling window (see PM2_rainwindows.h): rain total, then the peak intensity
+			RainWindowResult windows;
+			rain.windows.results.read(windows);
+			uint8_t w = command.myint - GET_RAIN_1MIN;
+			replyLength += ReadingEncoding::fixed32(windows.total[w], RAIN_SCALE, replyBuffer + replyLength);
+			replyLength += ReadingEncoding::fixed32(windows.peak[w], RAIN_SCALE, replyBuffer + replyLength);
+			wichCommand=command;
+			break;
+		}
+		case GET_WIND_STATS: {
+			// statistics of the wind readings since the previous GET_WIND_STATS (see PM2_windstats.h)
+			WindStatistics st;
+			wind.statsSnapshot.read(st);
+			replyByte((uint8_t)st.count);
+			replyByte((uint8_t)(st.count >> 8));
+			replyLength += ReadingEncoding::real16(st.meanDir, WIND_DIR_SCALE, replyBuffer + replyLength);
+			replyLength += ReadingEncoding::real16(st.dirStdDev, WIND_DIR_SCALE, replyBuffer + replyLength);
+			replyLength += ReadingEncoding::real16(st.meanSpeed, WIND_SPEED_SCALE, replyBuffer + replyLength);
+			replyLength += ReadingEncoding::real16(st.vectorSpeed, WIND_SPEED_SCALE, replyBuffer + replyLength);
+			replyLength += ReadingEncoding::real32(st.speedVariance, WIND_SPEED_SCALE*WIND_SPEED_SCALE,
+				replyBuffer + replyLength);
+			replyLength += ReadingEncoding::real16(st.gust, WIND_SPEED_SCALE, replyBuffer + replyLength);
+			replyLength += ReadingEncoding::real16(st.lull, WIND_SPEED_SCALE, replyBuffer + replyLength);
+			wind.requestStatsReset();		// the next reading starts a new window
+			wichCommand=command;
+			break;
+		}
+		case HISTORY_STATUS: {
+			// board time (s), oldest and next record sequence numbers, 1 if the time was set by SET_TIME
+			replyLong(history.nowISR());
+			replyLong(history.oldest());
+			replyLong(history.next());
+			replyByte(history.timeSet() ? 1 : 0);
+			wichCommand=command;
+			break;
+		}
+		case HISTORY_READ: {
+			// one chunk of records from the cursor (layout in PM2_history.h)
+			history.readChunk(replyBuffer);
+			replyLength=HISTORY_CHUNK_SIZE;
+			wichCommand=command;
+			break;
+		}
+		case GET_POWER_STATS: {
+			// uptime and time in standby (mS), wakes by source (see HalWakeSource), worst RTC wake latency (uS),
+			// UART bytes lost to receive overruns
+			replyLong(halMillis());
+			replyLong(halPower.standbyMillis);
+			for (uint8_t i=0; i<WAKE_SOURCES; i++) {
+				replyLong(halPower.wakes[i]);
+			}
+			replyLong(halPower.wakeLatencyMax);
+			replyLong(halPower.rxLost);
+			wichCommand=command;
+			break;
+		}
+		case GET_UART_STATS: {
+			// receive counters of the wind then the rain UART (see UartRxStats): bytes, receive interrupts,
+			// UART overruns, framing errors, ring overruns
+			const UartRxStats *ports[2] = { &wind.rxStats(), &rain.rxStats() };
+			for (uint8_t i=0; i<2; i++) {
+				replyLong(ports[i]->bytes);
+				replyLong(ports[i]->interrupts);
+				replyLong(ports[i]->overruns);
+				replyLong(ports[i]->framingErrors);
+				replyLong(ports[i]->ringOverruns);
+			}
+			wichCommand=command;
+			break;
+		}
+		case GET_METRICS: {
+			replyMetrics(commandArgCount ? commandArgs[0] : 0);
+			wichCommand=command;
+			break;
+		}
+		case GET_SAMPLING: {
+			// wind then rain: interval in use, minimum and maximum interval (mS), hysteresis (uint8)
+			AdaptiveRate *rates[2] = { &wind.rate, &rain.rate };
+			for (uint8_t i=0; i<2; i++) {
+				SamplingLimits limits;
+				rates[i]->limits.read(limits);
+				replyLong(rates[i]->interval() / 1000);
+				replyLong(limits.minInterval / 1000);
+				replyLong(limits.maxInterval / 1000);
+				replyByte(limits.hysteresis);
+			}
+			wichCommand=command;
+			break;
+		}
+		case GET_SENSOR_STATUS: {
+			// wind then rain: state (SensorState), failed attempts in a row (uint8), millis() when first ready
+			// (uint32, 0 if not yet); then micros() when the I2C slave came up and when it first answered
+			const Bringup *sensors[2] = { &wind.bringup, &rain.bringup };
+			for (uint8_t i=0; i<2; i++) {
+				replyByte((uint8_t)sensors[i]->state);
+				replyByte(sensors[i]->failures);
+				replyLong(sensors[i]->readyTime);
+			}
+			replyLong(i2cOnlineTime);
+			replyLong(firstRequestTime);
+			wichCommand=command;
+			break;
+		}
+		case GET_RAIN_MODE: {
+			replyByte((uint8_t)rain.requestedMode());
+			wichCommand=command;
+			break;
+		}
+		case SET_WIND_MODE: {
+			// arguments: 0 = polled, 1 = streaming; optionally the streaming rate (1 - 4 Hz, default 4)
+			commandAccepted = (commandArgCount == 1 || commandArgCount == 2)
+				&& wind.setMode(commandArgs[0], (commandArgCount == 2) ? commandArgs[1] : WIND_STREAM_RATE);
+			if (commandAccepted) {
+				scheduler.wake(windTaskId);		// the wind task sends the mode sentence to the anemometer
+			}
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case SET_CONFIG: {
+			// arguments: first register, then its value and those of the registers after it (uint16 each);
+			// the block must stay valid as a whole (PM2_config.h). Applied by the config task.
+			commandAccepted = (commandArgCount >= 3) && (commandArgCount % 2 == 1)
+				&& config.write(commandArgs[0], commandArgs + 1, (commandArgCount - 1) / 2);
+			if (commandAccepted) {
+				scheduler.wake(configTaskId);
+			}
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case GET_CONFIG: {
+			// the registers (uint16 each), then 1 if they are the ones saved in flash
+			ConfigBlock block;
+			uint32_t number = config.block.read(block);
+			for (uint8_t i=0; i<CONFIG_REGISTERS; i++) {
+				replyByte((uint8_t)block.reg[i]);
+				replyByte((uint8_t)(block.reg[i] >> 8));
+			}
+			replyByte(number == config.savedNumber ? 1 : 0);
+			wichCommand=command;
+			break;
+		}
+		case SAVE_CONFIG: {
+			// no argument: the config task writes the registers to flash (GET_CONFIG shows when it is done)
+			commandAccepted = (commandArgCount == 0);
+			if (commandAccepted) {
+				config.savePending=true;
+				scheduler.wake(configTaskId);
+			}
+			replyAck(commandAccepted);
+			wichCommand=command;
+			break;
+		}
+		case GET_WIND_MODE: {
+			// selected mode and rate, then the streaming counters (PM2_Winddriver.h): samples, gaps,
+			// ring overruns, restarts, drift (int32 ppm)
+			replyByte((uint8_t)wind.requestedMode());
+			replyByte(wind.streamRate);
+			replyLong(wind.streamStats.samples);
+			replyLong(wind.streamStats.gaps);
+			replyLong(wind.streamStats.ringOverruns);
+			replyLong(wind.streamStats.restarts);
+			replyLong((uint32_t)wind.streamStats.driftPpm);
+			wichCommand=command;
+			break;
+		}
+		case GET_RAIN_LINK: {
+			// rain gauge serial link: baud rate, time the last negotiation took (uS), fallbacks since power up
+			replyLong(rain.baudRate());
+			replyLong(rain.probeTime);
+			replyLong(rain.linkFallbacks);
+			wichCommand=command;
+			break;
+		}
+		case GET_SNAPSHOT_STATUS: {
+			// consistency counters: readings published by each sensor and reads that had to be repeated
+			replyLong(wind.snapshot.published);
+			replyLong(rain.snapshot.published);
+			replyLong(wind.snapshot.retries + rain.snapshot.retries);
+			wichCommand=command;
+			break;
+		}
+		default: {
+			if (howMany > 0) {
+				METRIC_COUNT(METRIC_I2C_UNKNOWN);
+			}
+			wichCommand.myint=99;
+			break;
+		}
+	}
+	METRIC_STOP_COMMAND(METRIC_I2C_RECEIVE, command.myint, start);
+}
+
+// requestEvent INTERRUPT FROM i2c PORT (Master asks slave to send data)
+void requestEvent()
+{
+	/*
+		Respond to a request from the Master with the reply receiveEvent prepared; typically: Ack (1); Nack (0)
+		(1 byte) or a Reading value (4 byte float; or int16 / int32 with the fixed point encoding: see
+		PM2_encoding.h). Nothing is decoded, encoded or logged here: the master's clock is held until this returns.
+	*/
+	METRIC_START(start);
+	i2cSlave.write(replyData, replyLength);
+	METRIC_STOP_COMMAND(METRIC_I2C_REQUEST, wichCommand.myint, start);
+}
+
+/*
+	GET_METRICS argument (block). 0: timers, buckets, counters, cycles per uS (4 x uint8) then the counters (see
+	metricCounters); 1..timers: histogram of timer block-1; METRIC_COMMAND_BLOCK + command: the worst receiveEvent
+	and requestEvent times of that command (see PM2_metrics.h)
+*/
+static void replyMetrics(uint8_t block)
+{
+	if (block == 0) {
+		uint32_t counters[METRIC_REPORT_COUNTERS];
+		uint8_t n = metricCounters(counters);
+#ifdef PM2_METRICS
+		replyByte((uint8_t)METRIC_TIMERS);
+#else
+		replyByte((uint8_t)0);		// compiled out: counters only
+#endif
+		replyByte((uint8_t)METRIC_BUCKETS);
+		replyByte(n);
+		replyByte((uint8_t)HAL_CYCLES_PER_US);
+		for (uint8_t i=0; i<n; i++) {
+			replyLong(counters[i]);
+		}
+	}
+#ifdef PM2_METRICS
+	else if (block <= METRIC_TIMERS) {
+		// count, max (cycles), sum (cycles, 64 bit), then METRIC_BUCKETS bucket counts
+		const MetricHistogram &h = metrics.timers[block - 1];
+		replyLong(h.count);
+		replyLong(h.max);
+		replyLong((uint32_t)h.sum);
+		replyLong((uint32_t)(h.sum >> 32));
+		for (uint8_t i=0; i<METRIC_BUCKETS; i++) {
+			replyLong(h.buckets[i]);
+		}
+	}
+	else if (block >= METRIC_COMMAND_BLOCK && block < METRIC_COMMAND_BLOCK + METRIC_COMMANDS) {
+		// worst receiveEvent and requestEvent (cycles)
+		const MetricCommand &c = metrics.commands[block - METRIC_COMMAND_BLOCK];
+		replyLong(c.receiveMax);
+		replyLong(c.requestMax);
+	}
+#endif
+}
+
+// name of a command for the log (kept in flash with the rest of CommandLiterals)
+const char *commandName(uint8_t command)
+{
+	if (command >= sizeof(CommandLiterals) / sizeof(CommandLiterals[0])) {
+		return "unknown";
+	}
+	return CommandLiterals[command];
+}
+
+static void replyByte(uint8_t value)
+{
+	if (replyLength < I2C_REPLY_MAX) {
+		replyBuffer[replyLength++] = value;
+	}
+}
+
+// a 32 bit value in the same (little endian) byte order as the floatbyte readings
+static void replyLong(uint32_t value)
+{
+	for (uint8_t i=0; i<4; i++) {
+		replyByte((uint8_t)(value >> (8*i)));
+	}
+}
+
+// Ack (1) or Nack (0)
+static void replyAck(bool ack)
+{
+	replyByte(ack ? 1 : 0);
+	if (!ack) {
+		METRIC_COUNT(METRIC_I2C_NACK);
+	}
+}
+
+// size bytes of the GET_ALL frame from offset: the frame is copied as it is now, so the reply stays whole
+// even if frameTask publishes a new one before the master reads it
+static void replySlice(uint8_t offset, uint8_t size)
+{
+	alert.acknowledge();
+	frame.read(replyFrame);
+	replyData = replyFrame.b + offset;
+	replyLength = size;
+}
+
+// 32 bit (little endian) command argument starting at commandArgs[first]
+static uint32_t argLong(uint8_t first)
+{
+	uint32_t value=0;
+	for (uint8_t i=0; i<4; i++) {
+		value |= (uint32_t)commandArgs[first + i] << (8*i);
+	}
+	return value;
+}
+
+// 16 bit (little endian) command argument starting at commandArgs[first]
+static uint16_t argShort(uint8_t first)
+{
+	return commandArgs[first] | (commandArgs[first + 1] << 8);
+}
+/*
+	The Rain Gauge runs at 9600 bps :  (1041 uS per bit: 937.5 uS per byte (8 bits + stop))
+	Assuming immediate response to a Poll:
+	characters:  Poll = R+ CR LF + Response: |Acc 0.000 in, EventAcc 0.000 in, TotalAcc 0.000 in, RInt 0.000 iph| + CR LF
+	== 71 characters =~ (iro) 66562.5 uS for a complete Poll
+
+	The Wind Anemometer runs at 38400 bps: 2,042 uS per bit; 234.3 uS per Byte
+	Assuming immediate response: Poll command: $ULPI*00\r\n  (10 CHAR)
+	Poll Response: $--MWV,360,R,9.999,M*hh\r\n (25 CHAR)
+	== 35 CHARACTERS =~ (iro) 8203.1 uS
+
+	I2C commands will interrupt the reading process as frequently as 5 seconds; but likely every 60 sec
+
+	The Reading process and the I2C process are not synchronous. The latter can interrupt a reading.
+
+	I2C Poll (for EACH sensor value (of 6)) consists of address (1 byte) + 1 char (command) followed by Request (=address + No of Bytes)
+	I2C bus can operate at either 100 KBps or 400 kbps
+	Therefore each I2C Poll + request can take iro 360 uS @ 100 kbps or 90 uS @ 400 kbps
+	GET_ALL replaces the 6 polls (12 transactions and 12 interrupts; 42 bytes on the wire iro 3.9 mS @ 100 kbps)
+	with 1 poll (2 transactions and 2 interrupts; 33 bytes on the wire iro 3.0 mS @ 100 kbps).
+
+	There is a small chance the Reading operation and the I2C poll operation might overlap
+
+	Each driver therefore publishes its readings through a Snapshot (PM2_snapshot.h): the new values are written
+	into a second copy which is then switched in, so requestEvent always sends the last complete set of values
+	and never has to nack a reading request while a sample is being taken.
+	GET_SNAPSHOT_STATUS returns the number of readings published by each sensor and the number of reads that had
+	to be repeated because a publish overlapped them (3 x uint32).
+
+*/
@@ -0,0 +1,124 @@
+#include <string.h>
+#include "PM2_config.h"
+#include "PM2_adaptive.h"
+#include "PM2_frame.h"
+
+#ifdef ARDUINO
+// row aligned area in the program flash; it is cleared (not blank) whenever new firmware is uploaded
+__attribute__((aligned(HAL_FLASH_ROW))) static const uint8_t configArea[CONFIG_SIZE] = { };
+#else
+alignas(HAL_FLASH_ROW) uint8_t configArea[CONFIG_SIZE];
+#endif
+
+// read through a volatile pointer: the compiler must not assume the contents are the initial zeroes
+static const volatile uint8_t *const configFlash = configArea;
+
+static uint16_t getShort(const uint8_t *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// the sampling limits of one sensor, from its first register (CONFIG_WIND_MIN or CONFIG_RAIN_MIN)
+static bool validSensor(const ConfigBlock &block, uint8_t first) {
+	const uint16_t *r = block.reg + first;
+	SamplingLimits limits = { r[0] * (uint32_t)SAMPLING_UNIT, r[1] * (uint32_t)SAMPLING_UNIT, (uint8_t)r[2] };
+	return r[2] <= UINT8_MAX && AdaptiveRate::valid(limits)
+		&& r[3] >= CONFIG_TIMEOUT_MIN && r[3] <= CONFIG_TIMEOUT_MAX && r[4] <= CONFIG_RETRIES_MAX
+		&& (uint32_t)r[3] * 1000 * (r[4] + 1) < limits.minInterval;
+}
+
+bool Config::valid(const ConfigBlock &block) {
+	const uint16_t *r = block.reg;
+	return r[CONFIG_REFRESH] >= CONFIG_REFRESH_MIN && r[CONFIG_REFRESH] <= CONFIG_REFRESH_MAX
+		&& validSensor(block, CONFIG_WIND_MIN) && validSensor(block, CONFIG_RAIN_MIN)
+		&& r[CONFIG_WIND_GUST] >= CONFIG_GUST_MIN && r[CONFIG_WIND_GUST] <= CONFIG_GUST_MAX;
+}
+
+/*
+	Called from the I2C handler: the registers written are merged into the current block, which is only
+	replaced if the result is valid as a whole (so a write is accepted or rejected entirely).
+*/
+bool Config::write(uint8_t first, const uint8_t *values, uint8_t count) {
+	if (count == 0 || first >= CONFIG_REGISTERS || count > CONFIG_REGISTERS - first) {
+		return false;
+	}
+	ConfigBlock next;
+	block.read(next);
+	for (uint8_t i=0; i<count; i++) {
+		next.reg[first + i] = getShort(values + 2 * i);
+	}
+	if (!valid(next)) {
+		return false;
+	}
+	block.publish(next);
+	return true;
+}
+
+bool Config::readRecord(uint8_t row, uint32_t &seq, ConfigBlock &out) {
+	uint8_t b[CONFIG_RECORD_SIZE];
+	const volatile uint8_t *p = configFlash + row * HAL_FLASH_ROW;
+	for (uint8_t i=0; i<CONFIG_RECORD_SIZE; i++) {
+		b[i] = p[i];
+	}
+	if (b[31] != CONFIG_MAGIC || crc8(b, 30) != b[30]) {
+		return false;
+	}
+	seq = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+	for (uint8_t i=0; i<CONFIG_REGISTERS; i++) {
+		out.reg[i] = getShort(b + 4 + 2 * i);
+	}
+	return seq != 0 && seq != 0xFFFFFFFF && valid(out);
+}
+
+/*
+	Find the newest valid record of the two rows. A block that is no longer valid (limits changed by newer
+	firmware) is ignored, so the defaults are used rather than values the drivers would reject.
+*/
+bool Config::begin(ConfigBlock &saved) {
+	ConfigBlock candidate;
+	uint32_t seq;
+	_seq=0;
+	saves=0;
+	for (uint8_t row=0; row<CONFIG_ROWS; row++) {
+		if (readRecord(row, seq, candidate) && seq > _seq) {
+			_seq=seq;
+			_row=row;
+			saved=candidate;
+		}
+	}
+	return _seq != 0;
+}
+
+/*
+	Write the block to the row that does not hold the newest record, then check it.
+	A page write is committed as a whole, in no defined byte order, so the record goes in with the magic byte
+	blank and the magic byte follows in a second write: a save cut short in either leaves no magic byte.
+*/
+bool Config::save(const ConfigBlock &saving) {
+	uint8_t row = (_seq == 0) ? 0 : (uint8_t)((_row + 1) % CONFIG_ROWS);
+	uint32_t seq = _seq + 1;
+	uint8_t b[CONFIG_RECORD_SIZE];
+	memset(b, 0xFF, sizeof(b));
+	for (uint8_t i=0; i<4; i++) {
+		b[i] = (uint8_t)(seq >> (8*i));
+	}
+	for (uint8_t i=0; i<CONFIG_REGISTERS; i++) {
+		b[4 + 2*i] = (uint8_t)saving.reg[i];
+		b[5 + 2*i] = (uint8_t)(saving.reg[i] >> 8);
+	}
+	b[30] = crc8(b, 30);
+	halFlashErase(configArea + row * HAL_FLASH_ROW);
+	halFlashWrite(configArea + row * HAL_FLASH_ROW, b, CONFIG_RECORD_SIZE);
+	// the magic byte in a page write of its own, once the rest is in: its last word again, the other bytes unchanged
+	b[31] = CONFIG_MAGIC;
+	halFlashWrite(configArea + row * HAL_FLASH_ROW + CONFIG_RECORD_SIZE - 4, b + CONFIG_RECORD_SIZE - 4, 4);
+
+	ConfigBlock check;
+	uint32_t checkSeq;
+	if (!readRecord(row, checkSeq, check) || checkSeq != seq || memcmp(&check, &saving, sizeof(check)) != 0) {
+		return false;
+	}
+	_seq=seq;
+	_row=row;
+	saves++;
+	return true;
+}
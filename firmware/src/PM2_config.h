@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include "PM2_hal.h"
+#include "PM2_snapshot.h"
+#include "PM2_windstats.h"
+
+/*
+	Runtime configuration: a block of uint16 registers the master writes with SET_CONFIG and reads with
+	GET_CONFIG, so the sampling of a mast can be tuned without reflashing it.
+
+	A write is checked against the whole block (see valid) before it is accepted, then applied by the config
+	task in the main context (PM2_tasks.cpp): the new values take effect at once, without a reset. SAVE_CONFIG
+	keeps the block in flash; it is loaded at start up, otherwise the compiled in defaults are used.
+
+	Registers (SET_CONFIG writes from a first register on; intervals in units of SAMPLING_UNIT, 100 mS):
+		CONFIG_REFRESH			frame and history refresh interval (readingRefreshInterval)
+		CONFIG_WIND_MIN / MAX	adaptive sampling limits (as SET_SAMPLING, PM2_adaptive.h)
+		CONFIG_WIND_HYSTERESIS	quiet readings before each back off
+		CONFIG_WIND_TIMEOUT		mS allowed for the reply to a poll
+		CONFIG_WIND_RETRIES		polls sent again at once after a timeout, before waiting for the next sample instant
+		CONFIG_WIND_GUST		mS: averaging window of the gust and lull (PM2_windstats.h)
+		CONFIG_RAIN_MIN .. CONFIG_RAIN_RETRIES	the same for the rain gauge
+	A poll and its retries must fit in the minimum interval: timeout * (retries + 1) < minimum.
+
+	Flash: the block is kept in one of two rows, written alternately, so a save cut short by a reset leaves the
+	previous block in the other row. Record layout (little endian):
+		uint32	sequence number (never 0 or 0xFFFFFFFF)
+		uint16	registers x CONFIG_REGISTERS
+		uint8	reserved (0xFF) x2
+		uint8	CRC-8 of the preceding 30 bytes (see PM2_frame.h)
+		uint8	CONFIG_MAGIC
+*/
+
+enum ConfigRegister : uint8_t {
+	CONFIG_REFRESH,
+	CONFIG_WIND_MIN,
+	CONFIG_WIND_MAX,
+	CONFIG_WIND_HYSTERESIS,
+	CONFIG_WIND_TIMEOUT,
+	CONFIG_WIND_RETRIES,
+	CONFIG_WIND_GUST,
+	CONFIG_RAIN_MIN,
+	CONFIG_RAIN_MAX,
+	CONFIG_RAIN_HYSTERESIS,
+	CONFIG_RAIN_TIMEOUT,
+	CONFIG_RAIN_RETRIES,
+	CONFIG_REGISTERS
+};
+
+#define CONFIG_REFRESH_MIN 5			// x SAMPLING_UNIT: 0.5 S
+#define CONFIG_REFRESH_MAX 6000			// x SAMPLING_UNIT: 600 S
+#define CONFIG_TIMEOUT_MIN 10			// mS
+#define CONFIG_TIMEOUT_MAX 5000			// mS
+#define CONFIG_RETRIES_MAX 3
+#define CONFIG_GUST_MIN 1000			// mS
+#define CONFIG_GUST_MAX GUST_WINDOW_MAX_MS	// mS (GUST_SAMPLES is sized for it at the fastest streaming rate)
+
+#define CONFIG_RECORD_SIZE 32
+#define CONFIG_ROWS 2
+#define CONFIG_SIZE (CONFIG_ROWS * HAL_FLASH_ROW)
+#define CONFIG_MAGIC 0x5A
+
+struct ConfigBlock {
+	uint16_t reg[CONFIG_REGISTERS];
+};
+
+class Config {
+	public:
+		bool begin(ConfigBlock &saved);			// the block saved last; false if there is none
+		static bool valid(const ConfigBlock &block);
+		bool write(uint8_t first, const uint8_t *values, uint8_t count);	// I2C handler: count uint16 from first
+		bool save(const ConfigBlock &block);		// main context only: blocks for an erase and two writes (~11 mS)
+		Snapshot<ConfigBlock> block;				// registers as last accepted (GET_CONFIG)
+		volatile bool savePending=false;			// SAVE_CONFIG: written by the config task
+		volatile uint32_t savedNumber=0;			// block.published when it was last saved or loaded
+		uint32_t saves=0;							// blocks written since begin()
+
+	private:
+		bool readRecord(uint8_t row, uint32_t &seq, ConfigBlock &out);
+		uint32_t _seq=0;							// sequence number of the newest record
+		uint8_t _row=0;								// row holding it
+};
+
+#ifndef ARDUINO
+extern uint8_t configArea[CONFIG_SIZE];		// simulated flash
+#endif
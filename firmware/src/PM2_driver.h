@@ -1,15 +1,18 @@
 #pragma once
 
-#include <Arduino.h>
-#include <Wire.h>
-#include <time.h>
-#include "pins.h"
+#include "PM2_hal.h"
 
 
 // define debug_PM2   // set debug mode for this build
 
 #include "PM2_Winddriver.h"
 #include "PM2_Raindriver.h"
+#include "PM2_scheduler.h"
+#include "PM2_frame.h"
+#include "PM2_history.h"
+#include "PM2_flashlog.h"
+#include "PM2_alert.h"
+#include "PM2_config.h"
 
 typedef enum PM2commands {
 	none=0,
@@ -24,7 +27,65 @@ typedef enum PM2commands {
 	GET_RAIN_TOTALACC,
 	GET_RAIN_INTVACC,
 	RAIN_RESETACCUM,
-	RAIN_CHECK
+	RAIN_CHECK,
+	GET_SNAPSHOT_STATUS,
+	GET_ALL,
+	GET_WIND_STATS,
+	SET_RAIN_MODE,
+	GET_RAIN_MODE,
+	GET_RAIN_LINK,
+	SET_TIME,
+	HISTORY_STATUS,
+	HISTORY_SEEK,
+	HISTORY_READ,
+	GET_POWER_STATS,
+	GET_UART_STATS,
+	GET_METRICS,
+	SET_SAMPLING,
+	GET_SAMPLING,
+	GET_SENSOR_STATUS,
+	SET_ALERT,
+	GET_ALERT,
+	GET_RAIN_1MIN,
+	GET_RAIN_10MIN,
+	GET_RAIN_60MIN,
+	SET_WIND_MODE,
+	GET_WIND_MODE,
+	SET_CONFIG,
+	GET_CONFIG,
+	SAVE_CONFIG
 
 } pmcommands;
 
+#define I2C_ADDRESS 0x03		// its in the reserved address space; unlikely to be duplicate with any commercial device.
+#define I2C_MAX_ARGS (1 + 2*CONFIG_REGISTERS)	// argument bytes that may follow a command byte (SET_CONFIG: 25)
+#define I2C_REPLY_MAX HISTORY_CHUNK_SIZE	// longest reply (HISTORY_READ), prepared by receiveEvent
+
+// board objects (PM2_driver.ino on the board, native/main_native.cpp on the native build)
+extern CalypsoWind wind;
+extern RadeonRain rain;
+
+// scheduler tasks and shared state (PM2_tasks.cpp)
+extern Scheduler scheduler;
+extern int8_t windTaskId;
+extern int8_t rainTaskId;
+extern int8_t frameTaskId;
+extern int8_t configTaskId;
+extern Snapshot<PM2Frame> frame;
+extern History history;
+extern FlashLog flashLog;
+extern Config config;
+extern SampleClock sampleClock;
+extern Alert alert;
+extern uint32_t readingRefreshInterval;
+extern bool windRunning;
+extern bool rainRunning;
+void startTasks();
+extern uint32_t i2cOnlineTime;				// micros() when the I2C slave was registered (PM2_commands.cpp)
+extern volatile uint32_t firstRequestTime;	// micros() when the first request was answered
+#define METRIC_REPORT_COUNTERS 7
+uint8_t metricCounters(uint32_t *values);	// error counters reported by GET_METRICS
+
+// I2C command dispatcher (PM2_commands.cpp)
+void receiveEvent(int howMany);
+void requestEvent();
@@ -6,6 +6,8 @@
 	The PM 2 Board is polled once in each cycle of readings for each device by the Master 
 	; wherein it delivers the most recent readings 
 	There is one request poll for each measurement reading of which there are 6.
+	Alternatively GET_ALL returns all 6 readings in one 30 byte frame (see PM2_frame.h).
+	GET_WIND_STATS returns statistics of every wind reading taken since the previous GET_WIND_STATS.
 		 
 */
 #include "wiring_private.h"
@@ -17,6 +19,8 @@
 
 #include "PM2_Raindriver.h"
 #include "PM2_Winddriver.h"
+#include "PM2_metrics.h"
+#include "PM2_log.h"
 
 
 
@@ -31,15 +35,12 @@ Special Note: On the PM Board for GPIO Port;
 	The Grove connector has 2 signal wires; the standard is: Yellow on Pin 1 (Rx); White on Pin 2. (Tx)
 	This therefore requires an unstandard form of wiring that crosses Tx and Rx.
 
-Secondary note: The default Baud rate of 9600 is slow; but we do not use higher baud rates because
-	it is unclear from documentation as to whether settings like this are preserved across power cycles.
-	This would make baud rate indeterminate and introduce complications in the code: namely having to reset 
-	baud rate for serial port.
+Secondary note: The default Baud rate of 9600 is slow; and it is unclear from documentation as to whether
+	a baud rate set with the 'B' command is preserved across power cycles.
+	RadeonRain::begin() therefore probes for the rate the gauge answers on and moves the link to the fastest
+	rate that passes a round trip (see RadeonRain::probe); beginRainSerial() restarts this port at each new rate.
 */
-Uart SerialGroveGPIO (&sercom4, GPIO1,GPIO0, SERCOM_RX_PAD_1, UART_TX_PAD_0 );
-void SERCOM4_Handler() {
-  SerialGroveGPIO.IrqHandler();
-} 
+DmaUart SerialGroveGPIO (&sercom4, GPIO1,GPIO0, SERCOM_RX_PAD_1, UART_TX_PAD_0, SERCOM4, 1, TC4);	// received by DMA channel 1, idle timer TC4
 
 // Hardware Serial UART SerialGrove (Grove #4 on PM Board) (38400 - Wind)
 /*
@@ -50,52 +51,60 @@ Special Note: On the PM Board for UART Port;
       The Grove connector has 2 signal wires; the standard is: Yellow on Pin 1 (Rx); White on Pin 2. (Tx)
       This can use a standard Grove Cable
 */
-Uart SerialGrove (&sercom1, RX0, TX0, SERCOM_RX_PAD_3, UART_TX_PAD_2);
-void SERCOM1_Handler() {
-  SerialGrove.IrqHandler();
-}
-
+DmaUart SerialGrove (&sercom1, RX0, TX0, SERCOM_RX_PAD_3, UART_TX_PAD_2, SERCOM1, 0, TC3);	// DMA channel 0, idle timer TC3
 RadeonRain rain(&SerialGroveGPIO);		// constructor executes
 CalypsoWind wind(&SerialGrove);
 
-union ibyte {				// used for I2C commands
-	uint8_t myint;
-	byte b;
-};
-
-extern floatbyte fbyte;		// used for readings.  Loaded as a float; read as a byte array [4]
-
-ibyte wichCommand;
-ibyte command;
-	
-uint32_t timer1=0;
-uint32_t timer2=0;
-uint32_t readingRefreshInterval; 
-bool windRunning=false;
-bool rainRunning=false;
-
-String CommandLiterals[] {		// used for debug only
-	"none",
-	"START_WIND",
-	"STOP_WIND",
-	"GET_WIND_DIR",
-	"GET_WIND_SPEED",
-	"START_RAIN",
-	"STOP_RAIN",
-	"GET_RAIN_ACC",
-	"GET_RAIN_EVENTACC",
-	"GET_RAIN_TOTALACC",
-	"GET_RAIN_INTVACC",
-	"RAIN_RESETACCUM",
-	"RAIN_CHECK"
-};
+/*
+  The sensor UARTs are received by the DMA controller (PM2_uartdma.h): the SERCOM handlers only see UART
+  errors, transmit and start of frame; the received bytes reach the drivers at the end of each burst.
+*/
+void SERCOM1_Handler() {
+  METRIC_START(start);		// entry to exit timing with PM2_METRICS (PM2_metrics.h)
+  halUartRxStart(SERCOM1);	// start of frame wake up / overrun count (PM2_hal.h)
+  SerialGrove.irqHandler();
+  METRIC_STOP(METRIC_WIND_ISR, start);
+}
+void SERCOM4_Handler() {
+  METRIC_START(start);
+  halUartRxStart(SERCOM4);
+  SerialGroveGPIO.irqHandler();
+  METRIC_STOP(METRIC_RAIN_ISR, start);
+} 
+void DMAC_Handler() {
+  METRIC_START(start);
+  SerialGrove.dmaHandler();		// half of a receive ring filled
+  SerialGroveGPIO.dmaHandler();
+  METRIC_STOP(METRIC_DMA_ISR, start);
+}
+void TC3_Handler() {
+  METRIC_START(start);
+  SerialGrove.idleHandler();	// end of a burst from the anemometer
+  METRIC_STOP(METRIC_WIND_IDLE_ISR, start);
+}
+void TC4_Handler() {
+  METRIC_START(start);
+  SerialGroveGPIO.idleHandler();	// end of a burst from the rain gauge
+  METRIC_STOP(METRIC_RAIN_IDLE_ISR, start);
+}
+void windRx() {
+  wind.serviceRx();		// feed the received sentence into the MWV parser
+}
+void rainRx() {
+  rain.serviceRx();		// feed the received line into the RG-15 line decoder
+}
 
-#define I2C_ADDRESS 0x03		// its in the reserved address space; unlikely to be duplicate with any commercial device.
+// (re)start the rain UART: begin() resets the SERCOM pin routing, so the pins are switched back to SERCOM4
+void beginRainSerial(uint32_t baud) {
+	SerialGroveGPIO.begin(baud);
+	pinPeripheral(GPIO0, PIO_SERCOM_ALT);   // tell the MUX unit what kind of port
+	pinPeripheral(GPIO1, PIO_SERCOM_ALT);
+	halUartStandby(SERCOM4, baud, WAKE_RAIN);	// keep receiving in standby (PM2_LOW_POWER)
+}
 
 void setup() {
 
 	uint32_t setuptimer=micros();
-	readingRefreshInterval=5*1000000; // (microseconds) (5 seconds): How often to take readings from the serial devices
 
 	// initialize serial communication at 115200 bits per second:  (Debugging)
 	SerialUSB.begin(115200);
@@ -107,38 +116,9 @@ void setup() {
 	digitalWrite(pinBLUE, HIGH);
 	digitalWrite(pinGREEN, LOW);
 	digitalWrite(pinRED, HIGH);
+	alert.begin();					// data ready line released until SET_ALERT turns it on (PM2_alert.h)
 
-	SerialGrove.begin(38400);		// wind  (Grove 3)
-	pinPeripheral(RX0, PIO_SERCOM);
-	pinPeripheral(TX0, PIO_SERCOM); 
-	while (!SerialGrove) {
-		delay(1);
-	}
-	SerialGroveGPIO.begin(9600);	// rain  (Grove 4)
-	pinPeripheral(GPIO0, PIO_SERCOM_ALT);   // tell the MUX unit what kind of port
-	pinPeripheral(GPIO1, PIO_SERCOM_ALT);
-	while (!SerialGroveGPIO) {
-		delay(1);
-	}
-	
-	wind.begin(&SerialGrove);
-	if (wind.started) {
-		windRunning=true;
-	} else {
-		SerialUSB.println("Anenometer unavailable");
-	}
-
-	rain.begin(&SerialGroveGPIO); 
-	if (rain.started){
-		rainRunning=true;
-	} else {
-		SerialUSB.println("Rain Guage unavailable");
-	
-	}
-	
-	timer1=micros();		// this is just initialisation 
-	timer2=micros();
-
+	// the I2C slave comes first so the master finds the board at once, whether the sensors answer or not
 	const byte addr=0x03;			// tried to use I2C_ADDRESS here but the device would not respond on the bus.
 	Wire.begin(addr);   			//  specifying a Slave Address sets I2C into Slave Mode
 									// the following interrupt driven functions are needed to allow
@@ -146,8 +126,29 @@ void setup() {
 	// interrupt service routines for I2C communication
 	Wire.onReceive(receiveEvent);	// Registers a function to be called when a slave device receives a transmission from the master.
 	Wire.onRequest(requestEvent);	// Register a function to be called when a master requests data from this slave device.
+	halI2CStandby(SERCOM3);			// Wire is on SERCOM3: an address match wakes the board from standby
+	i2cOnlineTime=micros();
 	// Slave mode operation and interrupt driven comms means that theoretically other operations will halt part way through
 	// and this may cause a loss of data during serial read operations in particular.
+
+	SerialGrove.onReceive(windRx);
+	SerialGroveGPIO.onReceive(rainRx);
+	SerialGrove.begin(38400);		// wind  (Grove 3)
+	pinPeripheral(RX0, PIO_SERCOM);
+	pinPeripheral(TX0, PIO_SERCOM); 
+	halUartStandby(SERCOM1, 38400, WAKE_WIND);
+	beginRainSerial(9600);			// rain  (Grove 4): the rain task negotiates a faster rate
+	rain.onPortBegin(beginRainSerial);
+
+	// the sensors are found and configured in the background by their tasks (PM2_bringup.h);
+	// GET_SENSOR_STATUS reports how far they got
+	wind.begin(&SerialGrove);
+	rain.begin(&SerialGroveGPIO); 
+	windRunning=true;
+	rainRunning=true;
+	
+	startTasks();		// scheduler tasks (PM2_tasks.cpp)
+	halLowPowerBegin();				// standby between tasks when built with PM2_LOW_POWER (PM2_hal.h)
 	
 	SerialUSB.println("PM#2 Board is ready");
 
@@ -158,315 +159,12 @@ void setup() {
 }
 
 
-// receiveEvent INTERRUPT FROM I2C PORT (Master sends data to the slave)
-void receiveEvent(int howMany)
-{
-	command.myint = 99;
-	uint32_t timer=micros();
-	uint32_t timeout=100;
-	//#ifdef debug_PM2
-	SerialUSB.print("Received an I2C Event. Bytes requested: ");
-	SerialUSB.println(howMany);
-	//#endif
-	if (howMany > 0) {
-		while (!Wire.available()) {
-			delayMicroseconds(1);
-			if (micros()-timer > timeout) break;
-		}
-		while (Wire.available()) {
-			command.b = Wire.read();	// one byte is not assumed but its the most likely case
-		}
-	}
-	//#ifdef debug_PM2
-	if (command.myint !=99) {
-		SerialUSB.print("Received an I2C Event command: ");
-		SerialUSB.println(CommandLiterals[command.myint]);
-	}
-	//#endif
-	
-	switch(command.myint) {
-		case START_WIND: {
-			if (wind.start()) {
-				windRunning=true;
-			}
-			wichCommand=command;
-			break;
-		}case START_RAIN: {
-			if (rain.start()) {
-				rainRunning=true;
-			}
-			wichCommand=command;
-			break;
-		}
-		case STOP_WIND:	{
-			if (wind.stop()) {
-				windRunning=false;
-			}
-			wichCommand=command;
-			break;
-		}
-		case STOP_RAIN: {
-			if (rain.stop()) {
-				rainRunning=false;
-			}
-			wichCommand=command;
-			break;
-		}
-		
-		case RAIN_RESETACCUM: {
-			rain.resetAccum();
-			wichCommand=command;
-			break;
-		}
-		
-		case GET_WIND_DIR:
-		case GET_WIND_SPEED:
-		case GET_RAIN_ACC:
-		case GET_RAIN_EVENTACC:
-		case GET_RAIN_TOTALACC:
-		case GET_RAIN_INTVACC:
-		case RAIN_CHECK: 
-		{
-			wichCommand=command;
-			break;
-		}
-		default: {
-			wichCommand.myint=99;
-			break;
-		}
-	}
-}
-
-// requestEvent INTERRUPT FROM i2c PORT (Master asks slave to send data)
-void requestEvent()
-{
-	/*
-		Respond to a request from the Master; typically: Ack (1); Nack (0) (1 byte) or a Reading value (4 bytes)
-	*/
-	//#ifdef debug_PM2  : Inclusion of the serial print comands will introduce a delay which could cause a timeout 
-	// or hoold up the bus.
-	//SerialUSB.print("Servicing an I2C request for command: ");
-	//SerialUSB.println(CommandLiterals[wichCommand.myint]);
-	//#endif
-	digitalWrite(pinBLUE, HIGH);
-	digitalWrite(pinGREEN, HIGH);
-	digitalWrite(pinRED, LOW);
-	floatbyte rdg;
-	switch (wichCommand.myint) {
-		
-		case START_WIND: {
-			if (wind.started) {
-				Wire.write(1);		// ack
-				SerialUSB.println("Ack sent for start wind");
-				rdg.f=0.00;
-				windRunning=true;
-			} else {
-				SerialUSB.println("wind is not started: Nack sent");
-				Wire.write(0);		// nack
-			}
-			break;
-		}
-		case STOP_WIND:	{
-			if (!wind.started) {
-				Wire.write(1);
-				rdg.f=0.00;
-				windRunning=false;
-			} else {
-				Wire.write(0);
-			}
-			break;
-		}
-		case GET_WIND_DIR: {
-			if (!wind.readingInProgress) {
-				rdg=wind.getWind_Dir();
-				for (uint8_t i=0; i<4; i++) {
-					Wire.write(rdg.b[i]);
-				}
-			} else {
-				Wire.write(0);
-			}
-			break;
-		}
-
-		case GET_WIND_SPEED:{
-			if (!wind.readingInProgress) {
-				rdg=wind.getWind_Speed();
-				for (uint8_t i=0; i<4; i++) {
-					Wire.write(rdg.b[i]);
-				}
-			} else {
-				Wire.write(0);
-			}
-			break;
-		}
-		case START_RAIN: {
-			if (rain.started) {
-				Wire.write(1);
-				SerialUSB.println("Ack sent for start rain");
-				rainRunning=true;
-			} else {
-				rain.started=false;
-				Wire.write(0);
-				SerialUSB.println("rain is not started: Nack sent");
-				
-			}
-			rdg.f=0.00;
-			
-			break;
-		}
-		case STOP_RAIN: {
-			rdg.f=0.00;
-			rain.stop();
-			if (!rain.started) {
-				Wire.write(1);
-				rainRunning=false;
-			} else {
-				Wire.write(0);
-			}
-			break;
-		}
-		case GET_RAIN_ACC: {
-			if (!rain.readingInProgress) {
-				rdg=rain.getAccReading();
-				for (uint8_t i=0; i<4; i++) {
-					Wire.write(rdg.b[i]);
-				}
-			} else {
-				Wire.write(0);
-			}
-			break;
-		}
-		case GET_RAIN_EVENTACC:{
-			if (!rain.readingInProgress) {
-				rdg=rain.getEventAccReading();
-				for (uint8_t i=0; i<4; i++) {
-					Wire.write(rdg.b[i]);
-				}
-			} else {
-				Wire.write(0);
-			}
-			break;
-		}
-		case GET_RAIN_TOTALACC:{
-			if (!rain.readingInProgress) {
-				rdg=rain.getTotalAccReading();
-				for (uint8_t i=0; i<4; i++) {
-					Wire.write(rdg.b[i]);
-				}
-			} else {
-				Wire.write(0);
-			}
-			break;
-		}
-		case GET_RAIN_INTVACC:{
-			if (!rain.readingInProgress) {
-				rdg=rain.getIntervalReading();
-				for (uint8_t i=0; i<4; i++) {
-					Wire.write(rdg.b[i]);
-				}
-			} else {
-				Wire.write(0);
-			}	
-			break;
-		}
-		case RAIN_CHECK: {
-			if (rain.checkStarted()) {
-				Wire.write(1);
-			} else {
-				Wire.write(0);
-			}
-		}
-		case RAIN_RESETACCUM: {
-			Wire.write(1);
-			break;
-		}
-		default: {
-			break;
-		}
-	}
-}
-/*
-	The Rain Gauge runs at 9600 bps :  (1041 uS per bit: 937.5 uS per byte (8 bits + stop))
-	Assuming immediate response to a Poll:
-	characters:  Poll = R+ CR LF + Response: |Acc 0.000 in, EventAcc 0.000 in, TotalAcc 0.000 in, RInt 0.000 iph| + CR LF
-	== 71 characters =~ (iro) 66562.5 uS for a complete Poll
-
-	The Wind Anemometer runs at 38400 bps: 2,042 uS per bit; 234.3 uS per Byte
-	Assuming immediate response: Poll command: $ULPI*00\r\n  (10 CHAR)
-	Poll Response: $--MWV,360,R,9.999,M*hh\r\n (25 CHAR)
-	== 35 CHARACTERS =~ (iro) 8203.1 uS
-
-	I2C commands will interrupt the reading process as frequently as 5 seconds; but likely every 60 sec
-
-	The Reading process and the I2C process are not synchronous. The latter can interrupt a reading.
-
-	I2C Poll (for EACH sensor value (of 6)) consists of address (1 byte) + 1 char (command) followed by Request (=address + No of Bytes)
-	I2C bus can operate at either 100 KBps or 400 kbps
-	Therefore each I2C Poll + request can take iro 360 uS @ 100 kbps or 90 uS @ 400 kbps
-
-	There is a small chance the Reading operation and the I2C poll operation might overlap
-
-	So I set up a semaphore called readingInProgress. It is set to true when the library is running the time critical process
-	of sending a request and reading the result.  It is set to false at the end of that process.
-	If readingInProgress=true; then we send a nack in response to a reading request; instead of the reading value.
-	A nack has the value of 0;  (byte= 0 == 8 bits all 0 + stop bit); 
-	it is obviously 1 byte in length instead of the expected 4 bytes for a reading. (float)
-	Knowing this is what occurs, it should be detectable in the Master MCU.
-
-*/
-// the loop function runs over and over again forever It waits 100 mS on each iteration; and takes a reading from each device
-// every readingRefreshInterval uS.
-uint32_t myctr=0;
+// the loop function runs over and over again forever; it dispatches whatever task is due, prints what the
+// interrupt handlers logged (PM2_log.h) and otherwise sleeps.
 void loop() {
-	SerialUSB.println("PM#2 Board is idling in the  Reading Loop");
-	digitalWrite(pinBLUE, LOW);
-	digitalWrite(pinGREEN, HIGH);
-	digitalWrite(pinRED, HIGH);	
-	delay(500);
-	#ifdef debug_PM2
-	SerialUSB.println(myctr);
-	#endif
-	//floatbyte rdg;
-	if (wind.started && windRunning) {
-		if (micros() - timer1 > readingRefreshInterval) {
-			
-			SerialUSB.println("Wind Reading ..........");
-			
-			wind.getReading(); // send /receive 35 bytes at 38400 bps + processing time
-			/*
-			SerialUSB.print("Wind Speed:");
-			rdg=wind.getWind_Speed();
-			SerialUSB.println(rdg.f);
-			SerialUSB.print("Wind Dir:");
-			rdg=wind.getWind_Dir();
-			SerialUSB.println(rdg.f);
-			*/
-			timer1 = micros();
-		}
-	}
-	digitalWrite(pinBLUE, HIGH);
-	digitalWrite(pinGREEN, LOW);
-	digitalWrite(pinRED, HIGH);	
-	if (rain.checkStarted() && rainRunning) {
-		if (micros() - timer2 > readingRefreshInterval) {
-			
-			SerialUSB.println("Rain Reading .........");
-			
-			rain.getReading(); // 71 bytes @ 9600 bps + processing time
-			/*
-			rdg=rain.getAccReading();
-			SerialUSB.print("Rain Accum:");
-			SerialUSB.println(rdg.f);
-			rdg=rain.getEventAccReading();
-			SerialUSB.print("Rain Event Accum:");
-			SerialUSB.println(rdg.f);
-			rdg=rain.getTotalAccReading();
-			SerialUSB.print("Rain Total Accum:");
-			SerialUSB.println(rdg.f);
-			*/
-			timer2 = micros();
-		}
-	}
-	myctr++;
+	METRIC_START(start);
+	scheduler.runDue();
+	METRIC_STOP(METRIC_LOOP, start);
+	eventLog.drain();
+	scheduler.idle();
 }
-
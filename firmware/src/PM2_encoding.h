@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include "PM2_types.h"
+
+/*
+	Reading representation.
+
+	The parsers produce scaled integers directly and the readings are stored that way:
+		wind direction		deci-degrees			(int16)
+		wind speed			centi-metres / second	(int16)
+		rain accumulations	micro-metres			(int32)
+		rain intensity		micro-metres / hour		(int32)
+	How a reading is sent over I2C is a compile time policy (the M0+ has no FPU, so every float conversion
+	is a software routine):
+		FloatEncoding (default)	IEEE float in the original units (deg, m/s, mm, mm/hr): 4 bytes per value.
+								This is the format existing masters expect.
+		FixedEncoding			the scaled integers themselves, little endian: int16 for wind values,
+								int32 for rain values. No float arithmetic at all.
+	Select the fixed point encoding with build_flags = -D PM2_FIXED_POINT in platformio.ini.
+	`program encoding` in the native build times parsing and encoding a sample under each policy.
+*/
+
+#define WIND_DIR_SCALE		10		// deci-degrees per degree
+#define WIND_SPEED_SCALE	100		// centi-m/s per m/s
+#define RAIN_SCALE			1000	// uM per mm (also uM/hr per mm/hr)
+
+struct FloatEncoding {
+	static const uint8_t size16=4;	// bytes used for a value held as int16
+	static const uint8_t size32=4;	// bytes used for a value held as int32
+
+	static uint8_t real(float value, uint8_t *out) {
+		floatbyte rdg;
+		rdg.f=value;
+		for (uint8_t i=0; i<4; i++) {
+			out[i]=rdg.b[i];
+		}
+		return 4;
+	}
+	static uint8_t fixed16(int16_t value, int32_t scale, uint8_t *out) {
+		return real((float)value / scale, out);
+	}
+	static uint8_t fixed32(int32_t value, int32_t scale, uint8_t *out) {
+		return real((float)value / scale, out);
+	}
+	static uint8_t real16(float value, int32_t /* scale */, uint8_t *out) {
+		return real(value, out);
+	}
+	static uint8_t real32(float value, int32_t /* scale */, uint8_t *out) {
+		return real(value, out);
+	}
+};
+
+struct FixedEncoding {
+	static const uint8_t size16=2;
+	static const uint8_t size32=4;
+
+	static uint8_t fixed16(int16_t value, int32_t /* scale */, uint8_t *out) {
+		out[0]=(uint8_t)value;
+		out[1]=(uint8_t)((uint16_t)value >> 8);
+		return 2;
+	}
+	static uint8_t fixed32(int32_t value, int32_t /* scale */, uint8_t *out) {
+		for (uint8_t i=0; i<4; i++) {
+			out[i]=(uint8_t)((uint32_t)value >> (8*i));
+		}
+		return 4;
+	}
+	// values that are computed as floats (statistics) are scaled and rounded
+	static uint8_t real16(float value, int32_t scale, uint8_t *out) {
+		float scaled = value * scale;
+		if (scaled > 32767.0f) scaled = 32767.0f;
+		if (scaled < -32768.0f) scaled = -32768.0f;
+		return fixed16((int16_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f), scale, out);
+	}
+	static uint8_t real32(float value, int32_t scale, uint8_t *out) {
+		float scaled = value * scale;
+		if (scaled > 2147483520.0f) scaled = 2147483520.0f;
+		if (scaled < -2147483520.0f) scaled = -2147483520.0f;
+		return fixed32((int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f), scale, out);
+	}
+};
+
+#ifdef PM2_FIXED_POINT
+typedef FixedEncoding ReadingEncoding;
+#else
+typedef FloatEncoding ReadingEncoding;
+#endif
+
+#define WIND_VALUE_SIZE ReadingEncoding::size16
+#define RAIN_VALUE_SIZE ReadingEncoding::size32
@@ -0,0 +1,136 @@
+#include <string.h>
+#include "PM2_flashlog.h"
+#include "PM2_frame.h"
+
+#ifdef ARDUINO
+// row aligned area in the program flash; it is cleared (not blank) whenever new firmware is uploaded
+__attribute__((aligned(HAL_FLASH_ROW))) static const uint8_t flashLogArea[FLASHLOG_SIZE] = { };
+#else
+alignas(HAL_FLASH_ROW) uint8_t flashLogArea[FLASHLOG_SIZE];
+#endif
+
+// read through a volatile pointer: the compiler must not assume the contents are the initial zeroes
+static const volatile uint8_t *const flashLog = flashLogArea;
+
+static uint32_t getLong(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t *putLong(uint8_t *p, uint32_t value) {
+	for (uint8_t i=0; i<4; i++) {
+		*p++ = (uint8_t)(value >> (8*i));
+	}
+	return p;
+}
+
+static void copySlot(uint16_t slot, uint8_t *out) {
+	const volatile uint8_t *p = flashLog + slot * FLASHLOG_SLOT_SIZE;
+	for (uint8_t i=0; i<FLASHLOG_SLOT_SIZE; i++) {
+		out[i] = p[i];
+	}
+}
+
+bool FlashLog::readSlot(uint16_t slot, FlashCheckpoint &checkpoint) {
+	uint8_t b[FLASHLOG_SLOT_SIZE];
+	copySlot(slot, b);
+	if (b[15] != FLASHLOG_MAGIC || crc8(b, 14) != b[14]) {
+		return false;
+	}
+	checkpoint.seq = getLong(b);
+	checkpoint.totalacc = (int32_t)getLong(b + 4);
+	checkpoint.eventacc = (int32_t)getLong(b + 8);
+	return checkpoint.seq != 0 && checkpoint.seq != 0xFFFFFFFF;
+}
+
+bool FlashLog::blankSlot(uint16_t slot) {
+	uint8_t b[FLASHLOG_SLOT_SIZE];
+	copySlot(slot, b);
+	for (uint8_t i=0; i<FLASHLOG_SLOT_SIZE; i++) {
+		if (b[i] != 0xFF) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+	Find the newest checkpoint (see PM2_flashlog.h) and point the log at the slot after it.
+	With nothing valid in the area (first boot, new firmware) the log starts again at row 0.
+*/
+bool FlashLog::begin() {
+	FlashCheckpoint checkpoint;
+	int8_t newestRow=-1;
+	recoverReads=0;
+	saves=0;
+	_last.seq=0;
+	for (uint8_t row=0; row<FLASHLOG_ROWS; row++) {
+		recoverReads++;
+		if (readSlot(row * FLASHLOG_SLOTS_PER_ROW, checkpoint) && checkpoint.seq > _last.seq) {
+			_last=checkpoint;
+			newestRow=row;
+		}
+	}
+	if (newestRow < 0) {
+		_last.totalacc=0;
+		_last.eventacc=0;
+		_nextSlot=0;
+		return false;
+	}
+	uint16_t first = newestRow * FLASHLOG_SLOTS_PER_ROW;
+	uint16_t newestSlot=first;
+	for (uint16_t slot=first + 1; slot<first + FLASHLOG_SLOTS_PER_ROW; slot++) {
+		recoverReads++;
+		if (readSlot(slot, checkpoint) && checkpoint.seq > _last.seq) {
+			_last=checkpoint;
+			newestSlot=slot;
+		}
+	}
+	_nextSlot = (newestSlot + 1) % (FLASHLOG_ROWS * FLASHLOG_SLOTS_PER_ROW);
+	return true;
+}
+
+/*
+	Write a checkpoint to the next slot, erasing the row first when the log moves onto a new one. The slot is
+	written with the magic byte blank and the magic byte follows in a second page write (see PM2_flashlog.h).
+	A slot that is not blank (a write cut short before the last reset) is skipped rather than erased.
+*/
+bool FlashLog::save(int32_t totalacc, int32_t eventacc) {
+	const uint16_t slots = FLASHLOG_ROWS * FLASHLOG_SLOTS_PER_ROW;
+	for (uint16_t tries=0; tries<FLASHLOG_SLOTS_PER_ROW; tries++) {
+		if (_nextSlot % FLASHLOG_SLOTS_PER_ROW == 0) {
+			halFlashErase(flashLogArea + _nextSlot * FLASHLOG_SLOT_SIZE);
+		}
+		if (blankSlot(_nextSlot)) {
+			break;
+		}
+		skippedSlots++;
+		_nextSlot = (_nextSlot + 1) % slots;
+	}
+
+	uint32_t seq = _last.seq + 1;
+	uint8_t b[FLASHLOG_SLOT_SIZE];
+	uint8_t *p = putLong(b, seq);
+	p = putLong(p, (uint32_t)totalacc);
+	p = putLong(p, (uint32_t)eventacc);
+	*p++ = 0xFF;
+	*p++ = 0xFF;
+	*p++ = crc8(b, 14);
+	*p = 0xFF;
+	const uint8_t *slot = flashLogArea + _nextSlot * FLASHLOG_SLOT_SIZE;
+	halFlashWrite(slot, b, FLASHLOG_SLOT_SIZE);
+	// the magic byte in a page write of its own, once the rest is in: the last word again, the other bytes unchanged
+	b[15] = FLASHLOG_MAGIC;
+	halFlashWrite(slot + FLASHLOG_SLOT_SIZE - 4, b + FLASHLOG_SLOT_SIZE - 4, 4);
+
+	FlashCheckpoint check;
+	bool written = readSlot(_nextSlot, check) && check.seq == seq;
+	_nextSlot = (_nextSlot + 1) % slots;
+	if (!written) {
+		return false;
+	}
+	_last.seq=seq;
+	_last.totalacc=totalacc;
+	_last.eventacc=eventacc;
+	saves++;
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include "PM2_hal.h"
+
+/*
+	Rain accumulation checkpoints kept in the on-chip flash, so totalacc / eventacc survive a reset or a
+	brown out (the RG-15 itself is cleared with 'O' at every start up).
+
+	The log is a small area of FLASHLOG_ROWS flash rows used as a ring of fixed size slots. A checkpoint is
+	written to the next slot; a row is erased only when the log moves onto it, so every row is erased once per
+	FLASHLOG_ROWS*FLASHLOG_SLOTS_PER_ROW checkpoints (128) and the wear is spread evenly over the area.
+	Slot layout (little endian):
+		uint32	sequence number (never 0 or 0xFFFFFFFF)
+		int32	totalacc (uM)
+		int32	eventacc (uM)
+		uint8	reserved (0xFF) x2
+		uint8	CRC-8 of the preceding 14 bytes (see PM2_frame.h)
+		uint8	FLASHLOG_MAGIC
+	The NVM controller commits a page write as a whole, in no byte order that can be relied on, so a slot is
+	written twice: first everything but the magic byte, then its last word again with the magic byte. A write
+	cut short by a reset leaves the magic byte blank (or not yet all cleared) and is ignored: recovery returns
+	the checkpoint before it.
+
+	Recovery at boot is bounded: the first slot of every row is read to find the row written last (slot 0 of a
+	row is always the first written after its erase), then that row is scanned for its newest valid slot.
+	That is at most FLASHLOG_ROWS + FLASHLOG_SLOTS_PER_ROW slot reads whatever the state of the area.
+
+	Erasing and programming stall the CPU (see halFlashErase), so checkpoints are rare: the checkpoint task
+	saves at most once every FLASHLOG_INTERVAL and only when the totals have changed.
+*/
+
+#define FLASHLOG_ROWS 8
+#define FLASHLOG_SLOT_SIZE 16
+#define FLASHLOG_SLOTS_PER_ROW (HAL_FLASH_ROW / FLASHLOG_SLOT_SIZE)
+#define FLASHLOG_SIZE (FLASHLOG_ROWS * HAL_FLASH_ROW)		// 2 kB
+#define FLASHLOG_MAGIC 0xA5
+#define FLASHLOG_INTERVAL 60000000		// uS between checkpoints while the totals keep changing
+#define FLASHLOG_DEFER 50000			// uS to wait while a sensor reply is on the wire
+
+struct FlashCheckpoint {
+	uint32_t seq;			// 0: nothing saved yet
+	int32_t totalacc;		// uM
+	int32_t eventacc;		// uM
+};
+
+class FlashLog {
+	public:
+		bool begin();							// recover the newest checkpoint; false if there is none
+		bool save(int32_t totalacc, int32_t eventacc);	// main context only: blocks for up to ~11 mS
+		const FlashCheckpoint &last() const { return _last; }
+		uint16_t recoverReads=0;				// slots read by the last begin()
+		uint32_t saves=0;						// checkpoints written since begin()
+		uint32_t skippedSlots=0;				// slots found not blank (an earlier write cut short)
+
+	private:
+		bool readSlot(uint16_t slot, FlashCheckpoint &checkpoint);
+		bool blankSlot(uint16_t slot);
+		FlashCheckpoint _last={0, 0, 0};
+		uint16_t _nextSlot=0;					// slot the next checkpoint goes to
+};
+
+#ifndef ARDUINO
+extern uint8_t flashLogArea[FLASHLOG_SIZE];		// simulated flash: the native build inspects and clears it
+#endif
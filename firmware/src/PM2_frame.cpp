@@ -0,0 +1,28 @@
+#include "PM2_frame.h"
+
+// CRC-8 polynomial x^8 + x^2 + x + 1 (0x07), as used by SMBus PEC
+uint8_t crc8(const uint8_t *data, uint8_t len) {
+	uint8_t crc=0;
+	for (uint8_t i=0; i<len; i++) {
+		crc ^= data[i];
+		for (uint8_t bit=0; bit<8; bit++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+void buildFrame(PM2Frame &frame, uint32_t sequence, uint8_t status, const windreading &wind, const RainReading &rain) {
+	uint8_t *p = frame.b;
+	for (uint8_t i=0; i<4; i++) {
+		*p++ = (uint8_t)(sequence >> (8*i));
+	}
+	*p++ = status;
+	p += ReadingEncoding::fixed16(wind.winddir, WIND_DIR_SCALE, p);
+	p += ReadingEncoding::fixed16(wind.windspeed, WIND_SPEED_SCALE, p);
+	p += ReadingEncoding::fixed32(rain.accum, RAIN_SCALE, p);
+	p += ReadingEncoding::fixed32(rain.eventacc, RAIN_SCALE, p);
+	p += ReadingEncoding::fixed32(rain.totalacc, RAIN_SCALE, p);
+	p += ReadingEncoding::fixed32(rain.intervalacc, RAIN_SCALE, p);
+	*p = crc8(frame.b, FRAME_SIZE - 1);
+}
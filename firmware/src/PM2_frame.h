@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include "PM2_types.h"
+#include "PM2_encoding.h"
+#include "PM2_Winddriver.h"
+#include "PM2_Raindriver.h"
+
+/*
+	Bulk reading frame returned by the GET_ALL command: every reading in a single I2C transaction.
+	The frame is built by the main loop whenever a sensor publishes, so the I2C handlers only copy bytes.
+
+	Layout (little endian; values encoded by ReadingEncoding, see PM2_encoding.h):
+		uint32	sequence		incremented each time the frame is rebuilt
+		uint8	status			FRAME_STATUS_xxx bits
+		wind direction			float (deg) or int16 (deci-degrees)
+		wind speed				float (m/s) or int16 (centi-m/s)
+		rain acc				float (mm) or int32 (uM)
+		rain eventacc			float (mm) or int32 (uM)
+		rain totalacc			float (mm) or int32 (uM)
+		rain intensity			float (mm/hr) or int32 (uM/hr)
+		uint8	CRC-8 (polynomial 0x07, initial value 0) of all the preceding bytes
+	This is 30 bytes with the float encoding and 26 bytes with the fixed point encoding.
+*/
+
+#define FRAME_SIZE (4 + 1 + 2*WIND_VALUE_SIZE + 4*RAIN_VALUE_SIZE + 1)
+
+// offsets of the readings, also sent on their own as the replies to GET_WIND_DIR .. GET_RAIN_INTVACC
+#define FRAME_WIND_DIR		5
+#define FRAME_WIND_SPEED	(FRAME_WIND_DIR + WIND_VALUE_SIZE)
+#define FRAME_RAIN_ACC		(FRAME_WIND_SPEED + WIND_VALUE_SIZE)
+#define FRAME_RAIN_EVENTACC	(FRAME_RAIN_ACC + RAIN_VALUE_SIZE)
+#define FRAME_RAIN_TOTALACC	(FRAME_RAIN_EVENTACC + RAIN_VALUE_SIZE)
+#define FRAME_RAIN_INTVACC	(FRAME_RAIN_TOTALACC + RAIN_VALUE_SIZE)
+
+#define FRAME_STATUS_WIND_RUNNING	0x01
+#define FRAME_STATUS_RAIN_RUNNING	0x02
+#define FRAME_STATUS_WIND_NEW		0x04	// wind reading changed since the previous frame
+#define FRAME_STATUS_RAIN_NEW		0x08	// rain reading changed since the previous frame
+#define FRAME_STATUS_WIND_TIMEOUT	0x10	// the anemometer has missed a poll since the previous frame
+#define FRAME_STATUS_RAIN_TIMEOUT	0x20	// the rain gauge has missed a poll since the previous frame
+
+struct PM2Frame {
+	uint8_t b[FRAME_SIZE];
+};
+
+uint8_t crc8(const uint8_t *data, uint8_t len);
+void buildFrame(PM2Frame &frame, uint32_t sequence, uint8_t status, const windreading &wind, const RainReading &rain);
@@ -0,0 +1,230 @@
+#pragma once
+
+/*
+	Hardware abstraction layer.
+
+	The drivers, the scheduler and the I2C command dispatcher only use the names below for the hardware:
+		SerialPort		sensor UART (available / read / rxSpan / rxConsume / write / print / println / begin);
+						on the board received by the DMA controller (PM2_uartdma.h)
+		I2CSlave		the I2C slave port (onReceive / onRequest / available / read / write), instance i2cSlave
+		halMicros() / halMillis() / halDelay() / halDelayMicroseconds() / halIdle()	clock and sleep
+		halCycles()		CPU cycle count for timing short sections (PM2_metrics.h)
+		halInterruptsOff() / halStandby()	scheduler sleep between tasks (standby with -D PM2_LOW_POWER)
+		halLog			debug text output (print / println); halLogReady(): someone is listening
+		halInInterrupt()	running in an interrupt handler (PM2_log.h)
+		halLed()		RGB status led
+		halAlertBegin() / halAlert()	data ready line to the master (open drain, see PM2_alert.h)
+		halFlashErase() / halFlashWrite()	on-chip flash: erase a row of HAL_FLASH_ROW bytes, program within a page
+	On the board (ARDUINO defined) they map directly onto the Arduino core: plain typedefs and inline
+	functions, so there is no virtual call or indirection added on the target.
+	The native (Linux) build maps them onto the simulated devices in native/PM2_hal_native.h instead,
+	which lets the drivers and the command dispatcher be compiled and exercised on a PC.
+*/
+
+#include <stdint.h>
+
+#define HAL_FLASH_PAGE 64		// SAMD21 NVM: write unit
+#define HAL_FLASH_ROW 256		// erase unit (4 pages)
+#define HAL_CYCLES_PER_US 48	// halCycles() rate: the CPU clock
+
+enum LedColour : uint8_t {
+	LED_RED,
+	LED_GREEN,
+	LED_BLUE
+};
+
+/*
+	Low power operation (build with -D PM2_LOW_POWER, see PM2_lowpower.cpp). When no task is due the scheduler
+	turns interrupts off, checks once more, and calls halStandby() with the time to the next deadline: the board
+	goes into standby (the CPU, the 48 MHz clock and SysTick stop) and is woken by
+		the RTC alarm set for the next deadline,
+		a start bit on either sensor UART (SERCOM start of frame detection; the SERCOMs run from the on demand
+		8 MHz oscillator so they receive while the rest of the chip sleeps), or
+		an address match on the I2C slave (the master's clock is stretched until the handler has run).
+	Interrupts stay off across the sleep so a wake source that fires between the check and the sleep still ends
+	it; the pending handlers run when halStandby() turns them back on. The time slept is measured by the RTC and
+	added to halMicros() / halMillis(). While the USB port is configured (debugging on the bench) the board only
+	idles, so the USB serial log keeps working. Without PM2_LOW_POWER halStandby() is the plain idle (WFI).
+
+	halPower counts what happened so the saving and the wake up can be checked over I2C (GET_POWER_STATS).
+*/
+enum HalWakeSource : uint8_t {
+	WAKE_RTC,			// the next task deadline
+	WAKE_WIND,			// start bit on the anemometer UART
+	WAKE_RAIN,			// start bit on the rain gauge UART
+	WAKE_I2C,			// I2C address match
+	WAKE_OTHER,
+	WAKE_SOURCES
+};
+
+struct HalPowerStats {
+	uint32_t standbyMillis;			// time spent in standby
+	uint32_t wakes[WAKE_SOURCES];
+	uint32_t wakeLatencyMax;		// uS from the RTC alarm to the CPU running again (RTC wakes)
+	uint32_t rxLost;				// UART receive overruns (bytes lost, eg while waking)
+};
+
+extern HalPowerStats halPower;
+
+// receive counters of a sensor UART (GET_UART_STATS)
+struct UartRxStats {
+	uint32_t bytes;				// bytes handed to the driver
+	uint32_t interrupts;		// receive interrupts: one per byte without DMA, one per burst / half ring with it
+	uint32_t overruns;			// bytes lost in the UART (the data register was not read in time)
+	uint32_t framingErrors;		// bytes with a bad stop bit (noise, or the two ends at different rates)
+	uint32_t ringOverruns;		// bytes lost because the receive ring was full
+};
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "pins.h"
+
+typedef DmaUart SerialPort;
+typedef TwoWire I2CSlave;
+
+static I2CSlave &i2cSlave = Wire;
+static Serial_ &halLog = SerialUSB;
+
+inline void halDelay(uint32_t ms) { delay(ms); }
+inline void halDelayMicroseconds(uint32_t us) { delayMicroseconds(us); }
+inline void halIdle() { __WFI(); }		// halt until the next interrupt
+inline void halInterruptsOff() { __disable_irq(); }
+inline void halInterruptsOn() { __enable_irq(); }
+inline bool halInInterrupt() { return (__get_IPSR() & 0x1FF) != 0; }
+inline bool halLogReady() { return SerialUSB.dtr(); }	// a terminal has the port open: printing will not block
+
+/*
+	CPU cycles since power up (wraps every ~89 S), from the millisecond count and the SysTick down counter.
+	Also correct inside an interrupt handler that has held off the SysTick interrupt past a reload.
+	Does not count time in standby: only used to time sections that run.
+*/
+inline uint32_t halCycles() {
+	uint32_t ms, ticks, pending;
+	do {
+		ms = millis();
+		ticks = SysTick->VAL;
+		pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+	} while (ms != millis());
+	if (pending && ticks > SysTick->LOAD / 2) {
+		ms++;			// reloaded before ticks was read, tick interrupt not taken yet
+	}
+	return ms * (SysTick->LOAD + 1) + (SysTick->LOAD - ticks);
+}
+
+#ifdef PM2_LOW_POWER
+
+extern volatile uint32_t halSleptMicros;	// time spent in standby, where SysTick does not count
+extern volatile uint32_t halSleptMillis;
+
+inline uint32_t halMicros() { return micros() + halSleptMicros; }
+inline uint32_t halMillis() { return millis() + halSleptMillis; }
+
+void halLowPowerBegin();			// RTC and standby clocks: call once the ports have been started
+void halUartStandby(Sercom *sercom, uint32_t baud, HalWakeSource source);	// after every begin() of a sensor UART
+void halI2CStandby(Sercom *sercom);	// after Wire.begin()
+void halStandby(uint32_t us);		// interrupts off on entry, on on return
+
+extern volatile uint8_t halRxActive;	// SERCOMs receiving a burst: stay out of standby until it has ended
+
+inline uint8_t halSercomBit(Sercom *sercom) {
+	return 1 << (((uintptr_t)sercom - (uintptr_t)SERCOM0) / ((uintptr_t)SERCOM1 - (uintptr_t)SERCOM0));
+}
+
+// the burst detected by the start of frame interrupt has ended (DmaUart idle timer)
+inline void halRxDone(Sercom *sercom) {
+	halRxActive &= ~halSercomBit(sercom);
+}
+
+#else
+
+inline uint32_t halMicros() { return micros(); }
+inline uint32_t halMillis() { return millis(); }
+inline void halLowPowerBegin() {}
+inline void halUartStandby(Sercom *sercom, uint32_t baud, HalWakeSource source) {}
+inline void halI2CStandby(Sercom *sercom) {}
+inline void halStandby(uint32_t us) { __WFI(); __enable_irq(); }	// SysTick still wakes it every mS
+inline void halRxDone(Sercom *sercom) {}
+
+#endif
+
+/*
+	First thing in SERCOMx_Handler: acknowledge a start of frame wake up and count a receive overrun.
+	The start of frame interrupt is taken on every start bit, awake or not; only the first of a burst finds the
+	board in standby. In standby the DMA controller and the idle timer stop with the main clock, so once a burst
+	has started the board only idles until the idle timer reports its end (halRxDone).
+*/
+inline void halUartRxStart(Sercom *sercom) {
+	SercomUsart &usart = sercom->USART;
+	if (usart.INTFLAG.bit.RXS) {
+		usart.INTFLAG.reg = SERCOM_USART_INTFLAG_RXS;
+#ifdef PM2_LOW_POWER
+		halRxActive |= halSercomBit(sercom);
+#endif
+	}
+	if (usart.STATUS.bit.BUFOVF) {
+		halPower.rxLost++;		// DmaUart::irqHandler clears the error
+	}
+}
+
+// the led pins are active low: light one colour only
+inline void halLed(LedColour colour) {
+	digitalWrite(pinRED, colour == LED_RED ? LOW : HIGH);
+	digitalWrite(pinGREEN, colour == LED_GREEN ? LOW : HIGH);
+	digitalWrite(pinBLUE, colour == LED_BLUE ? LOW : HIGH);
+}
+
+/*
+	The alert line is open drain: the output latch is held low and asserting it only turns the driver on, so
+	releasing it leaves the pin floating for the master's pull up. One PORT register write either way, safe
+	from an interrupt handler.
+*/
+inline void halAlertBegin() {
+	const PinDescription &pin = g_APinDescription[pinALERT];
+	PORT->Group[pin.ulPort].DIRCLR.reg = 1ul << pin.ulPin;
+	PORT->Group[pin.ulPort].OUTCLR.reg = 1ul << pin.ulPin;
+	PORT->Group[pin.ulPort].PINCFG[pin.ulPin].reg = 0;		// no pull, no peripheral
+}
+
+inline void halAlert(bool asserted) {
+	const PinDescription &pin = g_APinDescription[pinALERT];
+	if (asserted) {
+		PORT->Group[pin.ulPort].DIRSET.reg = 1ul << pin.ulPin;		// driven low
+	} else {
+		PORT->Group[pin.ulPort].DIRCLR.reg = 1ul << pin.ulPin;		// released
+	}
+}
+
+/*
+	On-chip flash (NVM controller). The CPU stalls while a row is erased (~6 mS) or a page written (~2.5 mS)
+	because it executes from the same flash, so callers keep these rare.
+*/
+inline void halFlashCommand(uint32_t command) {
+	NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | command;
+	while (!NVMCTRL->INTFLAG.bit.READY) {}
+}
+
+// erase the row starting at row (HAL_FLASH_ROW aligned): every byte reads 0xFF
+inline void halFlashErase(const uint8_t *row) {
+	NVMCTRL->ADDR.reg = (uintptr_t)row / 2;		// 16 bit word address
+	halFlashCommand(NVMCTRL_CTRLA_CMD_ER);
+}
+
+// program len bytes (a multiple of 4, 4 byte aligned, within one page); bits can only be cleared
+inline void halFlashWrite(const uint8_t *dst, const void *src, uint16_t len) {
+	NVMCTRL->CTRLB.bit.MANW = 1;				// write the page only on the WP command
+	halFlashCommand(NVMCTRL_CTRLA_CMD_PBC);		// page buffer to 0xFF: the rest of the page is left as it is
+	volatile uint32_t *d = (volatile uint32_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+	for (uint16_t i=0; i<len; i+=4) {
+		*d++ = s[i] | (s[i+1] << 8) | (s[i+2] << 16) | ((uint32_t)s[i+3] << 24);
+	}
+	halFlashCommand(NVMCTRL_CTRLA_CMD_WP);
+}
+
+#else
+
+#include "native/PM2_hal_native.h"
+
+#endif
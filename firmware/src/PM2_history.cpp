@@ -0,0 +1,127 @@
+#include "PM2_history.h"
+#include "PM2_frame.h"
+
+static uint8_t *putLong(uint8_t *p, uint32_t value) {
+	for (uint8_t i=0; i<4; i++) {
+		*p++ = (uint8_t)(value >> (8*i));
+	}
+	return p;
+}
+
+static uint8_t *putShort(uint8_t *p, uint16_t value) {
+	*p++ = (uint8_t)value;
+	*p++ = (uint8_t)(value >> 8);
+	return p;
+}
+
+History::History() {
+	for (uint16_t i=0; i<HISTORY_RECORDS; i++) {
+		_records[i].seq=0;
+	}
+	_time.seconds=0;
+	_time.millis=0;
+	_time.set=false;
+	_clock.publish(_time);
+}
+
+/*
+	Advance the clock by the whole seconds elapsed since the last call (so the millis() wrap at ~49 days
+	does not matter as long as this is called more often than that) and apply a pending SET_TIME.
+*/
+uint32_t History::now() {
+	uint32_t ms=halMillis();
+	if (_timePending) {
+		_timePending=false;
+		_time.seconds = _pendingTime + (ms - _pendingMillis) / 1000;
+		_time.millis = ms - (ms - _pendingMillis) % 1000;
+		_time.set=true;
+	} else {
+		uint32_t elapsed = (ms - _time.millis) / 1000;
+		_time.seconds += elapsed;
+		_time.millis += elapsed * 1000;
+	}
+	_clock.publish(_time);
+	return _time.seconds;
+}
+
+uint32_t History::nowISR() const {
+	HistoryClock clock;
+	_clock.read(clock);
+	return clock.seconds + (halMillis() - clock.millis) / 1000;
+}
+
+bool History::timeSet() const {
+	HistoryClock clock;
+	_clock.read(clock);
+	return clock.set;
+}
+
+void History::setTime(uint32_t unixTime) {
+	_pendingTime=unixTime;
+	_pendingMillis=halMillis();
+	_timePending=true;
+}
+
+void History::add(uint8_t flags, const windreading &wind, const RainReading &rain) {
+	uint32_t seq=_next;
+	uint32_t time=now();
+	HistoryRecord &record = _records[seq % HISTORY_RECORDS];
+	record.seq=0;				// being written: the I2C handler will not send it
+	SNAPSHOT_BARRIER();
+	record.time=time;
+	record.flags = _time.set ? flags : (uint8_t)(flags | HISTORY_TIME_UNSET);
+	record.wind=wind;
+	record.rain=rain;
+	SNAPSHOT_BARRIER();
+	record.seq=seq;
+	_next=seq + 1;
+}
+
+uint32_t History::oldest() const {
+	uint32_t next=_next;
+	return (next > HISTORY_RECORDS) ? next - HISTORY_RECORDS : 1;
+}
+
+void History::seek(uint32_t seq) {
+	_cursor=seq;
+}
+
+void History::readChunk(uint8_t *out) {
+	uint32_t next=_next;
+	if (_cursor < oldest()) {
+		_cursor=oldest();		// the records asked for have been overwritten
+	}
+	if (_cursor > next) {
+		_cursor=next;
+	}
+	uint8_t *p = out + 7;
+	uint8_t count=0;
+	while (count < HISTORY_CHUNK_RECORDS && _cursor + count < next) {
+		const HistoryRecord &record = _records[(_cursor + count) % HISTORY_RECORDS];
+		if (record.seq != _cursor + count) {
+			if (count == 0) {
+				_cursor++;		// the oldest record is being overwritten right now
+				continue;
+			}
+			break;
+		}
+		p = putLong(p, record.time);
+		*p++ = record.flags;
+		p = putShort(p, (uint16_t)record.wind.winddir);
+		p = putShort(p, (uint16_t)record.wind.windspeed);
+		p = putLong(p, (uint32_t)record.rain.accum);
+		p = putLong(p, (uint32_t)record.rain.eventacc);
+		p = putLong(p, (uint32_t)record.rain.totalacc);
+		p = putLong(p, (uint32_t)record.rain.intervalacc);
+		count++;
+	}
+	while (p < out + HISTORY_CHUNK_SIZE - 1) {
+		*p++ = 0;
+	}
+	uint32_t remaining = next - (_cursor + count);
+	p = putLong(out, _cursor);
+	*p++ = count;
+	putShort(p, (uint16_t)(remaining > 0xFFFF ? 0xFFFF : remaining));
+	out[HISTORY_CHUNK_SIZE - 1] = crc8(out, HISTORY_CHUNK_SIZE - 1);
+	_cursor += count;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include "PM2_hal.h"
+#include "PM2_snapshot.h"
+#include "PM2_Winddriver.h"
+#include "PM2_Raindriver.h"
+
+/*
+	On-board reading history: a RAM ring of timestamped samples of both sensors, one every reading interval,
+	so readings taken while the master was not listening (missed cycle, reboot, network down) can be fetched later.
+
+	Time is kept in seconds: Unix time once the master has sent SET_TIME, seconds since power up before that
+	(such records carry HISTORY_TIME_UNSET).
+
+	Every record has a sequence number (the first is 1). The master pages through the backlog with a cursor:
+		HISTORY_SEEK <uint32 seq>	move the cursor to seq (0 or anything older than the oldest record: the oldest)
+		HISTORY_READ				returns one chunk of HISTORY_CHUNK_SIZE bytes and moves the cursor past it
+	Chunk layout (little endian):
+		uint32	sequence of the first record in the chunk
+		uint8	records in the chunk (0..HISTORY_CHUNK_RECORDS; 0 = up to date)
+		uint16	records still waiting after this chunk (saturates at 65535)
+		HISTORY_CHUNK_RECORDS records of HISTORY_RECORD_SIZE bytes (unused ones are zero):
+			uint32	time (s)
+			uint8	flags: FRAME_STATUS_WIND_RUNNING / _RAIN_RUNNING / _WIND_NEW / _RAIN_NEW (see PM2_frame.h),
+					HISTORY_TIME_UNSET
+			int16	wind direction (deci-degrees)
+			int16	wind speed (centi-m/s)
+			int32	rain acc, eventacc, totalacc (uM), intensity (uM/hr)
+		uint8	CRC-8 of all the preceding bytes (see PM2_frame.h)
+	Records are always sent as scaled integers whatever the reading encoding. If a chunk is lost the master
+	just seeks back to the record after the last one it received; if the backlog outgrew the ring the first
+	sequence number of the next chunk is higher than the one asked for.
+
+	The records are written by the history task (main context) and read by the I2C interrupt handlers. A handler
+	can interrupt the task half way through a record, so each record's sequence number is cleared while it is
+	being written and the reader stops (or skips a record being overwritten) when the number does not match.
+*/
+
+#define HISTORY_RECORDS 512				// 512 records every 5 S = 42 minutes (32 bytes each: 16 kB of RAM)
+#define HISTORY_RECORD_SIZE 25			// bytes per record in a chunk
+#define HISTORY_CHUNK_RECORDS 9
+#define HISTORY_CHUNK_SIZE (4 + 1 + 2 + HISTORY_CHUNK_RECORDS*HISTORY_RECORD_SIZE + 1)	// 233 bytes: under the 256 byte Wire buffer
+#define HISTORY_TIME_UNSET 0x80			// record time is seconds since power up
+
+struct HistoryRecord {
+	uint32_t seq;			// 0 while the record is being written
+	uint32_t time;
+	uint8_t flags;
+	windreading wind;
+	RainReading rain;
+};
+
+// board clock: seconds at a millis() reference
+struct HistoryClock {
+	uint32_t seconds;
+	uint32_t millis;
+	bool set;				// seconds is Unix time
+};
+
+class History {
+	public:
+		History();
+		void add(uint8_t flags, const windreading &wind, const RainReading &rain);	// main context
+		uint32_t now();						// main context: board time in seconds (keeps the clock running)
+		uint32_t nowISR() const;			// board time from an interrupt handler
+		bool timeSet() const;
+		void setTime(uint32_t unixTime);	// I2C handler: applied by the next now()
+		void seek(uint32_t seq);			// I2C handler
+		void readChunk(uint8_t *out);		// I2C handler: HISTORY_CHUNK_SIZE bytes
+		uint32_t oldest() const;			// sequence number of the oldest record held
+		uint32_t next() const { return _next; }	// sequence number the next record will get
+
+	private:
+		HistoryRecord _records[HISTORY_RECORDS];
+		volatile uint32_t _next=1;
+		uint32_t _cursor=0;					// next record to send (I2C handlers only)
+		Snapshot<HistoryClock> _clock;
+		HistoryClock _time;					// main context copy of the clock
+		volatile bool _timePending=false;
+		volatile uint32_t _pendingTime=0;	// Unix time sent by the master
+		volatile uint32_t _pendingMillis=0;	// millis() when it was received
+};
@@ -0,0 +1,99 @@
+#include "PM2_log.h"
+#include "PM2_snapshot.h"
+
+EventLog eventLog;
+
+enum LogValue : uint8_t {
+	LOG_NO_VALUE,
+	LOG_NUMBER,
+	LOG_COMMAND					// a PM2commands value: printed by name
+};
+
+struct LogEventInfo {
+	const char *text;
+	LogValue value;
+};
+
+static const LogEventInfo LogEvents[LOG_EVENTS] = {		// kept in flash
+	{ "Received an I2C Event. Bytes requested:", LOG_NUMBER },
+	{ "Received an I2C Event command:", LOG_COMMAND },
+	{ "Ack sent for start wind", LOG_NO_VALUE },
+	{ "wind is not started: Nack sent", LOG_NO_VALUE },
+	{ "Ack sent for start rain", LOG_NO_VALUE },
+	{ "rain is not started: Nack sent", LOG_NO_VALUE },
+	{ "Wind  sensor was started", LOG_NO_VALUE },
+	{ "Wind  sensor did not respond; attempts:", LOG_NUMBER },
+	{ "Wind  sensor was asked to stop", LOG_NO_VALUE },
+	{ "Rain  sensor was started", LOG_NO_VALUE },
+	{ "Rain  sensor did not respond; attempts:", LOG_NUMBER },
+	{ "Rain gauge baud:", LOG_NUMBER },
+	{ "Rain gauge link failed, finding it again; was at baud", LOG_NUMBER },
+	{ "Rain checkpoint write failed; total uM", LOG_NUMBER },
+	{ "Config write failed", LOG_NO_VALUE },
+	{ "PM#2 Board is idling in the  Reading Loop", LOG_NO_VALUE }
+};
+
+static const char * const LogLevelNames[] = { "D", "I", "W" };
+
+void EventLog::log(uint8_t level, LogEvent event, int32_t value) {
+	LogRecord record = { halMillis(), value, event, level };
+	if (!halInInterrupt()) {
+		drain();				// anything queued by the handlers comes first
+		if (halLogReady()) {
+			print(record);
+		}
+		return;
+	}
+	uint8_t head = _head;
+	uint8_t next = (head + 1) & (LOG_RING - 1);
+	if (next == _tail) {
+		dropped++;
+		return;
+	}
+	_ring[head] = record;
+	SNAPSHOT_BARRIER();			// the record is complete before the main loop can see it
+	_head = next;
+}
+
+void EventLog::drain() {
+	bool ready = halLogReady();
+	while (_tail != _head) {
+		SNAPSHOT_BARRIER();
+		if (ready) {
+			print(_ring[_tail]);
+		}
+		_tail = (_tail + 1) & (LOG_RING - 1);
+	}
+	uint32_t lost = dropped;
+	if (lost != _droppedReported && ready) {
+		halLog.print(lost - _droppedReported);
+		halLog.println(" log records dropped");
+		_droppedReported = lost;
+	}
+}
+
+// "<mS> <level> <text>[ <value>]"
+void EventLog::print(const LogRecord &record) {
+	const LogEventInfo &info = LogEvents[record.event];
+	halLog.print(record.time);
+	halLog.print(" ");
+	halLog.print(LogLevelNames[record.level]);
+	halLog.print(" ");
+	halLog.print(info.text);
+	switch (info.value) {
+		case LOG_NUMBER: {
+			halLog.print(" ");
+			halLog.print((long)record.value);
+			break;
+		}
+		case LOG_COMMAND: {
+			halLog.print(" ");
+			halLog.print(commandName((uint8_t)record.value));
+			break;
+		}
+		default: {
+			break;
+		}
+	}
+	halLog.println();
+}
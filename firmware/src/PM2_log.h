@@ -0,0 +1,92 @@
+#pragma once
+
+#include "PM2_hal.h"
+
+/*
+	Deferred event log.
+
+	Printing on the USB serial port can block for milliseconds (longer with no host attached), which must not
+	happen inside an interrupt handler: receiveEvent / requestEvent hold the master's clock while they run.
+	A handler therefore only appends a compact record (time, event, value) to a ring in constant time, and the
+	main loop formats and prints the records later (drain()). Called from the main loop, log() drains the ring
+	and prints straight away, so the output stays in order.
+
+	The ring is single producer / single consumer without locks: every interrupt handler that logs runs at the
+	same priority (they cannot interrupt each other), and only the main loop reads. A record that does not fit
+	is dropped and counted. The event texts are kept in flash.
+
+	Levels below PM2_LOG_LEVEL (default LOG_LEVEL_INFO; -D PM2_LOG_LEVEL=0 for everything) are compiled out.
+*/
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_NONE 3
+
+#ifndef PM2_LOG_LEVEL
+#define PM2_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING 32				// records (power of 2)
+
+enum LogEvent : uint8_t {
+	LOG_I2C_RECEIVE,			// value: bytes written by the master
+	LOG_I2C_COMMAND,			// value: command (printed by name)
+	LOG_WIND_ACK,
+	LOG_WIND_NACK,
+	LOG_RAIN_ACK,
+	LOG_RAIN_NACK,
+	LOG_WIND_STARTED,
+	LOG_WIND_NO_RESPONSE,		// value: attempts failed in a row (see PM2_bringup.h)
+	LOG_WIND_STOPPED,
+	LOG_RAIN_STARTED,
+	LOG_RAIN_NO_RESPONSE,		// value: attempts failed in a row
+	LOG_RAIN_BAUD,				// value: baud rate negotiated
+	LOG_RAIN_LINK_FAILED,		// value: baud rate that failed
+	LOG_CHECKPOINT_FAILED,		// value: rain total (uM) that was not saved
+	LOG_CONFIG_SAVE_FAILED,
+	LOG_STATS,					// heads the statistics dump of statsTask
+	LOG_EVENTS
+};
+
+struct LogRecord {
+	uint32_t time;				// halMillis()
+	int32_t value;
+	LogEvent event;
+	uint8_t level;
+};
+
+class EventLog {
+	public:
+		void log(uint8_t level, LogEvent event, int32_t value);
+		void drain();				// main loop only: print (or discard without a host) the queued records
+		volatile uint32_t dropped=0;	// records lost because the ring was full
+	private:
+		void print(const LogRecord &record);
+		LogRecord _ring[LOG_RING];
+		volatile uint8_t _head=0;	// written by the handlers
+		volatile uint8_t _tail=0;	// written by the main loop
+		uint32_t _droppedReported=0;
+};
+
+extern EventLog eventLog;
+
+const char *commandName(uint8_t command);	// PM2_commands.cpp
+
+#if PM2_LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(event, value) eventLog.log(LOG_LEVEL_DEBUG, event, value)
+#else
+#define LOG_DEBUG(event, value)
+#endif
+
+#if PM2_LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(event, value) eventLog.log(LOG_LEVEL_INFO, event, value)
+#else
+#define LOG_INFO(event, value)
+#endif
+
+#if PM2_LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(event, value) eventLog.log(LOG_LEVEL_WARN, event, value)
+#else
+#define LOG_WARN(event, value)
+#endif
@@ -0,0 +1,166 @@
+#include "PM2_hal.h"
+
+HalPowerStats halPower;
+
+#if defined(ARDUINO) && defined(PM2_LOW_POWER)
+
+/*
+	Standby between tasks (see PM2_hal.h).
+	Clocks: the core sets up generator 2 from the 32 kHz ultra low power oscillator and generator 3 from OSC8M.
+	The RTC counts at 32768 Hz from generator 2, which is kept running in standby. The sensor UARTs and the
+	I2C slave are moved to generator 3 with OSC8M on demand and allowed to run in standby (without RUNSTDBY the
+	oscillator stops in standby whatever ONDEMAND says): a start bit or an address match starts the oscillator
+	for as long as the SERCOM needs it, without waking the 48 MHz clock.
+*/
+
+#define LP_GCLK_RTC 2
+#define LP_GCLK_SERCOM 3
+#define LP_RTC_HZ 32768
+#define LP_SERCOM_HZ 8000000
+#define LP_MIN_TICKS 4				// ~120 uS: shorter sleeps just idle (standby costs ~20 uS to wake from)
+
+volatile uint32_t halSleptMicros=0;
+volatile uint32_t halSleptMillis=0;
+volatile uint8_t halRxActive=0;
+static uint32_t sleptRemainder=0;		// uS not yet counted in halSleptMillis / standbyMillis
+
+struct UartWake {
+	IRQn_Type irq;
+	HalWakeSource source;
+};
+static UartWake uartWakes[2];
+static uint8_t numUartWakes=0;
+
+static void rtcSync() {
+	while (RTC->MODE0.STATUS.bit.SYNCBUSY) {}
+}
+
+static void gclkSync() {
+	while (GCLK->STATUS.bit.SYNCBUSY) {}
+}
+
+static uint8_t sercomIndex(Sercom *sercom) {
+	return ((uintptr_t)sercom - (uintptr_t)SERCOM0) / ((uintptr_t)SERCOM1 - (uintptr_t)SERCOM0);
+}
+
+// move a SERCOM's core clock onto the on demand 8 MHz generator (the SERCOM must be disabled)
+static void sercomClock(Sercom *sercom) {
+	GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex(sercom)) |
+		GCLK_CLKCTRL_GEN(LP_GCLK_SERCOM) | GCLK_CLKCTRL_CLKEN;
+	gclkSync();
+}
+
+void halLowPowerBegin() {
+	GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(LP_GCLK_RTC) | GCLK_GENCTRL_SRC_OSCULP32K | GCLK_GENCTRL_GENEN |
+		GCLK_GENCTRL_RUNSTDBY;
+	gclkSync();
+	GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_RTC | GCLK_CLKCTRL_GEN(LP_GCLK_RTC) | GCLK_CLKCTRL_CLKEN;
+	gclkSync();
+	PM->APBAMASK.reg |= PM_APBAMASK_RTC;
+
+	RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_SWRST;
+	rtcSync();
+	RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV1;
+	RTC->MODE0.READREQ.reg = RTC_READREQ_RCONT | RTC_READREQ_ADDR(0x10);	// keep COUNT synchronised for reading
+	RTC->MODE0.INTENSET.reg = RTC_MODE0_INTENSET_CMP0;
+	RTC->MODE0.CTRL.reg |= RTC_MODE0_CTRL_ENABLE;
+	rtcSync();
+	NVIC_EnableIRQ(RTC_IRQn);
+
+	SYSCTRL->OSC8M.bit.ONDEMAND = 1;
+	SYSCTRL->OSC8M.bit.RUNSTDBY = 1;
+}
+
+/*
+	The core's begin() clocks the SERCOM from the 48 MHz generator, which stops in standby: switch it to the
+	8 MHz one (recomputing the 16x arithmetic baud value) and enable start of frame detection.
+*/
+void halUartStandby(Sercom *sercom, uint32_t baud, HalWakeSource source) {
+	SercomUsart &usart = sercom->USART;
+	usart.CTRLA.bit.ENABLE = 0;
+	while (usart.SYNCBUSY.bit.ENABLE) {}
+	sercomClock(sercom);
+	usart.BAUD.reg = (uint16_t)(65536 - ((uint64_t)65536 * 16 * baud + LP_SERCOM_HZ / 2) / LP_SERCOM_HZ);
+	usart.CTRLA.bit.RUNSTDBY = 1;
+	usart.CTRLB.bit.SFDE = 1;
+	usart.INTENSET.reg = SERCOM_USART_INTENSET_RXS;
+	usart.CTRLA.bit.ENABLE = 1;
+	while (usart.SYNCBUSY.bit.ENABLE) {}
+
+	IRQn_Type irq = (IRQn_Type)(SERCOM0_IRQn + sercomIndex(sercom));
+	for (uint8_t i=0; i<numUartWakes; i++) {
+		if (uartWakes[i].irq == irq) {
+			return;				// restarted at a new baud rate
+		}
+	}
+	if (numUartWakes < 2) {
+		uartWakes[numUartWakes].irq=irq;
+		uartWakes[numUartWakes].source=source;
+		numUartWakes++;
+	}
+}
+
+void halI2CStandby(Sercom *sercom) {
+	SercomI2cs &i2c = sercom->I2CS;
+	i2c.CTRLA.bit.ENABLE = 0;
+	while (i2c.SYNCBUSY.bit.ENABLE) {}
+	sercomClock(sercom);
+	i2c.CTRLA.bit.RUNSTDBY = 1;
+	i2c.CTRLA.bit.ENABLE = 1;
+	while (i2c.SYNCBUSY.bit.ENABLE) {}
+}
+
+void RTC_Handler() {
+	RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_CMP0;
+}
+
+static HalWakeSource wakeSource(uint32_t now, uint32_t alarm) {
+	if (NVIC_GetPendingIRQ(SERCOM3_IRQn)) {
+		return WAKE_I2C;
+	}
+	for (uint8_t i=0; i<numUartWakes; i++) {
+		if (NVIC_GetPendingIRQ(uartWakes[i].irq)) {
+			return uartWakes[i].source;
+		}
+	}
+	if (NVIC_GetPendingIRQ(RTC_IRQn)) {
+		uint32_t latency = (uint32_t)((uint64_t)(now - alarm) * 1000000 / LP_RTC_HZ);
+		if (latency > halPower.wakeLatencyMax) {
+			halPower.wakeLatencyMax=latency;
+		}
+		return WAKE_RTC;
+	}
+	return WAKE_OTHER;
+}
+
+void halStandby(uint32_t us) {
+	uint32_t ticks = (uint32_t)((uint64_t)us * LP_RTC_HZ / 1000000);
+	if (ticks < LP_MIN_TICKS || halRxActive || USBDevice.configured()) {
+		__WFI();
+		__enable_irq();
+		return;
+	}
+	uint32_t start = RTC->MODE0.COUNT.reg;
+	uint32_t alarm = start + ticks;
+	RTC->MODE0.COMP[0].reg = alarm;
+	rtcSync();
+	NVIC_ClearPendingIRQ(RTC_IRQn);
+	RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_CMP0;
+
+	SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+	__DSB();
+	__WFI();
+	SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+	uint32_t now = RTC->MODE0.COUNT.reg;
+	halPower.wakes[wakeSource(now, alarm)]++;
+	uint32_t slept = (uint32_t)((uint64_t)(now - start) * 1000000 / LP_RTC_HZ);
+	halSleptMicros += slept;
+	sleptRemainder += slept;
+	halSleptMillis += sleptRemainder / 1000;
+	halPower.standbyMillis += sleptRemainder / 1000;
+	sleptRemainder %= 1000;
+	__enable_irq();			// the handler of whatever woke the board runs now
+}
+
+#endif
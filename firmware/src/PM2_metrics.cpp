@@ -0,0 +1,84 @@
+#include "PM2_metrics.h"
+#include "PM2_log.h"
+
+#ifdef PM2_METRICS
+
+Metrics metrics;
+
+static const char * const MetricTimerNames[METRIC_TIMERS] = {		// kept in flash
+	"i2c receive",
+	"i2c request",
+	"wind isr",
+	"rain isr",
+	"dma isr",
+	"wind parse",
+	"rain parse",
+	"wind round trip",
+	"rain round trip",
+	"loop",
+	"wind idle isr",
+	"rain idle isr"
+};
+
+// shift rather than divide or count leading zeros: the Cortex-M0+ has neither instruction
+void Metrics::record(MetricTimer timer, uint32_t cycles) {
+	MetricHistogram &h = timers[timer];
+	uint8_t bucket=0;
+	for (uint32_t c=cycles; c >= METRIC_FIRST_EDGE && bucket < METRIC_BUCKETS - 1; c >>= 2) {
+		bucket++;
+	}
+	h.buckets[bucket]++;
+	h.count++;
+	h.sum += cycles;
+	if (cycles > h.max) {
+		h.max = cycles;
+	}
+}
+
+void Metrics::recordCommand(MetricTimer timer, uint8_t command, uint32_t cycles) {
+	record(timer, cycles);
+	if (command >= METRIC_COMMANDS) {
+		return;			// no command byte, or an unknown one
+	}
+	uint32_t &worst = (timer == METRIC_I2C_REQUEST) ? commands[command].requestMax : commands[command].receiveMax;
+	if (cycles > worst) {
+		worst = cycles;
+	}
+}
+
+// one line per timer: count, mean and max in uS, then the bucket counts; then the worst time of each command seen
+void Metrics::print() {
+	for (uint8_t i=0; i<METRIC_TIMERS; i++) {
+		const MetricHistogram &h = timers[i];
+		if (h.count == 0) {
+			continue;
+		}
+		halLog.print(MetricTimerNames[i]);
+		halLog.print(": n ");
+		halLog.print(h.count);
+		halLog.print(" mean/max ");
+		halLog.print((uint32_t)(h.sum / h.count / HAL_CYCLES_PER_US));
+		halLog.print("/");
+		halLog.print(h.max / HAL_CYCLES_PER_US);
+		halLog.print(" uS  buckets");
+		for (uint8_t b=0; b<METRIC_BUCKETS; b++) {
+			halLog.print(" ");
+			halLog.print(h.buckets[b]);
+		}
+		halLog.println();
+	}
+	for (uint8_t i=0; i<METRIC_COMMANDS; i++) {
+		const MetricCommand &c = commands[i];
+		if (c.receiveMax == 0 && c.requestMax == 0) {
+			continue;
+		}
+		halLog.print(commandName(i));
+		halLog.print(": worst receive/request ");
+		halLog.print(c.receiveMax / HAL_CYCLES_PER_US);
+		halLog.print("/");
+		halLog.print(c.requestMax / HAL_CYCLES_PER_US);
+		halLog.println(" uS");
+	}
+}
+
+#endif
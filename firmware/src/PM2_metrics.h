@@ -0,0 +1,91 @@
+#pragma once
+
+#include "PM2_hal.h"
+
+/*
+	Timing instrumentation of the hot paths (build with -D PM2_METRICS).
+
+	Each timed section feeds a fixed bucket histogram of its duration in CPU cycles (halCycles(), from SysTick;
+	HAL_CYCLES_PER_US per uS). The buckets are powers of 4 from 64 cycles:
+		bucket 0: < 64 cycles (1.3 uS), bucket i: < 64 * 4^i cycles, bucket 9: >= 4M cycles (87 mS)
+	so a single histogram covers an interrupt handler (uS) as well as a sensor round trip (tens of mS).
+	The timers are cumulative since power up; the master reads them with GET_METRICS and works out the
+	differences, and statsTask prints them on the debug port.
+	Each timer is written from one context only (one interrupt handler or the main loop), so no locking is needed:
+	two handlers of the same UART have a timer each.
+	The I2C handlers also keep the worst time of each command (commands), since one slow command hides in the
+	histogram of all of them.
+
+	Without PM2_METRICS the METRIC_ macros compile to nothing and the tables are not built.
+*/
+
+#define METRIC_BUCKETS 10
+#define METRIC_FIRST_EDGE 64		// cycles: upper edge of bucket 0
+#define METRIC_COMMANDS 40			// command bytes timed one by one (see PM2commands in PM2_driver.h)
+#define METRIC_COMMAND_BLOCK 0x80	// GET_METRICS argument of command 0's worst times
+
+enum MetricTimer : uint8_t {
+	METRIC_I2C_RECEIVE,			// receiveEvent, entry to exit
+	METRIC_I2C_REQUEST,			// requestEvent: how long the master's clock is held
+	METRIC_WIND_ISR,			// SERCOM1_Handler: wind UART errors, transmit, start of frame
+	METRIC_RAIN_ISR,			// SERCOM4_Handler: the same for the rain UART
+	METRIC_DMA_ISR,				// DMAC_Handler (half of a receive ring filled)
+	METRIC_WIND_PARSE,			// CalypsoWind::serviceRx: decode and publish a burst
+	METRIC_RAIN_PARSE,			// RadeonRain::serviceRx
+	METRIC_WIND_ROUND_TRIP,		// poll sent to reading published
+	METRIC_RAIN_ROUND_TRIP,		// 'R' sent to reading published (polled mode)
+	METRIC_LOOP,				// loop(): the tasks run by one scheduler pass (not the sleep)
+	METRIC_WIND_IDLE_ISR,		// TC3_Handler: end of a wind burst, decoded there (includes METRIC_WIND_PARSE)
+	METRIC_RAIN_IDLE_ISR,		// TC4_Handler: end of a rain burst (includes METRIC_RAIN_PARSE)
+	METRIC_TIMERS
+};
+
+enum MetricCounter : uint8_t {
+	METRIC_I2C_RX_TIMEOUT,		// receiveEvent gave up waiting for the command byte
+	METRIC_I2C_NACK,			// requests answered with a Nack
+	METRIC_I2C_UNKNOWN,			// unknown command bytes
+	METRIC_COUNTERS
+};
+
+struct MetricHistogram {
+	uint32_t count;
+	uint32_t max;				// cycles
+	uint64_t sum;				// cycles (for the mean)
+	uint32_t buckets[METRIC_BUCKETS];
+};
+
+struct MetricCommand {
+	uint32_t receiveMax;		// cycles: worst receiveEvent
+	uint32_t requestMax;		// cycles: worst requestEvent (the master's clock is held)
+};
+
+#ifdef PM2_METRICS
+
+class Metrics {
+	public:
+		void record(MetricTimer timer, uint32_t cycles);
+		void recordCommand(MetricTimer timer, uint8_t command, uint32_t cycles);	// METRIC_I2C_RECEIVE or _REQUEST
+		void count(MetricCounter counter) { counters[counter]++; }
+		void print();				// text dump of the timers on halLog
+		MetricHistogram timers[METRIC_TIMERS];
+		uint32_t counters[METRIC_COUNTERS];
+		MetricCommand commands[METRIC_COMMANDS];
+};
+
+extern Metrics metrics;
+
+#define METRIC_START(start) uint32_t start = halCycles()
+#define METRIC_STOP(timer, start) metrics.record(timer, halCycles() - (start))
+#define METRIC_STOP_COMMAND(timer, command, start) metrics.recordCommand(timer, command, halCycles() - (start))
+#define METRIC_RECORD(timer, cycles) metrics.record(timer, cycles)
+#define METRIC_COUNT(counter) metrics.count(counter)
+
+#else
+
+#define METRIC_START(start)
+#define METRIC_STOP(timer, start)
+#define METRIC_STOP_COMMAND(timer, command, start)
+#define METRIC_RECORD(timer, cycles)
+#define METRIC_COUNT(counter)
+
+#endif
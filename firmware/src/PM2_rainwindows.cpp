@@ -0,0 +1,61 @@
+#include "PM2_rainwindows.h"
+
+const uint16_t RainWindows::bucketSeconds[RAIN_WINDOWS] = { 10, 60, 300 };
+const uint8_t RainWindows::buckets[RAIN_WINDOWS] = { 6, 10, 12 };
+
+RainWindows::RainWindows() {
+	for (uint8_t w=0; w<RAIN_WINDOWS; w++) {
+		for (uint8_t b=0; b<RAIN_WINDOW_BUCKETS; b++) {
+			_sum[w][b]=0;
+		}
+		_total[w]=0;
+		_bucket[w]=0;
+	}
+	RainWindowResult none = {};
+	results.publish(none);
+}
+
+// move the window on to bucket, dropping the buckets that fall out of it (at most the whole ring)
+void RainWindows::advance(uint8_t w, uint32_t bucket) {
+	uint32_t steps = bucket - _bucket[w];
+	if (steps >= buckets[w]) {
+		for (uint8_t b=0; b<buckets[w]; b++) {
+			_sum[w][b]=0;
+		}
+		_total[w]=0;
+	} else {
+		for (uint32_t i=0; i<steps; i++) {
+			uint8_t slot = (_bucket[w] + 1 + i) % buckets[w];
+			_total[w] -= _sum[w][slot];
+			_sum[w][slot]=0;
+		}
+	}
+	_bucket[w]=bucket;
+}
+
+void RainWindows::add(uint32_t timeMs, int32_t acc) {
+	if (_started) {
+		uint32_t elapsed = timeMs - _lastMs + _ms;
+		_seconds += elapsed / 1000;
+		_ms = elapsed % 1000;
+	}
+	_started=true;
+	_lastMs=timeMs;
+
+	RainWindowResult result;
+	for (uint8_t w=0; w<RAIN_WINDOWS; w++) {
+		advance(w, _seconds / bucketSeconds[w]);
+		_sum[w][_bucket[w] % buckets[w]] += acc;
+		_total[w] += acc;
+		int32_t wettest=0;
+		for (uint8_t b=0; b<buckets[w]; b++) {
+			if (_sum[w][b] > wettest) {
+				wettest=_sum[w][b];
+			}
+		}
+		result.total[w]=_total[w];
+		result.peak[w]=(int32_t)((int64_t)wettest * 3600 / bucketSeconds[w]);
+	}
+	result.seconds=_seconds;
+	results.publish(result);
+}
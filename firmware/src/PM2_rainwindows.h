@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include "PM2_snapshot.h"
+
+/*
+	Rolling rain totals over the last 1, 10 and 60 minutes, worked out on the board from the gauge's Acc
+	increments (the rain since its previous reading), so the master gets proper rolling figures however seldom
+	it reads them.
+
+	Each window is a ring of buckets with a running sum: a reading is added to the current bucket, and as time
+	moves on the oldest buckets are subtracted and cleared. An update costs at most one pass over a window's
+	buckets, whatever the rate of the readings; memory is fixed.
+		window		buckets
+		1 minute	6 x 10 s
+		10 minutes	10 x 1 minute
+		60 minutes	12 x 5 minutes
+	A window holds the current (partly elapsed) bucket and the buckets before it, so it slides a bucket at a
+	time. The peak intensity of a window is the rate of its wettest bucket (uM/hr): the highest 10 s rate of the
+	last minute, 1 minute rate of the last 10 minutes and 5 minute rate of the last hour.
+	Time is counted from the first reading by differences of millis(), so the 49 day wrap does not matter.
+	The rain task adds every reading (or continuous mode window) and publishes the results for GET_RAIN_1MIN,
+	GET_RAIN_10MIN and GET_RAIN_60MIN; they are as of the latest reading, at most one sampling interval old.
+*/
+
+#define RAIN_WINDOWS 3
+#define RAIN_WINDOW_BUCKETS 12		// most buckets in one window
+
+struct RainWindowResult {
+	int32_t total[RAIN_WINDOWS];	// uM in the window
+	int32_t peak[RAIN_WINDOWS];		// uM/hr: rate of the wettest bucket
+	uint32_t seconds;				// time of the latest reading, seconds from the first
+};
+
+class RainWindows {
+	public:
+		RainWindows();
+		void add(uint32_t timeMs, int32_t acc);		// rain task, after each reading: acc (uM) fell since the previous one
+		Snapshot<RainWindowResult> results;		// as read by the I2C handler
+
+		static const uint16_t bucketSeconds[RAIN_WINDOWS];
+		static const uint8_t buckets[RAIN_WINDOWS];
+	private:
+		void advance(uint8_t window, uint32_t bucket);
+		int32_t _sum[RAIN_WINDOWS][RAIN_WINDOW_BUCKETS];	// uM per bucket
+		int32_t _total[RAIN_WINDOWS];
+		uint32_t _bucket[RAIN_WINDOWS];		// number of the current bucket (seconds / bucketSeconds)
+		bool _started=false;
+		uint32_t _lastMs=0;			// millis() of the previous reading
+		uint32_t _seconds=0;		// since the first reading
+		uint16_t _ms=0;				// part of a second left over
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Sample instants shared by the sensor tasks.
+	Both sensors are polled on one grid, epoch + k * interval, instead of each timing its next poll from its own
+	previous one: the wind and rain tasks then send their polls in the same scheduler pass (a few tens of uS
+	apart) and the replies are collected as they arrive on their own SERCOMs, so the two readings of a set are
+	taken together and do not drift apart however late either task is dispatched.
+	The epoch is moved up to the latest past instant as the tasks run, so the grid survives micros() wrapping.
+*/
+class SampleClock {
+	public:
+		void start(uint32_t now) { _epoch = now; }
+
+		// first sample instant after now; tasks with different intervals still meet at common multiples
+		uint32_t next(uint32_t now, uint32_t interval) {
+			uint32_t slot = now + interval - (now - _epoch) % interval;
+			_epoch = slot - interval;		// never after now, so (now - _epoch) stays small
+			return slot;
+		}
+
+		// uS from now until slot; 0 if it is due, or so far off that it is stale (the task was not run for a while)
+		static uint32_t wait(uint32_t slot, uint32_t now, uint32_t interval) {
+			uint32_t remaining = slot - now;
+			return (remaining <= interval) ? remaining : 0;
+		}
+	private:
+		uint32_t _epoch=0;
+};
@@ -0,0 +1,106 @@
+#include "PM2_scheduler.h"
+
+Scheduler::Scheduler() {
+}
+
+int8_t Scheduler::add(const char *name, TaskFunction run, uint32_t firstDelay) {
+	if (numTasks >= SCHED_MAX_TASKS) {
+		return -1;
+	}
+	SchedulerTask &task = tasks[numTasks];
+	task.name=name;
+	task.run=run;
+	task.deadline=halMicros() + firstDelay;
+	task.woken=false;
+	task.runs=0;
+	task.lateLast=0;
+	task.lateMax=0;
+	task.lateSum=0;
+	task.lateCount=0;
+	return numTasks++;
+}
+
+void Scheduler::wake(int8_t id) {
+	if (id >= 0 && id < numTasks) {
+		tasks[id].woken=true;
+	}
+}
+
+// deadlines are compared as a signed difference so that the micros() wrap (~71 minutes) is harmless
+bool Scheduler::due(const SchedulerTask &task, uint32_t now) {
+	return task.woken || (int32_t)(now - task.deadline) >= 0;
+}
+
+void Scheduler::runDue() {
+	for (uint8_t i=0; i<numTasks; i++) {
+		SchedulerTask &task = tasks[i];
+		uint32_t now=halMicros();
+		if (!due(task, now)) {
+			continue;
+		}
+		if (task.woken) {
+			task.woken=false;		// woken early by an event: not a timing sample
+		} else {
+			uint32_t late = now - task.deadline;
+			task.lateLast=late;
+			if (late > task.lateMax) task.lateMax=late;
+			task.lateSum += late;
+			task.lateCount++;
+		}
+		task.deadline = now + task.run(now);
+		task.runs++;
+	}
+}
+
+/*
+	Nothing to do: sleep until the next interrupt (a UART byte, the I2C slave, SysTick or in standby the RTC
+	alarm for the next deadline). Interrupts are off from the check to the sleep, so a wake() that lands in
+	between still ends the sleep at once rather than being slept through.
+*/
+void Scheduler::idle() {
+	halInterruptsOff();
+	uint32_t now=halMicros();
+	uint32_t sleep=SCHED_MAX_SLEEP;
+	for (uint8_t i=0; i<numTasks; i++) {
+		if (due(tasks[i], now)) {
+			halInterruptsOn();
+			return;
+		}
+		uint32_t left = tasks[i].deadline - now;
+		if (left < sleep) sleep=left;
+	}
+	halStandby(sleep);
+	idleTime += halMicros() - now;
+}
+
+void Scheduler::resetStats() {
+	for (uint8_t i=0; i<numTasks; i++) {
+		tasks[i].runs=0;
+		tasks[i].lateLast=0;
+		tasks[i].lateMax=0;
+		tasks[i].lateSum=0;
+		tasks[i].lateCount=0;
+	}
+	idleTime=0;
+	statsStart=halMicros();
+}
+
+void Scheduler::printStats() {
+	uint32_t elapsed = halMicros() - statsStart;
+	halLog.print("Scheduler idle: ");
+	halLog.print(elapsed ? (uint32_t)((uint64_t)idleTime * 100 / elapsed) : 0);
+	halLog.println(" %");
+	for (uint8_t i=0; i<numTasks; i++) {
+		const SchedulerTask &task = tasks[i];
+		halLog.print(task.name);
+		halLog.print(": runs ");
+		halLog.print(task.runs);
+		halLog.print(" jitter last/avg/max ");
+		halLog.print(task.lateLast);
+		halLog.print("/");
+		halLog.print(task.lateCount ? task.lateSum / task.lateCount : 0);
+		halLog.print("/");
+		halLog.print(task.lateMax);
+		halLog.println(" uS");
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "PM2_hal.h"
+
+/*
+	Cooperative, tick-less task scheduler.
+
+	Each task is a function that is called when its deadline is reached and returns the number of
+	microseconds until it wants to run again; a task is therefore a resumable state machine that never
+	waits inside its function. An interrupt handler can bring a task forward with wake() (eg when a
+	sensor reply has been received), so a task waiting for bytes is resumed as soon as they arrive.
+	When nothing is due the CPU is halted until the next interrupt (in standby with PM2_LOW_POWER, see PM2_hal.h).
+
+	The scheduler records how late each timed task was dispatched (jitter) and how much of the time the
+	CPU was idle.
+*/
+
+#define SCHED_MAX_TASKS 8
+#define SCHED_MAX_SLEEP 60000000	// uS: longest sleep with no task due
+
+typedef uint32_t (*TaskFunction)(uint32_t now);		// returns uS until the task should run again
+
+struct SchedulerTask {
+	const char *name;
+	TaskFunction run;
+	uint32_t deadline;			// micros() when the task is due
+	volatile bool woken;		// set by wake(): run at the next opportunity
+	uint32_t runs;
+	uint32_t lateLast;			// uS the last timed dispatch was behind its deadline
+	uint32_t lateMax;
+	uint32_t lateSum;			// for the average
+	uint32_t lateCount;
+};
+
+class Scheduler {
+	public:
+		Scheduler();
+		int8_t add(const char *name, TaskFunction run, uint32_t firstDelay);	// returns the task id (-1 if full)
+		void wake(int8_t id);			// safe to call from an interrupt handler
+		void runDue();					// dispatch every task that is due
+		void idle();					// halt until the next interrupt if nothing is due
+		void resetStats();
+		void printStats();				// debug dump on halLog
+
+		uint8_t numTasks=0;
+		SchedulerTask tasks[SCHED_MAX_TASKS];
+		uint32_t idleTime=0;			// uS spent halted since resetStats()
+		uint32_t statsStart=0;			// micros() at resetStats()
+	private:
+		bool due(const SchedulerTask &task, uint32_t now);
+};
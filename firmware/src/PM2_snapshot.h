@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Tear-free publication of a reading set between the sampling side and the I2C interrupt handlers.
+
+	Two copies of the value are kept. The writer fills the copy that is not currently published and then
+	switches the index, so a reader always finds the last complete set of values without waiting.
+	Each copy carries a sequence number that is odd while it is being written; a reader that was interrupted
+	by a writer (only possible when the reader is not itself an interrupt handler) sees the sequence change
+	and copies again. These retries are counted in retries so a stress test can confirm reads are never torn.
+
+	There must be only one writer at a time (the sensor's receive interrupt or the main loop, not both).
+*/
+
+#define SNAPSHOT_BARRIER() __asm__ volatile("" ::: "memory")
+
+template <typename T>
+class Snapshot {
+	public:
+		Snapshot() {
+			_current=0;
+			_seq[0]=0;
+			_seq[1]=0;
+			_number[0]=0;
+			_number[1]=0;
+			published=0;
+			retries=0;
+		}
+
+		void publish(const T &value) {
+			uint8_t next = _current ^ 1;
+			_seq[next]++;				// odd: being written
+			SNAPSHOT_BARRIER();
+			_slot[next]=value;
+			_number[next]=published + 1;
+			SNAPSHOT_BARRIER();
+			_seq[next]++;				// even: complete
+			_current=next;
+			published++;
+		}
+
+		// copy the latest complete value into out; returns the publish count it corresponds to
+		uint32_t read(T &out) const {
+			for (;;) {
+				uint8_t idx = _current;
+				uint32_t before = _seq[idx];
+				SNAPSHOT_BARRIER();
+				if ((before & 1) == 0) {
+					out = _slot[idx];
+					uint32_t number = _number[idx];
+					SNAPSHOT_BARRIER();
+					if (_seq[idx] == before) {
+						return number;
+					}
+				}
+				retries++;
+			}
+		}
+
+		volatile uint32_t published;		// number of values published (consistency counter)
+		mutable volatile uint32_t retries;	// reads that had to be repeated because a publish overlapped them
+	private:
+		volatile uint8_t _current;
+		volatile uint32_t _seq[2];
+		uint32_t _number[2];			// publish count of each copy
+		T _slot[2];
+};
@@ -0,0 +1,305 @@
+#include "PM2_driver.h"
+#include "PM2_metrics.h"
+#include "PM2_log.h"
+
+Scheduler scheduler;
+int8_t windTaskId=-1;
+int8_t rainTaskId=-1;
+int8_t frameTaskId=-1;
+int8_t historyTaskId=-1;
+int8_t configTaskId=-1;
+Snapshot<PM2Frame> frame;		// GET_ALL response, rebuilt whenever a sensor publishes
+Alert alert;					// data ready line to the master
+History history;				// timestamped readings for HISTORY_READ
+FlashLog flashLog;				// rain totals kept across resets
+Config config;					// runtime configuration (SET_CONFIG), kept in flash by SAVE_CONFIG
+SampleClock sampleClock;		// sample instants shared by the wind and rain tasks
+uint32_t frameSequence=0;
+uint32_t readingRefreshInterval=5*1000000; // (microseconds) (5 seconds): How often the frame and history are refreshed (the sensors adapt their own rate: PM2_adaptive.h)
+const uint32_t statsReportInterval=60*1000000;	// (microseconds) how often the scheduler statistics are printed
+bool windRunning=false;
+bool rainRunning=false;
+
+/*
+	Scheduler tasks.
+	Each sensor task is a state machine (see CalypsoWind::run / RadeonRain::run): it sends the poll and
+	returns immediately; the SERCOM interrupt handler decodes the reply as it arrives and wakes the task
+	to finish the reading. In between the CPU is halted by scheduler.idle().
+*/
+uint32_t windTask(uint32_t now) {
+	if (!windRunning) {
+		return readingRefreshInterval;
+	}
+	halLed(LED_BLUE);
+	return wind.run(now); // send /receive 35 bytes at 38400 bps
+}
+
+uint32_t rainTask(uint32_t now) {
+	if (!rainRunning) {
+		return readingRefreshInterval;
+	}
+	halLed(LED_GREEN);
+	return rain.run(now); // 71 bytes @ 9600 bps
+}
+
+void windReady() {
+	scheduler.wake(windTaskId);
+	scheduler.wake(frameTaskId);
+}
+
+void rainReady() {
+	scheduler.wake(rainTaskId);
+	scheduler.wake(frameTaskId);
+}
+
+/*
+	Rebuild the GET_ALL frame (see PM2_frame.h) outside the interrupt handlers.
+	Woken whenever a sensor publishes; also run every readingRefreshInterval so the status bits stay current.
+	Then tells the master through the alert line, if it asked for it (PM2_alert.h).
+*/
+uint32_t frameTask(uint32_t /* now */) {
+	static uint32_t windPublished=0;
+	static uint32_t rainPublished=0;
+	static uint32_t windTimeouts=0;
+	static uint32_t rainTimeouts=0;
+	windreading windSet;
+	RainReading rainSet;
+	uint32_t windCount=wind.snapshot.read(windSet);
+	uint32_t rainCount=rain.snapshot.read(rainSet);
+	uint8_t status=0;
+
+	if (windRunning && wind.started) status |= FRAME_STATUS_WIND_RUNNING;
+	if (rainRunning && rain.checkStarted()) status |= FRAME_STATUS_RAIN_RUNNING;
+	if (windCount != windPublished) status |= FRAME_STATUS_WIND_NEW;
+	if (rainCount != rainPublished) status |= FRAME_STATUS_RAIN_NEW;
+	if (wind.pollTimeouts != windTimeouts) status |= FRAME_STATUS_WIND_TIMEOUT;
+	if (rain.pollTimeouts != rainTimeouts) status |= FRAME_STATUS_RAIN_TIMEOUT;
+	windPublished=windCount;
+	rainPublished=rainCount;
+	windTimeouts=wind.pollTimeouts;
+	rainTimeouts=rain.pollTimeouts;
+
+	PM2Frame next;
+	buildFrame(next, ++frameSequence, status, windSet, rainSet);
+	frame.publish(next);
+	alert.update(status, windSet, rainSet);		// after the publish: the master reads as soon as the line drops
+	return readingRefreshInterval;
+}
+
+/*
+	Add the latest readings of both sensors to the history every readingRefreshInterval
+*/
+uint32_t historyTask(uint32_t now) {
+	static uint32_t windPublished=0;
+	static uint32_t rainPublished=0;
+	static uint32_t lastRecord=0;
+	static bool recorded=false;
+	if (recorded && now - lastRecord < readingRefreshInterval) {
+		return readingRefreshInterval - (now - lastRecord);	// woken by a new refresh interval
+	}
+	recorded=true;
+	lastRecord=now;
+	windreading windSet;
+	RainReading rainSet;
+	uint32_t windCount=wind.snapshot.read(windSet);
+	uint32_t rainCount=rain.snapshot.read(rainSet);
+	uint8_t flags=0;
+
+	if (windRunning && wind.started) flags |= FRAME_STATUS_WIND_RUNNING;
+	if (rainRunning && rain.checkStarted()) flags |= FRAME_STATUS_RAIN_RUNNING;
+	if (windCount != windPublished) flags |= FRAME_STATUS_WIND_NEW;
+	if (rainCount != rainPublished) flags |= FRAME_STATUS_RAIN_NEW;
+	windPublished=windCount;
+	rainPublished=rainCount;
+	history.add(flags, windSet, rainSet);
+	return readingRefreshInterval;
+}
+
+/*
+	Checkpoint the rain totals to flash when they have changed (at most once every FLASHLOG_INTERVAL).
+	The CPU stalls for a few mS while the flash is written, long enough to drop UART bytes, so the write
+	waits until neither sensor has a reply on the wire.
+*/
+uint32_t checkpointTask(uint32_t /* now */) {
+	RainReading rainSet;
+	rain.snapshot.read(rainSet);
+	const FlashCheckpoint &last = flashLog.last();
+	if (rainSet.totalacc == last.totalacc && rainSet.eventacc == last.eventacc) {
+		return FLASHLOG_INTERVAL;
+	}
+	if (wind.awaitingReply || rain.awaitingReply) {
+		return FLASHLOG_DEFER;
+	}
+	if (!flashLog.save(rainSet.totalacc, rainSet.eventacc)) {
+		LOG_WARN(LOG_CHECKPOINT_FAILED, rainSet.totalacc);
+	}
+	return FLASHLOG_INTERVAL;
+}
+
+/*
+	The configuration in force, as registers (PM2_config.h)
+*/
+static void sensorRegisters(uint16_t *r, AdaptiveRate &rate, uint32_t responseTimeout, uint8_t retries) {
+	SamplingLimits limits;
+	rate.limits.read(limits);
+	r[0] = (uint16_t)(limits.minInterval / SAMPLING_UNIT);
+	r[1] = (uint16_t)(limits.maxInterval / SAMPLING_UNIT);
+	r[2] = limits.hysteresis;
+	r[3] = (uint16_t)responseTimeout;
+	r[4] = retries;
+}
+
+static ConfigBlock configInForce() {
+	ConfigBlock block;
+	block.reg[CONFIG_REFRESH] = (uint16_t)(readingRefreshInterval / SAMPLING_UNIT);
+	sensorRegisters(block.reg + CONFIG_WIND_MIN, wind.rate, wind.responseTimeout, wind.retries);
+	block.reg[CONFIG_WIND_GUST] = (uint16_t)wind.stats.gustWindow;
+	sensorRegisters(block.reg + CONFIG_RAIN_MIN, rain.rate, rain.responseTimeout, rain.retries);
+	return block;
+}
+
+/*
+	Hand a (valid) block to the tasks. Only changed sampling limits are requested, so the adaptive rate of a
+	sensor is not restarted by a write that left it alone.
+*/
+static void applySensor(const uint16_t *r, AdaptiveRate &rate, uint32_t &responseTimeout, uint8_t &retries) {
+	SamplingLimits limits = { r[0] * (uint32_t)SAMPLING_UNIT, r[1] * (uint32_t)SAMPLING_UNIT, (uint8_t)r[2] };
+	SamplingLimits current;
+	rate.limits.read(current);
+	if (limits.minInterval != current.minInterval || limits.maxInterval != current.maxInterval
+			|| limits.hysteresis != current.hysteresis) {
+		rate.request(limits);
+	}
+	responseTimeout = r[3];
+	retries = (uint8_t)r[4];
+}
+
+static void applyConfig(const ConfigBlock &block) {
+	readingRefreshInterval = block.reg[CONFIG_REFRESH] * (uint32_t)SAMPLING_UNIT;
+	applySensor(block.reg + CONFIG_WIND_MIN, wind.rate, wind.responseTimeout, wind.retries);
+	wind.stats.gustWindow = block.reg[CONFIG_WIND_GUST];
+	applySensor(block.reg + CONFIG_RAIN_MIN, rain.rate, rain.responseTimeout, rain.retries);
+}
+
+/*
+	Apply the block written by SET_CONFIG and save it for SAVE_CONFIG; woken by the I2C handler.
+	The tasks that schedule themselves from the configuration are woken to take it up at once (a sensor task
+	woken between its sample instants only reschedules, see retime). Like a checkpoint, the flash write waits
+	until neither sensor has a reply on the wire.
+*/
+uint32_t configTask(uint32_t /* now */) {
+	static uint32_t applied=0;
+	ConfigBlock block;
+	uint32_t number = config.block.read(block);
+	if (number != applied) {
+		applied=number;
+		applyConfig(block);
+		scheduler.wake(windTaskId);
+		scheduler.wake(rainTaskId);
+		scheduler.wake(frameTaskId);
+		scheduler.wake(historyTaskId);
+	}
+	if (config.savePending) {
+		if (wind.awaitingReply || rain.awaitingReply) {
+			return FLASHLOG_DEFER;
+		}
+		config.savePending=false;
+		if (config.save(block)) {
+			config.savedNumber=number;
+		} else {
+			LOG_WARN(LOG_CONFIG_SAVE_FAILED, 0);
+		}
+	}
+	return SCHED_MAX_SLEEP;
+}
+
+/*
+	Error counters for GET_METRICS and the debug dump, in this order: wind and rain poll timeouts, wind sentences
+	and rain lines the parsers rejected, I2C commands whose byte did not arrive, Nacks sent, unknown commands.
+	The I2C counts are only kept with PM2_METRICS (0 otherwise).
+*/
+uint8_t metricCounters(uint32_t *values) {
+	const MWVParserStats &w = wind.parserStats();
+	const RG15ParserStats &r = rain.parserStats();
+	values[0] = wind.pollTimeouts;
+	values[1] = rain.pollTimeouts;
+	values[2] = w.checksumErrors + w.formatErrors + w.truncated + w.overruns;
+	values[3] = r.rejected + r.overruns;
+#ifdef PM2_METRICS
+	values[4] = metrics.counters[METRIC_I2C_RX_TIMEOUT];
+	values[5] = metrics.counters[METRIC_I2C_NACK];
+	values[6] = metrics.counters[METRIC_I2C_UNKNOWN];
+#else
+	values[4] = values[5] = values[6] = 0;
+#endif
+	return METRIC_REPORT_COUNTERS;
+}
+
+/*
+	The statistics dump takes several lines per record, so it is printed here rather than queued, but only with a
+	terminal attached (printing could block otherwise) and after what the handlers logged (LOG_STATS drains it).
+	The master reads the same figures with GET_METRICS either way.
+*/
+uint32_t statsTask(uint32_t /* now */) {
+	LOG_INFO(LOG_STATS, 0);
+	if (halLogReady()) {
+		scheduler.printStats();
+#ifdef PM2_METRICS
+		uint32_t counters[METRIC_REPORT_COUNTERS];
+		metricCounters(counters);
+		halLog.print("timeouts wind/rain ");
+		halLog.print(counters[0]);
+		halLog.print("/");
+		halLog.print(counters[1]);
+		halLog.print("  parse failures wind/rain ");
+		halLog.print(counters[2]);
+		halLog.print("/");
+		halLog.print(counters[3]);
+		halLog.print("  i2c timeouts/nacks/unknown ");
+		halLog.print(counters[4]);
+		halLog.print("/");
+		halLog.print(counters[5]);
+		halLog.print("/");
+		halLog.println(counters[6]);
+		metrics.print();
+#endif
+	}
+	scheduler.resetStats();
+	return statsReportInterval;
+}
+
+/*
+	Register the scheduler tasks; called from setup() once the sensors have been started.
+	Each sensor is read by its own task; the reply handlers wake the task when a reading arrives. Both tasks
+	poll on the same sample instants, so the two polls go out together and the replies overlap.
+	The rain totals and the configuration saved before the last reset are restored first.
+*/
+void startTasks() {
+	if (flashLog.begin()) {
+		rain.restoreTotals(flashLog.last().totalacc, flashLog.last().eventacc);
+	}
+	ConfigBlock saved;
+	bool loaded = config.begin(saved);
+	if (loaded) {
+		applyConfig(saved);
+	}
+	halInterruptsOff();			// the I2C slave is already up: SET_CONFIG publishes too
+	config.block.publish(configInForce());
+	if (loaded) {
+		config.savedNumber=config.block.published;
+	}
+	halInterruptsOn();
+	sampleClock.start(halMicros());
+	wind.useClock(&sampleClock);
+	rain.useClock(&sampleClock);
+	windTaskId=scheduler.add("wind", windTask, 0);
+	rainTaskId=scheduler.add("rain", rainTask, 0);
+	frameTaskId=scheduler.add("frame", frameTask, 0);
+	historyTaskId=scheduler.add("history", historyTask, readingRefreshInterval);
+	scheduler.add("checkpoint", checkpointTask, FLASHLOG_INTERVAL);
+	scheduler.add("stats", statsTask, statsReportInterval);
+	configTaskId=scheduler.add("config", configTask, SCHED_MAX_SLEEP);
+	wind.onReading(windReady);
+	rain.onReading(rainReady);
+	scheduler.resetStats();
+}
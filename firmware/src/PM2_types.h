@@ -1,11 +1,11 @@
 
-#include <Arduino.h>
+#include <stdint.h>
 
 #ifndef _PM2_TYPES
 #define _PM2_TYPES
 typedef union{
   float f;
-  byte b[4];
+  uint8_t b[4];
 } floatbyte; 
 #else
 extern floatbyte fbyte; 
@@ -0,0 +1,202 @@
+#ifdef ARDUINO
+
+#include "PM2_hal.h"
+
+#define UART_DMA_CHANNELS 2			// wind and rain
+#define UART_DMA_HALF (UART_DMA_RING / 2)
+
+// descriptor memory of the DMA controller: first descriptor of each channel, write-back, and the second half
+__attribute__((aligned(16))) static DmacDescriptor dmaBase[UART_DMA_CHANNELS];
+__attribute__((aligned(16))) static DmacDescriptor dmaWriteback[UART_DMA_CHANNELS];
+__attribute__((aligned(16))) static DmacDescriptor dmaSecond[UART_DMA_CHANNELS];
+static bool dmaStarted=false;
+
+static void dmaBegin() {
+	if (dmaStarted) {
+		return;
+	}
+	PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+	PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+	PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+	DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+	while (DMAC->CTRL.bit.SWRST) {}
+	DMAC->BASEADDR.reg = (uintptr_t)dmaBase;
+	DMAC->WRBADDR.reg = (uintptr_t)dmaWriteback;
+	DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+	NVIC_SetPriority(DMAC_IRQn, SERCOM_NVIC_PRIORITY);		// same as the SERCOM handlers: they never nest
+	NVIC_EnableIRQ(DMAC_IRQn);
+	dmaStarted=true;
+}
+
+static uint8_t sercomIndex(Sercom *sercom) {
+	return ((uintptr_t)sercom - (uintptr_t)SERCOM0) / ((uintptr_t)SERCOM1 - (uintptr_t)SERCOM0);
+}
+
+static uint8_t timerIndex(Tc *tc) {
+	return ((uintptr_t)tc - (uintptr_t)TC3) / ((uintptr_t)TC4 - (uintptr_t)TC3);
+}
+
+DmaUart::DmaUart(SERCOM *sercom, uint8_t rxPin, uint8_t txPin, SercomRXPad rxPad, SercomUartTXPad txPad,
+		Sercom *regs, uint8_t dmaChannel, Tc *idleTimer) : Uart(sercom, rxPin, txPin, rxPad, txPad) {
+	_regs=regs;
+	_channel=dmaChannel;
+	_timer=idleTimer;
+	memset(&rxStats, 0, sizeof(rxStats));
+}
+
+/*
+	Start the UART through the core, then take the receive side over: the receive complete interrupt is
+	replaced by the DMA trigger, and the channel and the idle timer are (re)started for the new rate.
+*/
+void DmaUart::begin(unsigned long baud) {
+	Uart::begin(baud);
+	noInterrupts();
+	SercomUsart &usart = _regs->USART;
+	usart.INTENCLR.reg = SERCOM_USART_INTENCLR_RXC;
+	usart.INTENSET.reg = SERCOM_USART_INTENSET_ERROR;
+	dmaBegin();
+
+	DMAC->CHID.reg = DMAC_CHID_ID(_channel);
+	DMAC->CHCTRLA.reg = 0;
+	DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+	while (DMAC->CHCTRLA.bit.SWRST) {}
+	DMAC->CHCTRLB.reg = DMAC_CHCTRLB_TRIGSRC(SERCOM0_DMAC_ID_RX + 2 * sercomIndex(_regs)) |
+		DMAC_CHCTRLB_TRIGACT_BEAT | DMAC_CHCTRLB_EVOE;
+	DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+	for (uint8_t half=0; half<2; half++) {
+		DmacDescriptor &d = half ? dmaSecond[_channel] : dmaBase[_channel];
+		d.BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_DSTINC |
+			DMAC_BTCTRL_EVOSEL_BEAT | DMAC_BTCTRL_BLOCKACT_INT;
+		d.BTCNT.reg = UART_DMA_HALF;
+		d.SRCADDR.reg = (uintptr_t)&usart.DATA.reg;
+		d.DSTADDR.reg = (uintptr_t)(_ring + (half + 1) * UART_DMA_HALF);	// end address with an incrementing destination
+		d.DESCADDR.reg = (uintptr_t)(half ? &dmaBase[_channel] : &dmaSecond[_channel]);
+	}
+	memset(&dmaWriteback[_channel], 0, sizeof(DmacDescriptor));
+	_tail=0;
+	_received=0;
+	_taken=0;
+	DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+
+	// idle timer: a one shot timer retriggered by every DMA beat, overflowing after the idle time
+	uint8_t timer = timerIndex(_timer);
+	PM->APBCMASK.reg |= PM_APBCMASK_TC3 << timer;
+	GCLK->CLKCTRL.reg = (timer == 0 ? GCLK_CLKCTRL_ID_TCC2_TC3 : GCLK_CLKCTRL_ID_TC4_TC5) | GCLK_CLKCTRL_GEN_GCLK0 |
+		GCLK_CLKCTRL_CLKEN;
+	while (GCLK->STATUS.bit.SYNCBUSY) {}
+	TcCount16 &tc = _timer->COUNT16;
+	tc.CTRLA.reg = TC_CTRLA_SWRST;
+	while (tc.CTRLA.bit.SWRST) {}
+	tc.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV16;
+	uint32_t ticks = (uint64_t)UART_DMA_IDLE_BYTES * 10 * UART_DMA_TIMER_HZ / baud;
+	tc.CC[0].reg = (uint16_t)(ticks > 0xFFFF ? 0xFFFF : ticks);
+	tc.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_RETRIGGER;
+	tc.CTRLBSET.reg = TC_CTRLBSET_ONESHOT;
+	tc.INTENSET.reg = TC_INTENSET_OVF;
+	while (tc.STATUS.bit.SYNCBUSY) {}
+	tc.CTRLA.reg |= TC_CTRLA_ENABLE;
+	while (tc.STATUS.bit.SYNCBUSY) {}
+	NVIC_SetPriority((IRQn_Type)(TC3_IRQn + timer), SERCOM_NVIC_PRIORITY);
+	NVIC_EnableIRQ((IRQn_Type)(TC3_IRQn + timer));
+
+	EVSYS->USER.reg = EVSYS_USER_USER(EVSYS_ID_USER_TC3_EVU + timer) | EVSYS_USER_CHANNEL(_channel + 1);
+	EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(_channel) | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_DMAC_CH_0 + _channel) |
+		EVSYS_CHANNEL_PATH_ASYNCHRONOUS | EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT;
+	interrupts();
+}
+
+/*
+	The descriptor being filled is told apart by its end address in the write-back memory, which the
+	DMA controller updates as each byte is moved.
+*/
+uint16_t DmaUart::head() {
+	const DmacDescriptor &wb = dmaWriteback[_channel];
+	uint32_t end = wb.DSTADDR.reg;
+	if (end == 0) {
+		return 0;				// nothing received since begin()
+	}
+	uint16_t base = (end == dmaBase[_channel].DSTADDR.reg) ? 0 : UART_DMA_HALF;
+	return (base + UART_DMA_HALF - wb.BTCNT.reg) & (UART_DMA_RING - 1);
+}
+
+int DmaUart::available() {
+	return (head() - _tail) & (UART_DMA_RING - 1);
+}
+
+int DmaUart::read() {
+	if (head() == _tail) {
+		return -1;
+	}
+	uint8_t c = _ring[_tail];
+	rxConsume(1);
+	return c;
+}
+
+int DmaUart::peek() {
+	return head() == _tail ? -1 : _ring[_tail];
+}
+
+uint16_t DmaUart::rxSpan(const uint8_t *&data) {
+	uint16_t h = head();
+	uint16_t t = _tail;
+	data = _ring + t;
+	return (h >= t) ? h - t : UART_DMA_RING - t;
+}
+
+void DmaUart::rxConsume(uint16_t count) {
+	_tail = (_tail + count) & (UART_DMA_RING - 1);
+	_taken += count;
+	rxStats.bytes += count;
+}
+
+void DmaUart::irqHandler() {
+	SercomUsart &usart = _regs->USART;
+	if (usart.INTFLAG.bit.ERROR) {
+		usart.INTFLAG.reg = SERCOM_USART_INTFLAG_ERROR;
+		if (usart.STATUS.bit.BUFOVF) rxStats.overruns++;
+		if (usart.STATUS.bit.FERR) rxStats.framingErrors++;
+		usart.STATUS.reg = SERCOM_USART_STATUS_BUFOVF | SERCOM_USART_STATUS_FERR | SERCOM_USART_STATUS_PERR;
+	}
+	// transmit: the core's handler. A received byte is taken by the DMA channel within a few clocks of its
+	// trigger, long before this handler could see it.
+	if (usart.INTFLAG.reg & usart.INTENSET.reg & (SERCOM_USART_INTFLAG_DRE | SERCOM_USART_INTFLAG_TXC)) {
+		Uart::IrqHandler();
+	}
+}
+
+/*
+	A half of the ring is complete and the channel has moved on to the other half. The ring index alone cannot
+	tell a reader that has caught up into that half from one a whole lap behind, so the bytes received and
+	taken are counted: more than a half unread means the reader is still in the half the channel is about to
+	overwrite, and its bytes there are counted and skipped (it goes on from the half just completed).
+*/
+void DmaUart::dmaHandler() {
+	DMAC->CHID.reg = DMAC_CHID_ID(_channel);
+	if (!DMAC->CHINTFLAG.bit.TCMPL) {
+		return;
+	}
+	DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+	_received += UART_DMA_HALF;
+	int32_t unread = (int32_t)(_received - _taken);		// < 0: the reader is already into the new half
+	if (unread > UART_DMA_HALF) {
+		uint32_t lost = unread - UART_DMA_HALF;
+		rxStats.ringOverruns += lost;
+		_taken += lost;
+		_tail = (_received - UART_DMA_HALF) & (UART_DMA_RING - 1);
+	}
+	rxStats.interrupts++;
+	if (_onReceive) {
+		_onReceive();
+	}
+}
+
+void DmaUart::idleHandler() {
+	_timer->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+	halRxDone(_regs);
+	rxStats.interrupts++;
+	if (_onReceive) {
+		_onReceive();
+	}
+}
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+	Sensor UART with the receive side run by the DMA controller (the board side of SerialPort, see PM2_hal.h).
+
+	The core's Uart takes an interrupt for every received byte and copies it into a 64 byte ring, so a burst
+	that arrives while another handler (I2C, USB) is running can overrun the UART. Here a DMA channel moves
+	every received byte straight into a UART_DMA_RING byte ring, and the CPU only hears about it
+		at the end of a burst: each byte moved by the DMA channel restarts a one shot timer (DMA beat event
+		through the event system); when no byte has arrived for UART_DMA_IDLE_BYTES byte times the timer
+		fires. The SAMD21 UART has no idle line detection of its own, and the sensors end every burst with
+		the line terminator, so this hands the driver whole lines;
+		when half of the ring has filled (the ring is two linked descriptors): a long burst is drained before
+		the DMA channel comes round to it again.
+	Both call the onReceive handler, which decodes the bytes (rxSpan / rxConsume hand it contiguous spans).
+	available / read / peek read the same ring, so the drivers' start up code is unchanged; as the handler
+	consumes the ring too, code outside it reads with interrupts off (the ring has one reader at a time).
+
+	UART errors still interrupt through SERCOMx_Handler (irqHandler), which counts them and passes transmit
+	interrupts on to the core's handler.
+*/
+
+#define UART_DMA_RING 256			// bytes per port (power of 2)
+#define UART_DMA_IDLE_BYTES 3		// byte times of silence that end a burst (also used by the native build)
+#define UART_DMA_TIMER_HZ 3000000	// idle timer clock (48 MHz / 16)
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+class DmaUart : public Uart {
+	public:
+		DmaUart(SERCOM *sercom, uint8_t rxPin, uint8_t txPin, SercomRXPad rxPad, SercomUartTXPad txPad,
+			Sercom *regs, uint8_t dmaChannel, Tc *idleTimer);
+		void begin(unsigned long baud) override;
+		int available() override;
+		int read() override;
+		int peek() override;
+		uint16_t rxSpan(const uint8_t *&data);	// contiguous received bytes not yet consumed
+		void rxConsume(uint16_t count);
+		void onReceive(void (*handler)()) { _onReceive = handler; }
+
+		void irqHandler();			// SERCOMx_Handler
+		void dmaHandler();			// DMAC_Handler: a half of the ring has filled
+		void idleHandler();			// TCx_Handler: the burst has ended
+		UartRxStats rxStats;
+
+	private:
+		uint16_t head();			// ring index the DMA channel writes next
+		Sercom *_regs;
+		uint8_t _channel;
+		Tc *_timer;
+		void (*_onReceive)()=nullptr;
+		uint8_t _ring[UART_DMA_RING] __attribute__((aligned(4)));
+		volatile uint16_t _tail=0;	// next byte to hand out
+		uint32_t _received=0;		// bytes in the halves completed since begin()
+		volatile uint32_t _taken=0;	// bytes handed out or skipped since begin()
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "PM2_windstats.h"
+#include <math.h>
+
+static const float DEG_TO_RADIANS = 0.017453292519943f;
+static const float RADIANS_TO_DEG = 57.29577951308232f;
+
+WindStats::WindStats() {
+	reset();
+}
+
+void WindStats::reset() {
+	_count=0;
+	_first=0;
+	_last=0;
+	_sumSin=0;
+	_sumCos=0;
+	_sumU=0;
+	_sumV=0;
+	_mean=0;
+	_m2=0;
+	_gust=0;
+	_lull=0;
+	_gustHead=0;
+	_gustCount=0;
+	_gustSum=0;
+}
+
+void WindStats::add(uint32_t timeMs, float dirDeg, float speed) {
+	float s = sinf(dirDeg * DEG_TO_RADIANS);
+	float c = cosf(dirDeg * DEG_TO_RADIANS);
+
+	if (_count == 0) {
+		_first=timeMs;
+	}
+	_last=timeMs;
+	_count++;
+	_sumSin += s;
+	_sumCos += c;
+	_sumU += speed * s;
+	_sumV += speed * c;
+
+	// Welford
+	float delta = speed - _mean;
+	_mean += delta / _count;
+	_m2 += delta * (speed - _mean);
+
+	// gustWindow running mean: drop samples that have left the window, then add this one
+	while (_gustCount > 0) {
+		uint8_t oldest = (uint8_t)((_gustHead + GUST_SAMPLES - _gustCount) % GUST_SAMPLES);
+		if (_gustCount < GUST_SAMPLES && timeMs - _gustTime[oldest] < gustWindow) {
+			break;
+		}
+		_gustSum -= _gustSpeed[oldest];
+		_gustCount--;
+	}
+	_gustTime[_gustHead]=timeMs;
+	_gustSpeed[_gustHead]=speed;
+	_gustHead = (uint8_t)((_gustHead + 1) % GUST_SAMPLES);
+	_gustCount++;
+	_gustSum += speed;
+
+	float runningMean = _gustSum / _gustCount;
+	if (_count == 1 || runningMean > _gust) _gust=runningMean;
+	if (_count == 1 || runningMean < _lull) _lull=runningMean;
+}
+
+WindStatistics WindStats::result() const {
+	WindStatistics r;
+	r.count=_count;
+	r.duration=_last - _first;
+	r.meanDir=0;
+	r.dirStdDev=0;
+	r.meanSpeed=0;
+	r.vectorSpeed=0;
+	r.speedVariance=0;
+	r.gust=_gust;
+	r.lull=_lull;
+	if (_count == 0) {
+		return r;
+	}
+	float n = _count;
+	float sa = _sumSin / n;
+	float ca = _sumCos / n;
+	r.meanDir = atan2f(sa, ca) * RADIANS_TO_DEG;
+	if (r.meanDir < 0) r.meanDir += 360.0f;
+	if (r.meanDir >= 360.0f) r.meanDir -= 360.0f;
+	// Yamartino: epsilon = sqrt(1 - (sa^2 + ca^2))
+	float e2 = 1.0f - (sa*sa + ca*ca);
+	float epsilon = (e2 > 0) ? sqrtf(e2) : 0;
+	r.dirStdDev = asinf(epsilon) * (1.0f + 0.1547f * epsilon * epsilon * epsilon) * RADIANS_TO_DEG;
+	r.meanSpeed=_mean;
+	r.vectorSpeed=sqrtf(_sumU*_sumU + _sumV*_sumV) / n;
+	r.speedVariance = (_count > 1) ? _m2 / (n - 1) : 0;
+	return r;
+}
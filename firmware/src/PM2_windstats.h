@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+	Incremental wind statistics over a window of samples (O(1) memory: nothing is kept per sample
+	except the samples inside the gust window).
+
+	- mean direction: direction of the mean unit vector (correct across 0/360)
+	- direction standard deviation: Yamartino estimate from the same unit vector sums
+	- scalar mean speed and vector mean speed (magnitude of the mean wind vector)
+	- speed variance: Welford's running algorithm
+	- gust / lull: highest / lowest mean speed over gustWindow (3 seconds by default: WMO definition of a gust)
+
+	The window is restarted by reset(); the driver does this after the master has read the results.
+*/
+
+#define GUST_WINDOW_MS 3000		// default gust averaging window (set by CONFIG_WIND_GUST)
+#define GUST_WINDOW_MAX_MS 10000	// longest gust window accepted (CONFIG_GUST_MAX)
+#define GUST_RATE_MAX 4			// Hz: fastest sample rate (WIND_STREAM_RATE_MAX)
+#define GUST_SAMPLES (GUST_WINDOW_MAX_MS * GUST_RATE_MAX / 1000 + 8)	// the longest window at the fastest rate (plus margin)
+
+struct WindStatistics {
+	uint16_t count;			// samples in the window
+	uint32_t duration;		// mS from the first to the last sample
+	float meanDir;			// deg 0 - 360
+	float dirStdDev;		// deg
+	float meanSpeed;		// scalar mean (m/s)
+	float vectorSpeed;		// vector mean (m/s)
+	float speedVariance;	// (m/s)^2
+	float gust;				// m/s
+	float lull;				// m/s
+};
+
+class WindStats {
+	public:
+		WindStats();
+		void reset();
+		void add(uint32_t timeMs, float dirDeg, float speed);
+		WindStatistics result() const;
+		uint32_t gustWindow=GUST_WINDOW_MS;	// mS
+
+	private:
+		uint16_t _count;
+		uint32_t _first;		// time of the first sample
+		uint32_t _last;			// time of the latest sample
+		float _sumSin;			// sum of unit vectors
+		float _sumCos;
+		float _sumU;			// sum of wind vectors (speed weighted)
+		float _sumV;
+		float _mean;			// Welford running mean and sum of squared differences
+		float _m2;
+		float _gust;
+		float _lull;
+		// samples inside the gust window
+		uint32_t _gustTime[GUST_SAMPLES];
+		float _gustSpeed[GUST_SAMPLES];
+		uint8_t _gustHead;
+		uint8_t _gustCount;
+		float _gustSum;
+};
@@ -0,0 +1,430 @@
+#ifndef ARDUINO
+
+#include "../PM2_hal.h"
+#include <string.h>
+
+/*
+	Virtual clock and the simulated serial ports attached to it.
+*/
+
+#define NATIVE_MAX_PORTS 4
+#define NATIVE_TICK_US 1000		// SysTick: the longest the board ever sleeps before an interrupt
+
+static uint64_t clockUs=0;
+static SerialPort *ports[NATIVE_MAX_PORTS];
+static uint8_t numPorts=0;
+
+LogSink halLog;
+uint8_t nativeInterrupt=0;
+I2CSlave i2cSlave;
+LedColour nativeLed=LED_GREEN;
+bool nativeAlert=false;
+
+uint64_t nativeClock() {
+	return clockUs;
+}
+
+uint32_t halMicros() {
+	return (uint32_t)clockUs;
+}
+
+uint32_t halMillis() {
+	return (uint32_t)(clockUs / 1000);
+}
+
+// advance the clock, delivering every serial byte that falls due on the way
+void nativeAdvance(uint32_t us) {
+	uint64_t target = clockUs + us;
+	for (;;) {
+		uint64_t next = target;
+		for (uint8_t i=0; i<numPorts; i++) {
+			uint64_t when;
+			if (ports[i]->nextDelivery(when) && when < next) {
+				next = when;
+			}
+			if (ports[i]->nextTimer(when) && when < next) {
+				next = when;
+			}
+		}
+		if (next > clockUs) {
+			clockUs = next;
+		}
+		for (uint8_t i=0; i<numPorts; i++) {
+			ports[i]->deliver(clockUs);
+		}
+		if (clockUs >= target) {
+			return;
+		}
+	}
+}
+
+void halDelay(uint32_t ms) {
+	nativeAdvance(ms * 1000);
+}
+
+void halDelayMicroseconds(uint32_t us) {
+	nativeAdvance(us);
+}
+
+// sleep until the next "interrupt": a serial byte, an idle timer or the next SysTick
+void halIdle() {
+	uint64_t next = clockUs + NATIVE_TICK_US;
+	for (uint8_t i=0; i<numPorts; i++) {
+		uint64_t when;
+		if (ports[i]->nextDelivery(when) && when < next) {
+			next = when;
+		}
+		if (ports[i]->nextTimer(when) && when < next) {
+			next = when;
+		}
+	}
+	nativeAdvance((uint32_t)(next - clockUs));
+}
+
+uint64_t nativeI2CWakeAt=0;
+
+#ifdef PM2_LOW_POWER
+
+static uint64_t standbyUs=0;
+
+/*
+	Standby: no SysTick, so the board sleeps until the deadline, the start bit of the next serial byte
+	or the next master transaction, and takes NATIVE_WAKE_US to get going again. A UART holds one byte
+	while the next is shifted in, so a wake up slower than two byte times would lose bytes.
+	Once a burst has started the board only idles until its idle timer has fired (halRxActive).
+*/
+void halStandby(uint32_t us) {
+	for (uint8_t i=0; i<numPorts; i++) {
+		uint64_t when;
+		if (ports[i]->nextTimer(when)) {
+			halIdle();
+			return;
+		}
+	}
+	uint64_t wake = clockUs + us;
+	HalWakeSource source = WAKE_RTC;
+	uint32_t byteTime = 0;
+	for (uint8_t i=0; i<numPorts; i++) {
+		uint64_t when;
+		if (ports[i]->nextDelivery(when)) {
+			uint64_t start = when - ports[i]->byteTime();		// start bit
+			if (start < wake) {
+				wake = start > clockUs ? start : clockUs;
+				source = ports[i]->wakeSource;
+				byteTime = ports[i]->byteTime();
+			}
+		}
+	}
+	if (nativeI2CWakeAt != 0 && nativeI2CWakeAt < wake) {
+		wake = nativeI2CWakeAt > clockUs ? nativeI2CWakeAt : clockUs;
+		source = WAKE_I2C;
+	}
+	uint64_t slept = wake - clockUs;
+	nativeAdvance((uint32_t)slept);
+	standbyUs += slept;
+	halPower.standbyMillis = (uint32_t)(standbyUs / 1000);
+	halPower.wakes[source]++;
+	if (source == WAKE_RTC && NATIVE_WAKE_US > halPower.wakeLatencyMax) {
+		halPower.wakeLatencyMax = NATIVE_WAKE_US;
+	}
+	if (byteTime != 0 && NATIVE_WAKE_US > 2 * byteTime) {
+		halPower.rxLost++;
+	}
+	nativeAdvance(NATIVE_WAKE_US);
+}
+
+#else
+
+void halStandby(uint32_t /* us */) {
+	halIdle();
+}
+
+#endif
+
+// ---------------------------------------------------------------- log sink
+
+size_t LogSink::print(const char *text) { return enabled ? (size_t)printf("%s", text) : 0; }
+size_t LogSink::print(char c) { return enabled ? (size_t)printf("%c", c) : 0; }
+size_t LogSink::print(int value) { return enabled ? (size_t)printf("%d", value) : 0; }
+size_t LogSink::print(unsigned int value) { return enabled ? (size_t)printf("%u", value) : 0; }
+size_t LogSink::print(long value) { return enabled ? (size_t)printf("%ld", value) : 0; }
+size_t LogSink::print(unsigned long value) { return enabled ? (size_t)printf("%lu", value) : 0; }
+size_t LogSink::print(double value, int digits) { return enabled ? (size_t)printf("%.*f", digits, value) : 0; }
+size_t LogSink::println() { return enabled ? (size_t)printf("\n") : 0; }
+
+// ---------------------------------------------------------------- serial port
+
+SerialPort::SerialPort(const char *name, uint32_t baud) {
+	_name=name;
+	_baud=baud;
+	if (numPorts < NATIVE_MAX_PORTS) {
+		ports[numPorts++]=this;
+	}
+}
+
+void SerialPort::begin(uint32_t baud) {
+	_baud=baud;
+}
+
+void SerialPort::end() {
+	_rxCount=0;
+}
+
+int SerialPort::available() {
+	return _rxCount;
+}
+
+int SerialPort::read() {
+	if (_rxCount == 0) {
+		return -1;
+	}
+	uint8_t c = _rx[_rxHead];
+	rxConsume(1);
+	return c;
+}
+
+int SerialPort::peek() {
+	return _rxCount ? _rx[_rxHead] : -1;
+}
+
+uint16_t SerialPort::rxSpan(const uint8_t *&data) {
+	data = _rx + _rxHead;
+	return (_rxHead + _rxCount <= NATIVE_SERIAL_RX) ? _rxCount : NATIVE_SERIAL_RX - _rxHead;
+}
+
+void SerialPort::rxConsume(uint16_t count) {
+	_rxHead = (_rxHead + count) % NATIVE_SERIAL_RX;
+	_rxCount -= count;
+	rxStats.bytes += count;
+}
+
+// a rate mismatch corrupts every byte except the line feed; a rate too fast for the cable corrupts some of them
+uint8_t SerialPort::corrupt(uint8_t c) {
+	bool mismatch = (deviceBaud != 0 && deviceBaud != _baud);
+	bool noise=false;
+	if (lineLimit != 0 && _baud > lineLimit) {
+		_noise = _noise * 1664525UL + 1013904223UL;		// repeatable pseudo random noise
+		noise = (_noise >> 28) == 0;
+	}
+	return ((mismatch || noise) && c != '\n') ? (uint8_t)(c ^ 0xA5) : c;
+}
+
+// bytes written by the firmware are collected into lines for the mock device
+size_t SerialPort::write(uint8_t c) {
+	bytesWritten++;
+	c = corrupt(c);
+	if (c == '\n') {
+		_line[_lineLen]='\0';
+		if (_lineLen > 0 && _line[_lineLen - 1] == '\r') {
+			_line[_lineLen - 1]='\0';
+		}
+		_lineLen=0;
+		if (_responder) {
+			_responder(*this, _line);
+		}
+	} else if (_lineLen < NATIVE_SERIAL_LINE - 1) {
+		_line[_lineLen++]=(char)c;
+	}
+	return 1;
+}
+
+size_t SerialPort::write(const uint8_t *data, size_t len) {
+	for (size_t i=0; i<len; i++) {
+		write(data[i]);
+	}
+	return len;
+}
+
+size_t SerialPort::print(const char *text) {
+	return write((const uint8_t *)text, strlen(text));
+}
+
+size_t SerialPort::print(char c) {
+	return write((uint8_t)c);
+}
+
+size_t SerialPort::println(const char *text) {
+	return print(text) + println();
+}
+
+size_t SerialPort::println(char c) {
+	return print(c) + println();
+}
+
+size_t SerialPort::println() {
+	return print("\r\n");
+}
+
+void SerialPort::inject(const char *bytes, uint32_t delayUs) {
+	if (_pendCount == 0) {
+		_nextTime = clockUs + delayUs + byteTime();
+	}
+	for (const char *p=bytes; *p; p++) {
+		if (_pendCount >= NATIVE_SERIAL_PENDING) {
+			break;
+		}
+		_pending[(_pendHead + _pendCount) % NATIVE_SERIAL_PENDING]=(uint8_t)*p;
+		_pendCount++;
+	}
+}
+
+bool SerialPort::nextDelivery(uint64_t &when) const {
+	if (_pendCount == 0) {
+		return false;
+	}
+	when=_nextTime;
+	return true;
+}
+
+bool SerialPort::nextTimer(uint64_t &when) const {
+	if (_idleAt == 0) {
+		return false;
+	}
+	when=_idleAt;
+	return true;
+}
+
+/*
+	Move the bytes that have arrived by now into the receive buffer and "interrupt" for each one or, in DMA
+	mode, when half of the ring has filled and when the idle timer started by the last byte runs out.
+*/
+void SerialPort::deliver(uint64_t now) {
+	while (_pendCount > 0 && _nextTime <= now) {
+		if (_idleAt != 0 && _idleAt < _nextTime) {
+			break;				// the burst ended before this byte: the idle timer fires first
+		}
+		uint8_t raw = _pending[_pendHead];
+		uint8_t c = corrupt(raw);
+		if (c != raw) {
+			rxStats.framingErrors++;
+		}
+		_pendHead = (_pendHead + 1) % NATIVE_SERIAL_PENDING;
+		_pendCount--;
+		if (_rxCount < NATIVE_SERIAL_RX) {
+			_rx[(_rxHead + _rxCount) % NATIVE_SERIAL_RX]=c;
+			_rxCount++;
+		} else {
+			rxStats.ringOverruns++;
+		}
+		lastByteTime=_nextTime;
+		_nextTime += byteTime();
+		if (_idleBytes != 0) {
+			_idleAt = lastByteTime + (uint64_t)_idleBytes * byteTime();
+			if (_rxCount % (NATIVE_SERIAL_RX / 2) != 0) {
+				continue;
+			}
+		}
+		rxStats.interrupts++;
+		if (_rxHandler) {
+			nativeInterrupt++;
+			_rxHandler();
+			nativeInterrupt--;
+		}
+	}
+	if (_idleAt != 0 && _idleAt <= now) {
+		_idleAt=0;
+		rxStats.interrupts++;
+		if (_rxHandler) {
+			nativeInterrupt++;
+			_rxHandler();
+			nativeInterrupt--;
+		}
+		if (_pendCount > 0 && _nextTime <= now) {
+			deliver(now);
+		}
+	}
+	if (_pendCount == 0 && nextDeviceBaud != 0) {
+		deviceBaud=nextDeviceBaud;
+		nextDeviceBaud=0;
+	}
+}
+
+// ---------------------------------------------------------------- flash
+
+NativeFlashStats nativeFlash;
+int32_t nativeFlashPowerFail=-1;
+bool nativeFlashFailed=false;
+
+void halFlashErase(const uint8_t *row) {
+	if (nativeFlashFailed) {
+		return;				// the power is off until the caller simulates the reset
+	}
+	memset((uint8_t *)row, 0xFF, HAL_FLASH_ROW);
+	nativeFlash.erases++;
+	nativeFlash.lastErased=row;
+	nativeAdvance(NATIVE_FLASH_ERASE_US);
+}
+
+void halFlashWrite(const uint8_t *dst, const void *src, uint16_t len) {
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+	if (nativeFlashFailed) {
+		return;
+	}
+	if (((uintptr_t)d & 3) || (len & 3) || ((uintptr_t)d / HAL_FLASH_PAGE != ((uintptr_t)d + len - 1) / HAL_FLASH_PAGE)) {
+		nativeFlash.violations++;		// not word aligned or crosses a page
+	}
+	nativeFlash.pageWrites++;
+	uint16_t first=0;
+	if (nativeFlashPowerFail >= 0 && nativeFlashPowerFail < len) {
+		// the page is committed as a whole, in no order the firmware can rely on: a cut programs the end of it
+		first = len - (uint16_t)nativeFlashPowerFail;
+		nativeFlashFailed=true;
+		nativeFlashPowerFail=-1;
+	} else if (nativeFlashPowerFail > 0) {
+		nativeFlashPowerFail -= len;
+	}
+	for (uint16_t i=first; i<len; i++) {
+		if (s[i] & ~d[i]) {
+			nativeFlash.violations++;
+		}
+		d[i] &= s[i];
+		nativeFlash.bytesProgrammed++;
+	}
+	nativeAdvance(NATIVE_FLASH_WRITE_US);
+}
+
+// ---------------------------------------------------------------- I2C slave
+
+size_t I2CSlave::write(uint8_t c) {
+	if (_txCount >= NATIVE_I2C_BUFFER) {
+		return 0;
+	}
+	_tx[_txCount++]=c;
+	return 1;
+}
+
+size_t I2CSlave::write(const uint8_t *data, size_t len) {
+	size_t n=0;
+	while (n < len && write(data[n])) {
+		n++;
+	}
+	return n;
+}
+
+bool I2CSlave::masterWrite(const uint8_t *data, uint8_t len) {
+	if (!_onReceive || _address == 0) {
+		return false;
+	}
+	memcpy(_rx, data, len);
+	_rxCount=len;
+	_rxPos=0;
+	nativeInterrupt++;
+	_onReceive(len);
+	nativeInterrupt--;
+	return true;
+}
+
+uint8_t I2CSlave::masterRead(uint8_t *data, uint8_t len) {
+	_txCount=0;
+	if (_onRequest) {
+		nativeInterrupt++;
+		_onRequest();
+		nativeInterrupt--;
+	}
+	uint8_t n = (_txCount < len) ? (uint8_t)_txCount : len;
+	memcpy(data, _tx, n);
+	return n;
+}
+
+#endif
@@ -0,0 +1,202 @@
+#pragma once
+
+/*
+	Native (Linux) implementation of the hardware abstraction layer (see PM2_hal.h).
+
+	Time is simulated: halMicros() returns a virtual clock that only moves when the firmware waits
+	(halDelay, halDelayMicroseconds) or sleeps (halIdle), so a run is deterministic and a long
+	period of operation can be simulated in a fraction of a second.
+
+	SerialPort is a scripted serial device. Lines written by the firmware are handed to a responder
+	function (the mock sensor) which can queue a reply with inject(); the reply bytes are then delivered
+	one at a time at the byte rate of the port's baud rate, and the port's receive handler is called for
+	each byte as SERCOMx_Handler is by the core's Uart. After rxDma() it is called as on the board
+	(PM2_uartdma.h) instead: once the line has been idle for the given number of byte times, or when half of
+	the receive ring has filled.
+
+	I2CSlave holds the onReceive / onRequest handlers registered by the firmware; masterWrite() and
+	masterRead() play the part of the Smart Citizen master.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+// ---------------------------------------------------------------- clock
+
+uint32_t halMicros();
+uint32_t halMillis();
+void halDelay(uint32_t ms);
+void halDelayMicroseconds(uint32_t us);
+void halIdle();						// advance to the next simulated interrupt
+inline void halInterruptsOff() {}
+inline void halInterruptsOn() {}
+void halStandby(uint32_t us);		// scheduler sleep: standby with PM2_LOW_POWER (see PM2_hal.h), else halIdle()
+void nativeAdvance(uint32_t us);	// advance the virtual clock, delivering serial bytes and idle timers on the way
+uint64_t nativeClock();				// virtual time in uS (64 bit: does not wrap)
+inline uint32_t halCycles() { return (uint32_t)(nativeClock() * HAL_CYCLES_PER_US); }	// virtual: code takes no time
+
+#define NATIVE_WAKE_US 20				// estimated standby wake up time of the SAMD21 (OSC8M / DFLL restart)
+extern uint64_t nativeI2CWakeAt;		// next master transaction: wakes the board from standby (0: none)
+
+// ---------------------------------------------------------------- log sink
+
+class LogSink {
+	public:
+		bool enabled=true;
+		size_t print(const char *text);
+		size_t print(char c);
+		size_t print(int value);
+		size_t print(unsigned int value);
+		size_t print(long value);
+		size_t print(unsigned long value);
+		size_t print(double value, int digits=2);
+		size_t println();
+		template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+		size_t println(double value, int digits) { size_t n = print(value, digits); return n + println(); }
+};
+
+extern LogSink halLog;
+inline bool halLogReady() { return halLog.enabled; }
+
+extern uint8_t nativeInterrupt;		// > 0 while a simulated interrupt handler runs
+inline bool halInInterrupt() { return nativeInterrupt != 0; }
+
+// ---------------------------------------------------------------- serial port
+
+#define NATIVE_SERIAL_RX 256		// bytes: same as the SAMD core ring buffer
+#define NATIVE_SERIAL_PENDING 512	// bytes queued by the mock device and not yet delivered
+#define NATIVE_SERIAL_LINE 128
+
+class SerialPort;
+typedef void (*SerialResponder)(SerialPort &port, const char *line);
+
+class SerialPort {
+	public:
+		SerialPort(const char *name, uint32_t baud);
+		void begin(uint32_t baud);
+		void end();
+		operator bool() { return true; }
+		int available();
+		int read();
+		int peek();
+		uint16_t rxSpan(const uint8_t *&data);	// contiguous received bytes not yet consumed
+		void rxConsume(uint16_t count);
+		void flush() {}
+		size_t write(uint8_t c);
+		size_t write(const uint8_t *data, size_t len);
+		size_t print(const char *text);
+		size_t print(char c);
+		size_t println(const char *text);
+		size_t println(char c);
+		size_t println();
+
+		// device side
+		void setResponder(SerialResponder responder) { _responder = responder; }
+		void setRxHandler(void (*handler)()) { _rxHandler = handler; }	// the "interrupt handler"
+		void rxDma(uint8_t idleBytes) { _idleBytes = idleBytes; }	// handler at the end of a burst / half ring
+		void inject(const char *bytes, uint32_t delayUs);	// device sends bytes after delayUs
+		uint32_t baud() const { return _baud; }
+		uint32_t byteTime() const { return 10000000UL / _baud; }	// uS per byte (start + 8 + stop)
+		const char *name() const { return _name; }
+		HalWakeSource wakeSource=WAKE_OTHER;	// reported when a start bit on this port ends a standby
+		UartRxStats rxStats={0, 0, 0, 0, 0};	// ringOverruns: bytes lost because the receive buffer was full
+		uint32_t bytesWritten=0;
+		uint64_t lastByteTime=0;	// virtual time the last byte was delivered
+		uint32_t deviceBaud=0;		// rate the device is talking at (0: always the port's rate)
+		uint32_t nextDeviceBaud=0;	// device switches to this rate once its queued reply has been sent
+		uint32_t lineLimit=0;		// fastest rate the simulated cable carries cleanly (0: any); faster rates lose 1 byte in 16
+		uint8_t corrupt(uint8_t c);	// the byte as it arrives at the other end
+
+		// used by the clock
+		bool nextDelivery(uint64_t &when) const;
+		bool nextTimer(uint64_t &when) const;		// pending idle timer (DMA mode)
+		void deliver(uint64_t now);
+
+	private:
+		const char *_name;
+		uint32_t _baud;
+		SerialResponder _responder=nullptr;
+		void (*_rxHandler)()=nullptr;
+		uint8_t _rx[NATIVE_SERIAL_RX];
+		uint16_t _rxHead=0;
+		uint16_t _rxCount=0;
+		uint8_t _pending[NATIVE_SERIAL_PENDING];
+		uint16_t _pendHead=0;
+		uint16_t _pendCount=0;
+		uint64_t _nextTime=0;		// delivery time of the first pending byte
+		uint8_t _idleBytes=0;		// DMA mode: byte times of silence that end a burst (0: handler per byte)
+		uint64_t _idleAt=0;			// idle timer expiry (0: not running)
+		char _line[NATIVE_SERIAL_LINE];
+		uint8_t _lineLen=0;
+		uint32_t _noise=1;
+};
+
+// ---------------------------------------------------------------- I2C slave
+
+#define NATIVE_I2C_BUFFER 256
+
+class I2CSlave {
+	public:
+		void begin(uint8_t address) { _address = address; }
+		void onReceive(void (*handler)(int)) { _onReceive = handler; }
+		void onRequest(void (*handler)()) { _onRequest = handler; }
+		int available() { return _rxCount - _rxPos; }
+		int read() { return (_rxPos < _rxCount) ? _rx[_rxPos++] : -1; }
+		size_t write(uint8_t c);
+		size_t write(const uint8_t *data, size_t len);
+		size_t write(int c) { return write((uint8_t)c); }
+		size_t write(unsigned int c) { return write((uint8_t)c); }
+
+		// master side
+		bool masterWrite(const uint8_t *data, uint8_t len);		// false if no slave is listening
+		uint8_t masterRead(uint8_t *data, uint8_t len);			// returns the bytes the slave sent
+		uint8_t address() const { return _address; }
+
+	private:
+		uint8_t _address=0;
+		void (*_onReceive)(int)=nullptr;
+		void (*_onRequest)()=nullptr;
+		uint8_t _rx[NATIVE_I2C_BUFFER];
+		uint16_t _rxCount=0;
+		uint16_t _rxPos=0;
+		uint8_t _tx[NATIVE_I2C_BUFFER];
+		uint16_t _txCount=0;
+};
+
+extern I2CSlave i2cSlave;
+
+// ---------------------------------------------------------------- flash
+
+/*
+	Simulated NVM: halFlashErase / halFlashWrite operate on ordinary RAM but keep the rules of the SAMD21 flash
+	(erase by row, program within a page, program can only clear bits) and count the work done, so the
+	flash log can be checked for write amplification and wear. Erase and write advance the virtual clock by
+	the datasheet times. nativeFlashPowerFail cuts a write short after that many bytes (a brown out); the bytes
+	that make it are the last ones of that page write, since the hardware commits the page buffer in one command.
+*/
+#define NATIVE_FLASH_ERASE_US 6000
+#define NATIVE_FLASH_WRITE_US 2500
+
+struct NativeFlashStats {
+	uint32_t erases;			// rows erased
+	uint32_t pageWrites;		// page program commands
+	uint32_t bytesProgrammed;
+	uint32_t violations;		// writes that tried to set a bit (would need an erase first)
+	const uint8_t *lastErased;	// row erased last
+};
+
+extern NativeFlashStats nativeFlash;
+extern int32_t nativeFlashPowerFail;	// bytes until the power fails (-1: never)
+extern bool nativeFlashFailed;			// a write was cut short: the flash is left alone until this is cleared
+void halFlashErase(const uint8_t *row);
+void halFlashWrite(const uint8_t *dst, const void *src, uint16_t len);
+
+// ---------------------------------------------------------------- status led
+
+extern LedColour nativeLed;
+inline void halLed(LedColour colour) { nativeLed = colour; }
+extern bool nativeAlert;			// the data ready line is asserted (the master polls it instead of a pin change)
+inline void halAlertBegin() { nativeAlert = false; }
+inline void halAlert(bool asserted) { nativeAlert = asserted; }
@@ -0,0 +1,208 @@
+#ifndef ARDUINO
+
+/*
+	Reading encoding benchmark (program encoding [samples] [seed]).
+	Times the cost of one sample under each encoding policy of PM2_encoding.h: parsing an MWV sentence and an
+	RG-15 reading line into the scaled integers (the same parsers for both policies), then encoding the 6 readings
+	as buildFrame() does, and the 7 wind statistics as GET_WIND_STATS does. Every encoded value is decoded again
+	and checked: the scaled integers must come back exactly (as floats within float precision) and the statistics
+	within half a unit of the scale.
+	The times are host nanoseconds; a PC has a hardware FPU, so the float encoding costs far more on the M0+,
+	where each int to float conversion and division is a software routine.
+*/
+
+#include "../PM2_encoding.h"
+#include "../PM2_MWVparser.h"
+#include "../PM2_RG15parser.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+struct EncodingSample {
+	char wind[MWV_MAX_SENTENCE];
+	char rain[2 * RG15_MAX_LINE];
+	int32_t values[6];			// winddir, windspeed, accum, eventacc, totalacc, intervalacc as scaled integers
+	float stats[7];				// GET_WIND_STATS values
+};
+
+static const int32_t sampleScale[6] = { WIND_DIR_SCALE, WIND_SPEED_SCALE, RAIN_SCALE, RAIN_SCALE, RAIN_SCALE,
+	RAIN_SCALE };
+static const int32_t statsScale[7] = { WIND_DIR_SCALE, WIND_DIR_SCALE, WIND_SPEED_SCALE, WIND_SPEED_SCALE,
+	WIND_SPEED_SCALE * WIND_SPEED_SCALE, WIND_SPEED_SCALE, WIND_SPEED_SCALE };
+
+static uint32_t benchState=1;
+
+static uint32_t benchRandom() {
+	benchState = benchState * 1664525 + 1013904223;
+	return benchState >> 8;
+}
+
+static uint64_t hostNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void makeSample(EncodingSample &s) {
+	s.values[0] = benchRandom() % 3600;
+	s.values[1] = benchRandom() % 3000;
+	s.values[2] = benchRandom() % 2000;
+	s.values[3] = benchRandom() % 50000;
+	s.values[4] = benchRandom() % 9999999;
+	s.values[5] = benchRandom() % 150000;
+	int n = snprintf(s.wind, sizeof(s.wind), "$WIMWV,%d.%d,R,%d.%02d,M,A", s.values[0] / 10, s.values[0] % 10,
+		s.values[1] / 100, s.values[1] % 100);
+	uint8_t sum=0;
+	for (int i=1; i<n; i++) {
+		sum ^= (uint8_t)s.wind[i];
+	}
+	snprintf(s.wind + n, sizeof(s.wind) - n, "*%02X\r\n", sum);
+	snprintf(s.rain, sizeof(s.rain), "Acc %d.%03d mm, EventAcc %d.%03d mm, TotalAcc %d.%03d mm, RInt %d.%03d mmph\r\n",
+		s.values[2] / 1000, s.values[2] % 1000, s.values[3] / 1000, s.values[3] % 1000, s.values[4] / 1000,
+		s.values[4] % 1000, s.values[5] / 1000, s.values[5] % 1000);
+	for (uint8_t i=0; i<7; i++) {
+		s.stats[i] = (benchRandom() % 100000) / 317.0f;
+	}
+}
+
+// the 6 readings as in buildFrame(); returns the bytes written
+template <class Encoding>
+static uint8_t encodeReadings(const int32_t *v, uint8_t *out) {
+	uint8_t *p = out;
+	p += Encoding::fixed16((int16_t)v[0], WIND_DIR_SCALE, p);
+	p += Encoding::fixed16((int16_t)v[1], WIND_SPEED_SCALE, p);
+	for (uint8_t i=2; i<6; i++) {
+		p += Encoding::fixed32(v[i], RAIN_SCALE, p);
+	}
+	return (uint8_t)(p - out);
+}
+
+// the wind statistics as in GET_WIND_STATS
+template <class Encoding>
+static uint8_t encodeStats(const float *v, uint8_t *out) {
+	uint8_t *p = out;
+	for (uint8_t i=0; i<7; i++) {
+		p += (i == 4) ? Encoding::real32(v[i], statsScale[i], p) : Encoding::real16(v[i], statsScale[i], p);
+	}
+	return (uint8_t)(p - out);
+}
+
+static double decodeFloat(const uint8_t *p) {
+	floatbyte v;
+	memcpy(v.b, p, 4);
+	return v.f;
+}
+
+static double decodeFixed(const uint8_t *p, uint8_t size, int32_t scale) {
+	int32_t v = (size == 2) ? (int16_t)(p[0] | (p[1] << 8))
+		: (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+	return (double)v / scale;
+}
+
+// decode what encodeReadings / encodeStats wrote and compare with the source values
+template <class Encoding>
+static bool roundTrip(const EncodingSample &s) {
+	const bool isFloat = (Encoding::size16 == 4);
+	uint8_t buffer[64];
+	encodeReadings<Encoding>(s.values, buffer);
+	const uint8_t *p = buffer;
+	for (uint8_t i=0; i<6; i++) {
+		uint8_t size = (i < 2) ? Encoding::size16 : Encoding::size32;
+		double expected = (double)s.values[i] / sampleScale[i];
+		double got = isFloat ? decodeFloat(p) : decodeFixed(p, size, sampleScale[i]);
+		if (fabs(got - expected) > (isFloat ? 1e-6 * fabs(expected) : 0)) {
+			return false;
+		}
+		p += size;
+	}
+	encodeStats<Encoding>(s.stats, buffer);
+	p = buffer;
+	for (uint8_t i=0; i<7; i++) {
+		uint8_t size = (i == 4) ? Encoding::size32 : Encoding::size16;
+		double got = isFloat ? decodeFloat(p) : decodeFixed(p, size, statsScale[i]);
+		if (fabs(got - s.stats[i]) > 0.5 / statsScale[i] + 1e-6 * fabs(s.stats[i])) {
+			return false;
+		}
+		p += size;
+	}
+	return true;
+}
+
+static volatile uint8_t encodingSink;
+
+template <class Encoding>
+static void timeEncoding(const char *name, const std::vector<EncodingSample> &samples, uint32_t passes,
+		double parseNs) {
+	uint8_t buffer[64];
+	uint8_t readingBytes=0, statsBytes=0;
+	uint64_t start = hostNs();
+	for (uint32_t pass=0; pass<passes; pass++) {
+		for (size_t i=0; i<samples.size(); i++) {
+			readingBytes = encodeReadings<Encoding>(samples[i].values, buffer);
+			encodingSink = buffer[readingBytes - 1];
+		}
+	}
+	double readingNs = (double)(hostNs() - start) / ((double)passes * samples.size());
+	start = hostNs();
+	for (uint32_t pass=0; pass<passes; pass++) {
+		for (size_t i=0; i<samples.size(); i++) {
+			statsBytes = encodeStats<Encoding>(samples[i].stats, buffer);
+			encodingSink = buffer[statsBytes - 1];
+		}
+	}
+	double statsNs = (double)(hostNs() - start) / ((double)passes * samples.size());
+	printf("  %-14s parse %6.1f ns + encode %5.1f ns (%u bytes) = %6.1f ns per sample; wind statistics %5.1f ns "
+		"(%u bytes)\n", name, parseNs, readingNs, readingBytes, parseNs + readingNs, statsNs, statsBytes);
+}
+
+int encodingBench(int argc, char **argv) {
+	uint32_t count = (argc > 2) ? (uint32_t)atoi(argv[2]) : 10000;
+	benchState = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1;
+	const uint32_t passes=20;
+
+	std::vector<EncodingSample> samples(count);
+	for (uint32_t i=0; i<count; i++) {
+		makeSample(samples[i]);
+	}
+
+	// parse: check the scaled integers, then time the parsers on their own
+	MWVParser windParser;
+	RG15Parser rainParser;
+	uint32_t wrong=0;
+	for (uint32_t i=0; i<count; i++) {
+		const EncodingSample &s = samples[i];
+		bool wind=false, rain=false;
+		for (const char *p=s.wind; *p; p++) wind |= windParser.feed(*p);
+		for (const char *p=s.rain; *p; p++) rain |= rainParser.feed(*p);
+		const MWVSentence &w = windParser.sentence();
+		const RG15Reading &r = rainParser.reading();
+		if (!wind || !rain || w.angle != s.values[0] || w.speed != s.values[1] || r.acc != s.values[2]
+				|| r.eventAcc != s.values[3] || r.totalAcc != s.values[4] || r.rInt != s.values[5]) {
+			wrong++;
+		}
+		if (!roundTrip<FloatEncoding>(s) || !roundTrip<FixedEncoding>(s)) {
+			wrong++;
+		}
+	}
+	uint32_t decoded=0;
+	uint64_t start = hostNs();
+	for (uint32_t pass=0; pass<passes; pass++) {
+		for (size_t i=0; i<samples.size(); i++) {
+			for (const char *p=samples[i].wind; *p; p++) decoded += windParser.feed(*p);
+			for (const char *p=samples[i].rain; *p; p++) decoded += rainParser.feed(*p);
+		}
+	}
+	double parseNs = (double)(hostNs() - start) / ((double)passes * count);
+
+	printf("encoding: %u samples x %u, %u decoded (%u wrong after parsing or a round trip)\n", count, passes,
+		decoded, wrong);
+	timeEncoding<FloatEncoding>("FloatEncoding", samples, passes, parseNs);
+	timeEncoding<FixedEncoding>("FixedEncoding", samples, passes, parseNs);
+	printf("  this build sends %s\n", (WIND_VALUE_SIZE == 2) ? "FixedEncoding (PM2_FIXED_POINT)" : "FloatEncoding");
+	return (wrong == 0 && decoded == 2 * passes * count) ? 0 : 1;
+}
+
+#endif
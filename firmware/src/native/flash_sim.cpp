@@ -0,0 +1,115 @@
+#ifndef ARDUINO
+
+/*
+	Flash log simulator (program flash [checkpoints] [power fail 1 in N]).
+	Writes the given number of rain checkpoints (default 100000) through FlashLog to the simulated NVM,
+	cutting the power part way through a write about once every N checkpoints (default 50). After every
+	power cut the log is recovered as at boot and must return the last checkpoint that completed (or the one
+	being written, if the cut came after its magic byte was programmed).
+	Reports the write amplification, the wear of each row, the CPU stall per checkpoint and the work
+	done by recovery.
+*/
+
+#include "../PM2_flashlog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLASH_SIM_CYCLES_PER_SLOT 800	// estimated SAMD21 cycles to read and check one slot (16 byte CRC-8)
+
+static uint32_t simRandom() {
+	static uint32_t state=12345;
+	state = state * 1664525 + 1013904223;
+	return state >> 8;
+}
+
+int flashSim(int argc, char **argv) {
+	uint32_t checkpoints = (argc > 2) ? (uint32_t)atoi(argv[2]) : 100000;
+	uint32_t failRate = (argc > 3) ? (uint32_t)atoi(argv[3]) : 50;
+	uint32_t rowErases[FLASHLOG_ROWS];
+	memset(rowErases, 0, sizeof(rowErases));
+	memset(flashLogArea, 0, sizeof(flashLogArea));		// as left by a firmware upload
+	memset(&nativeFlash, 0, sizeof(nativeFlash));
+
+	FlashLog log;
+	bool found = log.begin();
+	printf("first boot: %s, %u slot reads\n", found ? "checkpoint found" : "no checkpoint", log.recoverReads);
+
+	int32_t total=0;
+	int32_t event=0;
+	FlashCheckpoint committed={0, 0, 0};
+	uint32_t written=0, cuts=0, errors=0, maxReads=0;
+	uint64_t stall=0, maxStall=0;
+	while (written < checkpoints) {
+		total += 10 + simRandom() % 200;
+		event = (simRandom() % 8 == 0) ? 0 : event + 10;
+		bool cut = failRate != 0 && simRandom() % failRate == 0;
+		if (cut) {
+			nativeFlashPowerFail = simRandom() % (FLASHLOG_SLOT_SIZE + 4);		// the slot or its magic byte
+		}
+		const uint8_t *erased = nativeFlash.lastErased;
+		uint32_t erases = nativeFlash.erases;
+		uint64_t start = nativeClock();
+		bool ok = log.save(total, event);
+		uint64_t took = nativeClock() - start;
+		stall += took;
+		if (took > maxStall) maxStall = took;
+		if (nativeFlash.erases != erases || nativeFlash.lastErased != erased) {
+			rowErases[(nativeFlash.lastErased - flashLogArea) / HAL_FLASH_ROW]++;
+		}
+		if (nativeFlashFailed) {
+			// power cut: reboot and check that recovery returns the last complete checkpoint
+			nativeFlashFailed=false;
+			nativeFlashPowerFail=-1;
+			cuts++;
+			log.begin();
+			if (log.recoverReads > maxReads) maxReads = log.recoverReads;
+			const FlashCheckpoint &last = log.last();
+			bool previous = last.seq == committed.seq && last.totalacc == committed.totalacc
+				&& last.eventacc == committed.eventacc;
+			bool saving = last.seq == committed.seq + 1 && last.totalacc == total && last.eventacc == event;
+			if (!previous && !saving) {
+				errors++;
+			}
+			if (saving) {
+				committed = last;		// cut in the magic byte's write after it was programmed: the checkpoint stands
+				written++;
+			}
+			continue;
+		}
+		if (!ok) {
+			errors++;
+			continue;
+		}
+		committed = log.last();
+		written++;
+	}
+	log.begin();
+	if (log.last().totalacc != committed.totalacc) {
+		errors++;
+	}
+
+	uint32_t logical = written * 8;		// totalacc + eventacc
+	printf("%u checkpoints, %u power cuts, %u recovery errors, %u slots skipped, %u rule violations\n",
+		written, cuts, errors, log.skippedSlots, nativeFlash.violations);
+	printf("programmed %u bytes in %u page writes, %u row erases (%u bytes)\n", nativeFlash.bytesProgrammed,
+		nativeFlash.pageWrites, nativeFlash.erases, nativeFlash.erases * HAL_FLASH_ROW);
+	printf("write amplification: %.2f programmed, %.2f erased bytes per logical byte\n",
+		(double)nativeFlash.bytesProgrammed / logical, (double)nativeFlash.erases * HAL_FLASH_ROW / logical);
+	uint32_t minWear=0xFFFFFFFF, maxWear=0;
+	printf("row erases:");
+	for (uint8_t row=0; row<FLASHLOG_ROWS; row++) {
+		printf(" %u", rowErases[row]);
+		if (rowErases[row] < minWear) minWear = rowErases[row];
+		if (rowErases[row] > maxWear) maxWear = rowErases[row];
+	}
+	printf(" (min %u max %u): %.1f checkpoints per erase of a row\n", minWear, maxWear,
+		maxWear ? (double)written / maxWear : 0.0);
+	printf("CPU stall per checkpoint: mean %.2f mS, max %.2f mS\n", stall / 1000.0 / (written + cuts),
+		maxStall / 1000.0);
+	printf("recovery: max %u slot reads (bound %u), ~%.0f uS at 48 MHz\n", maxReads,
+		FLASHLOG_ROWS + FLASHLOG_SLOTS_PER_ROW - 1, maxReads * FLASH_SIM_CYCLES_PER_SLOT / 48.0);
+	return errors ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,943 @@
+#ifndef ARDUINO
+
+/*
+	Native (Linux) build of the PM#2 firmware: the drivers, the scheduler and the I2C command dispatcher
+	run against scripted mock sensors on the simulated serial ports of native/PM2_hal_native.cpp.
+
+	Usage: program [seconds] [master interval seconds] [rain mode] [gauge baud] [cable limit] [gauge reset seconds]
+		[gauge unplug seconds]
+	Simulates the board for the given time (default 60 s) while a mock master reads GET_ALL every
+	master interval (default 10 s) and prints the decoded frame. If a rain mode is given the master
+	first sends SET_RAIN_MODE with it (0 polled, 1 continuous).
+	The mock gauge powers up at gauge baud (default 9600). A cable limit (baud) corrupts every byte sent faster
+	than that. If a gauge reset time is given the gauge goes back to 9600 baud at that time, as after a power
+	cycle; together these exercise the baud rate negotiation and fallback. A gauge baud of 0 leaves the gauge
+	unplugged until the reset time (or for good), which exercises the background bring-up (PM2_bringup.h). If an
+	unplug time is given the gauge stops answering at that time: the link fails and the bring-up looks for it again.
+	The master's first request is sent as soon as setup() returns, to time the first ACK.
+
+	Usage: program flash [checkpoints] [power fail 1 in N]		runs the flash log simulator (native/flash_sim.cpp)
+
+	Usage: program overlap [sample sets] [wind reply delay uS] [rain reply delay uS]
+	Times the acquisition of each sample set with the gauge in polled mode (see overlapTest).
+
+	Usage: program replay <wind capture> <rain capture> [seconds] [sample interval mS] [master period mS]
+	Replays captured sensor output at the wire's timing under a scripted master (native/replay_bench.cpp).
+
+	Usage: program rainwindows [storms] [seed]		checks the rolling rain windows (native/rainwindow_sim.cpp)
+
+	Usage: program windstats [series] [seed]		checks the wind statistics (native/windstats_sim.cpp)
+
+	Usage: program stream [seconds] [rate Hz]
+	Streams MWV sentences from the mock anemometer, then switches back to polled mode half way (see streamTest).
+
+	Usage: program config		checks the configuration registers (see configTest)
+
+	Usage: program mwv [sentences] [seed]		checks and times the MWV parser (native/mwv_bench.cpp)
+
+	Usage: program rg15 [passes]		checks the RG-15 decoder and times it against sscanf (native/rg15_bench.cpp)
+
+	Usage: program encoding [samples] [seed]		times parsing and encoding under each policy (native/encoding_bench.cpp)
+*/
+
+#include "../PM2_driver.h"
+#include "../PM2_uartdma.h"
+#include "../PM2_metrics.h"
+#include "../PM2_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+SerialPort windPort("wind", 38400);
+SerialPort rainPort("rain", 9600);
+CalypsoWind wind(&windPort);
+RadeonRain rain(&rainPort);
+
+// ---------------------------------------------------------------- mock Calypso ULP
+
+#define CALYPSO_REPLY_DELAY 2000	// uS from the end of the poll to the first byte of the reply
+#define CALYPSO_CLOCK_PPM 200		// streaming: the sensor's clock runs this much slow
+#define CALYPSO_GARBLED 100			// streaming: 1 sentence in this many arrives with a bad checksum
+
+static uint32_t calypsoDelay=CALYPSO_REPLY_DELAY;
+static uint8_t calypsoRate=0;		// Hz while streaming, 0 in query mode
+static double calypsoNext=0;		// uS: when the next streamed sentence is due
+static uint32_t calypsoStreamed=0;	// sentences streamed
+static uint32_t calypsoGarbled=0;	// of which garbled
+
+// the MWV sentence for time t (S), a slowly veering wind with some gusts
+static void calypsoSentence(double t, char *sentence, size_t size) {
+	double dir = fmod(350.0 + 30.0 * sin(t / 50.0) + 360.0, 360.0);
+	double speed = 4.0 + 2.0 * sin(t / 7.0) + ((int)t % 37 == 0 ? 5.0 : 0.0);
+	char body[48];
+	snprintf(body, sizeof(body), "WIMWV,%.1f,R,%.2f,M,A", dir, speed);
+	uint8_t checksum=0;
+	for (const char *p=body; *p; p++) {
+		checksum ^= (uint8_t)*p;
+	}
+	snprintf(sentence, size, "$%s*%02X\r\n", body, checksum);
+}
+
+static void calypsoTick(SerialPort &port);
+
+static void calypsoRespond(SerialPort &port, const char *line) {
+	unsigned rate;
+	unsigned checksum;
+	if (sscanf(line, "$ULPO,%u*%2X", &rate, &checksum) == 2) {
+		uint8_t expected=0;
+		for (const char *p=line + 1; *p != '*'; p++) {
+			expected ^= (uint8_t)*p;
+		}
+		if (checksum == expected && rate <= 4) {
+			calypsoRate=(uint8_t)rate;
+			calypsoNext = nativeClock() + calypsoDelay;
+			calypsoTick(port);
+		}
+		return;
+	}
+	if (strcmp(line, "$ULPI*00") != 0) {
+		return;
+	}
+	char sentence[64];
+	calypsoSentence(nativeClock() / 1e6, sentence, sizeof(sentence));
+	port.inject(sentence, calypsoDelay);
+}
+
+// streaming: queue the next sentence as soon as the line is free, to start at its time on the sensor's clock
+static void calypsoTick(SerialPort &port) {
+	uint64_t busy;
+	if (calypsoRate == 0 || port.nextDelivery(busy)) {
+		return;
+	}
+	uint64_t now = nativeClock();
+	uint32_t delay = (calypsoNext > now) ? (uint32_t)(calypsoNext - now) : 0;
+	char sentence[64];
+	calypsoSentence((now + delay) / 1e6, sentence, sizeof(sentence));
+	if (rand() % CALYPSO_GARBLED == 0) {
+		sentence[8] ^= 0x01;			// a bit error in the angle: the checksum fails
+		calypsoGarbled++;
+	}
+	port.inject(sentence, delay);
+	calypsoStreamed++;
+	calypsoNext += 1e6 / calypsoRate * (1.0 + CALYPSO_CLOCK_PPM / 1e6);
+}
+
+// ---------------------------------------------------------------- mock RG-15
+
+#define RG15_REPLY_DELAY 1000		// uS
+
+static uint32_t rg15Delay=RG15_REPLY_DELAY;
+static bool rg15Connected=true;
+
+#define RG15_RESOLUTION 0.01		// mm (high resolution)
+
+static double rainOffset=0;			// gauge total at the last 'O'
+static double rainLast=0;			// total reported in the previous message
+static bool rg15Continuous=false;
+static const uint32_t rg15Rates[7] = {1200, 2400, 4800, 9600, 19200, 38400, 57600};
+
+// a shower every 10 minutes lasting 3 minutes at 6 mm/hr
+static double rainModel(double &intensity) {
+	double t = nativeClock() / 1e6;
+	double minute = fmod(t / 60.0, 10.0);
+	intensity = (minute < 3.0) ? 6.0 : 0.0;
+	return floor(t / 600.0) * 0.3 + (minute < 3.0 ? minute / 60.0 * 6.0 : 0.3);
+}
+
+// the 'R' message; the totals are reported at the gauge resolution
+static void rg15Message(SerialPort &port) {
+	double intensity;
+	double total = floor((rainModel(intensity) - rainOffset) / RG15_RESOLUTION) * RG15_RESOLUTION;
+	char reply[96];
+	snprintf(reply, sizeof(reply), "Acc %.2f mm, EventAcc %.2f mm, TotalAcc %.2f mm, RInt %.2f mmph\r\n",
+		total - rainLast, total, total, intensity);
+	rainLast=total;
+	port.inject(reply, rg15Delay);
+}
+
+static void rg15Respond(SerialPort &port, const char *line) {
+	if (line[0] == 'B') {
+		const char *p = line + 1;
+		while (*p == ' ') p++;
+		char reply[24];
+		if (*p >= '0' && *p <= '6' && p[1] == '\0') {
+			uint32_t rate = rg15Rates[*p - '0'];
+			snprintf(reply, sizeof(reply), "Baud %u\r\n", rate);
+			port.inject(reply, rg15Delay);
+			port.nextDeviceBaud=rate;		// switches once the reply has gone
+			return;
+		} else {
+			snprintf(reply, sizeof(reply), "Baud %u\r\n", port.deviceBaud);
+		}
+		port.inject(reply, rg15Delay);
+		return;
+	}
+	if (line[0] == '\0' || line[1] != '\0') {
+		return;
+	}
+	switch (line[0]) {
+		case 'P': rg15Continuous=false; port.inject("p\r\n", rg15Delay); break;
+		case 'C': rg15Continuous=true; port.inject("c\r\n", rg15Delay); break;
+		case 'H': port.inject("h\r\n", rg15Delay); break;
+		case 'M': port.inject("m\r\n", rg15Delay); break;
+		case 'O': {
+			double intensity;
+			rainOffset=rainModel(intensity);
+			rainLast=0;
+			break;
+		}
+		case 'R': rg15Message(port); break;
+	}
+}
+
+// continuous mode: send a message whenever the accumulation has changed by the resolution
+static void rg15Tick(SerialPort &port) {
+	double intensity;
+	if (rg15Continuous && rainModel(intensity) - rainOffset - rainLast >= RG15_RESOLUTION) {
+		rg15Message(port);
+	}
+}
+
+// the end of burst handlers (TC3_Handler / TC4_Handler on the board)
+static void windRx() {
+	METRIC_START(start);
+	wind.serviceRx();
+	METRIC_STOP(METRIC_WIND_IDLE_ISR, start);
+}
+
+static void rainRx() {
+	METRIC_START(start);
+	rain.serviceRx();
+	METRIC_STOP(METRIC_RAIN_IDLE_ISR, start);
+}
+
+// ---------------------------------------------------------------- mock master
+
+static uint32_t readLong(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// GET_METRICS: the counters, then the histogram of every timer that has run (build with -D PM2_METRICS)
+static void masterMetrics() {
+	uint8_t cmd[2] = { GET_METRICS, 0 };
+	uint8_t head[4 + 4 * METRIC_REPORT_COUNTERS];
+	i2cSlave.masterWrite(cmd, 2);
+	if (i2cSlave.masterRead(head, sizeof(head)) != sizeof(head)) {
+		printf("GET_METRICS: bad header\n");
+		return;
+	}
+	printf("GET_METRICS: %u timers, %u buckets, %u cycles/uS; timeouts wind %u rain %u, parse failures wind %u rain %u, "
+		"i2c timeouts %u nacks %u unknown %u\n", head[0], head[1], head[3], readLong(head + 4), readLong(head + 8),
+		readLong(head + 12), readLong(head + 16), readLong(head + 20), readLong(head + 24), readLong(head + 28));
+	uint8_t cyclesPerUs = head[3];
+	for (uint8_t timer=1; timer<=head[0]; timer++) {
+		uint8_t h[16 + 4 * METRIC_BUCKETS];
+		cmd[1] = timer;
+		i2cSlave.masterWrite(cmd, 2);
+		if (i2cSlave.masterRead(h, sizeof(h)) != sizeof(h) || readLong(h) == 0) {
+			continue;
+		}
+		uint64_t sum = readLong(h + 8) | ((uint64_t)readLong(h + 12) << 32);
+		printf("  timer %u: n %u mean %.0f max %u uS, buckets", timer - 1, readLong(h),
+			(double)sum / readLong(h) / cyclesPerUs, readLong(h + 4) / cyclesPerUs);
+		for (uint8_t b=0; b<METRIC_BUCKETS; b++) {
+			printf(" %u", readLong(h + 16 + 4 * b));
+		}
+		printf("\n");
+	}
+}
+
+#ifdef PM2_FIXED_POINT
+static double decodeValue(const uint8_t *p, uint8_t size, double scale) {
+	int32_t v = (size == 2) ? (int16_t)(p[0] | (p[1] << 8)) : (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+	return v / scale;
+}
+#else
+static double decodeValue(const uint8_t *p, uint8_t /* size */, double /* scale */) {
+	floatbyte v;
+	memcpy(v.b, p, 4);
+	return v.f;
+}
+#endif
+
+static void masterPoll() {
+	uint8_t cmd = GET_ALL;
+	uint8_t data[FRAME_SIZE];
+	i2cSlave.masterWrite(&cmd, 1);
+	uint8_t n = i2cSlave.masterRead(data, FRAME_SIZE);
+	if (n != FRAME_SIZE || crc8(data, FRAME_SIZE - 1) != data[FRAME_SIZE - 1]) {
+		printf("%10.3f  GET_ALL: bad frame (%u bytes)\n", nativeClock() / 1e6, n);
+		return;
+	}
+	const uint8_t *p = data + 5;
+	double dir = decodeValue(p, WIND_VALUE_SIZE, WIND_DIR_SCALE); p += WIND_VALUE_SIZE;
+	double speed = decodeValue(p, WIND_VALUE_SIZE, WIND_SPEED_SCALE); p += WIND_VALUE_SIZE;
+	double acc = decodeValue(p, RAIN_VALUE_SIZE, RAIN_SCALE); p += RAIN_VALUE_SIZE;
+	double eventAcc = decodeValue(p, RAIN_VALUE_SIZE, RAIN_SCALE); p += RAIN_VALUE_SIZE;
+	double totalAcc = decodeValue(p, RAIN_VALUE_SIZE, RAIN_SCALE); p += RAIN_VALUE_SIZE;
+	double rInt = decodeValue(p, RAIN_VALUE_SIZE, RAIN_SCALE);
+	uint32_t sequence = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+	printf("%10.3f  #%u status %02X  wind %6.1f deg %6.2f m/s  rain acc %.3f event %.3f total %.3f mm  %.3f mm/hr\n",
+		nativeClock() / 1e6, sequence, data[4], dir, speed, acc, eventAcc, totalAcc, rInt);
+}
+
+static uint32_t getLong(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+	Page through the whole history the way the master would and report the I2C bus time it takes:
+	per chunk a 2 byte write (address + HISTORY_READ) and a read of address + HISTORY_CHUNK_SIZE bytes,
+	9 clocks per byte plus start / stop.
+*/
+static void masterDownload() {
+	uint8_t seek[5] = { HISTORY_SEEK, 0, 0, 0, 0 };
+	uint8_t ack=0;
+	i2cSlave.masterWrite(seek, 5);
+	i2cSlave.masterRead(&ack, 1);
+	uint32_t records=0;
+	uint32_t chunks=0;
+	uint32_t expected=0;
+	uint32_t gaps=0;
+	uint8_t chunk[HISTORY_CHUNK_SIZE];
+	uint8_t first[HISTORY_RECORD_SIZE] = {};		// all zero if no record was read
+	uint8_t last[HISTORY_RECORD_SIZE] = {};
+	for (;;) {
+		uint8_t cmd = HISTORY_READ;
+		i2cSlave.masterWrite(&cmd, 1);
+		if (i2cSlave.masterRead(chunk, HISTORY_CHUNK_SIZE) != HISTORY_CHUNK_SIZE
+				|| crc8(chunk, HISTORY_CHUNK_SIZE - 1) != chunk[HISTORY_CHUNK_SIZE - 1]) {
+			printf("HISTORY_READ: bad chunk\n");
+			return;
+		}
+		chunks++;
+		uint32_t seq = getLong(chunk);
+		uint8_t count = chunk[4];
+		if (count == 0) {
+			break;
+		}
+		if (expected != 0 && seq != expected) {
+			gaps++;
+		}
+		if (records == 0) {
+			memcpy(first, chunk + 7, HISTORY_RECORD_SIZE);
+		}
+		memcpy(last, chunk + 7 + (count - 1) * HISTORY_RECORD_SIZE, HISTORY_RECORD_SIZE);
+		records += count;
+		expected = seq + count;
+	}
+	uint32_t clocks = chunks * ((2 * 9 + 2) + (1 + HISTORY_CHUNK_SIZE) * 9 + 2);
+	printf("history: %u records in %u chunks, %u gaps; first t=%u flags %02X, last t=%u flags %02X\n",
+		records, chunks, gaps, getLong(first), first[4], getLong(last), last[4]);
+	for (uint32_t khz=100; khz<=400; khz+=300) {
+		double seconds = clocks / (khz * 1000.0);
+		printf("  bus time at %u kHz: %.1f mS (%.0f records/s, %.1f kB/s of records)\n", khz, seconds * 1000,
+			records / seconds, records * HISTORY_RECORD_SIZE / seconds / 1000);
+	}
+}
+
+// the same sequence as setup() on the board (also used by native/replay_bench.cpp)
+void boardSetup() {
+	alert.begin();
+	i2cSlave.begin(I2C_ADDRESS);
+	i2cSlave.onReceive(receiveEvent);
+	i2cSlave.onRequest(requestEvent);
+	i2cOnlineTime=halMicros();
+
+	windPort.setResponder(calypsoRespond);
+	windPort.wakeSource=WAKE_WIND;
+	rainPort.wakeSource=WAKE_RAIN;
+	windPort.setRxHandler(windRx);
+	if (rg15Connected) {
+		rainPort.setResponder(rg15Respond);
+	}
+	rainPort.setRxHandler(rainRx);
+	windPort.rxDma(UART_DMA_IDLE_BYTES);		// received as on the board (PM2_uartdma.h)
+	rainPort.rxDma(UART_DMA_IDLE_BYTES);
+
+	wind.begin(&windPort);
+	rain.begin(&rainPort);
+	windRunning=true;
+	rainRunning=true;
+	startTasks();
+}
+
+static const char * const sensorStates[] = { "probing", "ready", "failed" };
+
+// GET_SENSOR_STATUS, decoded
+static void masterSensorStatus() {
+	uint8_t cmd = GET_SENSOR_STATUS;
+	uint8_t status[20];
+	i2cSlave.masterWrite(&cmd, 1);
+	if (i2cSlave.masterRead(status, sizeof(status)) != sizeof(status)) {
+		return;
+	}
+	printf("GET_SENSOR_STATUS:");
+	for (uint8_t sensor=0; sensor<2; sensor++) {
+		const uint8_t *p = status + 6 * sensor;
+		printf(" %s %s (%u failed", sensor ? "rain" : "wind", p[0] <= SENSOR_FAILED ? sensorStates[p[0]] : "?", p[1]);
+		if (readLong(p + 2)) {
+			printf(", ready after %u mS)", readLong(p + 2));
+		} else {
+			printf(")");
+		}
+	}
+	printf(", I2C up after %u uS, first ACK after %u uS\n", readLong(status + 12), readLong(status + 16));
+}
+
+// ---------------------------------------------------------------- overlap timing test
+
+/*
+	Both sensors are polled at the same sample instants (PM2_sampleclock.h) and their replies are received
+	concurrently on the two SERCOMs. For every sample set this measures, from the simulated clock:
+		skew		between the wind and rain polls (the instants the two values were sampled)
+		window		from the first poll to the second reading published (the acquisition time of the set)
+		sequential	the two round trips added up: the acquisition time if the sensors were read one after the other
+	Fails (exit status 1) if any set was sampled more than OVERLAP_MAX_SKEW apart or a poll was not answered.
+*/
+#define OVERLAP_MAX_SKEW 10000		// uS
+
+/*
+	Sample both sensors within the given limits, set as the master would: SET_CONFIG writes each sensor's
+	sampling registers (a response timeout that would no longer fit in the minimum interval is cut to half of
+	it) and the config task puts them in force on its next run. Also used by the replay benchmark.
+*/
+bool masterSampling(const SamplingLimits &limits) {
+	ConfigBlock block;
+	config.block.read(block);
+	const uint8_t sensors[2] = { CONFIG_WIND_MIN, CONFIG_RAIN_MIN };
+	for (uint8_t i=0; i<2; i++) {
+		const uint16_t *r = block.reg + sensors[i];
+		uint32_t pollMs = limits.minInterval / 1000 / (r[4] + 1);
+		uint16_t timeout = (r[3] < pollMs) ? r[3] : (uint16_t)(pollMs / 2);
+		uint16_t reg[5] = { (uint16_t)(limits.minInterval / SAMPLING_UNIT), (uint16_t)(limits.maxInterval / SAMPLING_UNIT),
+			limits.hysteresis, timeout, r[4] };
+		uint8_t cmd[12] = { SET_CONFIG, sensors[i] };
+		for (uint8_t j=0; j<5; j++) {
+			cmd[2 + 2*j] = (uint8_t)reg[j];
+			cmd[3 + 2*j] = (uint8_t)(reg[j] >> 8);
+		}
+		uint8_t ack=0;
+		i2cSlave.masterWrite(cmd, sizeof(cmd));
+		i2cSlave.masterRead(&ack, 1);
+		if (ack != 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int overlapTest(int argc, char **argv) {
+	uint32_t sets = (argc > 2) ? (uint32_t)atoi(argv[2]) : 100;
+	calypsoDelay = (argc > 3) ? (uint32_t)atoi(argv[3]) : CALYPSO_REPLY_DELAY;
+	rg15Delay = (argc > 4) ? (uint32_t)atoi(argv[4]) : RG15_REPLY_DELAY;
+	rainPort.deviceBaud=9600;
+	boardSetup();
+	rain.setMode(RAIN_POLLED);
+	SamplingLimits fixed = { readingRefreshInterval, readingRefreshInterval, 1 };	// every set polls both sensors
+	masterSampling(fixed);
+	halLog.enabled=false;
+
+	windreading windSet;
+	RainReading rainSet;
+	uint32_t windCount=wind.snapshot.read(windSet);
+	uint32_t rainCount=rain.snapshot.read(rainSet);
+	uint32_t windDone=0, rainDone=0;
+	bool windNew=false, rainNew=false;
+	uint32_t measured=0, under=0;
+	uint32_t maxSkew=0, maxWindow=0;
+	uint64_t sumSkew=0, sumWindow=0, sumSequential=0;
+	uint64_t end = nativeClock() + (uint64_t)(sets + 2) * readingRefreshInterval;
+	while (measured < sets && nativeClock() < end) {
+		scheduler.runDue();
+		scheduler.idle();
+		uint32_t now=halMicros();
+		// a reading counts once it answers the latest poll (not the publish made when the mode was switched)
+		uint32_t count=wind.snapshot.read(windSet);
+		if (count != windCount) {
+			windCount=count;
+			windDone=now;
+			windNew = !wind.awaitingReply && now != wind.sampleTime;
+		}
+		count=rain.snapshot.read(rainSet);
+		if (count != rainCount) {
+			rainCount=count;
+			rainDone=now;
+			rainNew = rain.mode == RAIN_POLLED && !rain.awaitingReply && now != rain.sampleTime;
+		}
+		if ((windNew && (int32_t)(windDone - wind.sampleTime) < 0) || (rainNew && (int32_t)(rainDone - rain.sampleTime) < 0)) {
+			windNew = rainNew = false;		// one of the sensors has been polled again without answering
+		}
+		if (wind.readingInterval != readingRefreshInterval || rain.readingInterval != readingRefreshInterval) {
+			windNew = rainNew = false;		// bring-up, or the fixed rate is not in force yet
+		}
+		if (!(windNew && rainNew)) {
+			continue;
+		}
+		windNew=false;
+		rainNew=false;
+		bool windFirst = (int32_t)(rain.sampleTime - wind.sampleTime) >= 0;
+		uint32_t first = windFirst ? wind.sampleTime : rain.sampleTime;
+		uint32_t skew = windFirst ? rain.sampleTime - first : wind.sampleTime - first;
+		uint32_t last = ((int32_t)(rainDone - windDone) > 0) ? rainDone : windDone;
+		uint32_t window = last - first;
+		uint32_t sequential = (windDone - wind.sampleTime) + (rainDone - rain.sampleTime);
+		measured++;
+		if (skew < OVERLAP_MAX_SKEW) under++;
+		if (skew > maxSkew) maxSkew=skew;
+		if (window > maxWindow) maxWindow=window;
+		sumSkew += skew;
+		sumWindow += window;
+		sumSequential += sequential;
+	}
+	if (measured == 0) {
+		printf("overlap: no sample set completed\n");
+		return 1;
+	}
+	printf("overlap: %u sample sets, reply delay wind %u uS rain %u uS, gauge at %u baud\n", measured, calypsoDelay,
+		rg15Delay, rain.baudRate());
+	printf("  poll skew    avg %6.0f uS  max %6u uS  (%u of %u sets under %u uS)\n", (double)sumSkew / measured,
+		maxSkew, under, measured, OVERLAP_MAX_SKEW);
+	printf("  window       avg %6.0f uS  max %6u uS\n", (double)sumWindow / measured, maxWindow);
+	printf("  sequential   avg %6.0f uS  (%.1f %% saved)\n", (double)sumSequential / measured,
+		100.0 - 100.0 * sumWindow / sumSequential);
+	printf("  timeouts     wind %u rain %u\n", wind.pollTimeouts, rain.pollTimeouts);
+	return (under == measured && measured == sets && wind.pollTimeouts == 0 && rain.pollTimeouts == 0) ? 0 : 1;
+}
+
+// ---------------------------------------------------------------- wind streaming test
+
+/*
+	The master sets the anemometer streaming (SET_WIND_MODE) and back to polled half way. The sensor's clock is
+	CALYPSO_CLOCK_PPM slow and it garbles 1 sentence in CALYPSO_GARBLED, so GET_WIND_MODE should show that drift
+	and one gap per garbled sentence. The consumer must have seen every reading, streamed or polled.
+	Fails (exit status 1) if the drift is off by more than STREAM_MAX_DRIFT_ERROR or a sentence went unaccounted.
+*/
+#define STREAM_MAX_DRIFT_ERROR 50	// ppm
+
+static uint32_t consumed=0;
+static uint32_t consumedLate=0;		// handed to the consumer more than a period after it was decoded
+
+static void countSample(const WindSample &sample) {
+	consumed++;
+	if (wind.mode == WIND_STREAMING && halMicros() - sample.time > 1000000 / wind.streamRate) {
+		consumedLate++;
+	}
+}
+
+static void streamRun(uint64_t until) {
+	while (nativeClock() < until) {
+		scheduler.runDue();
+		eventLog.drain();
+		scheduler.idle();
+		calypsoTick(windPort);
+	}
+}
+
+static bool setWindMode(uint8_t mode, uint8_t rate) {
+	uint8_t cmd[3] = { SET_WIND_MODE, mode, rate };
+	uint8_t ack=0;
+	i2cSlave.masterWrite(cmd, 3);
+	i2cSlave.masterRead(&ack, 1);
+	return ack == 1;
+}
+
+static int streamTest(int argc, char **argv) {
+	uint32_t seconds = (argc > 2) ? (uint32_t)atoi(argv[2]) : 600;
+	uint8_t rate = (argc > 3) ? (uint8_t)atoi(argv[3]) : WIND_STREAM_RATE;
+	rainPort.deviceBaud=9600;
+	srand(1);
+	boardSetup();
+	halLog.enabled=false;
+	wind.onSample(countSample);
+	streamRun(nativeClock() + 5000000);		// bring-up
+	uint32_t polledBefore = wind.parserStats().sentences;
+	if (!setWindMode(WIND_STREAMING, rate)) {
+		printf("stream: SET_WIND_MODE %u Hz was Nacked\n", rate);
+		return 1;
+	}
+	uint32_t consumedBefore=consumed;
+	streamRun(nativeClock() + (uint64_t)seconds * 500000);
+	uint32_t streamedConsumed = consumed - consumedBefore;
+	setWindMode(WIND_POLLED, 0);
+	streamRun(nativeClock() + (uint64_t)seconds * 500000);
+
+	uint8_t cmd = GET_WIND_MODE;
+	uint8_t reply[22];
+	i2cSlave.masterWrite(&cmd, 1);
+	if (i2cSlave.masterRead(reply, sizeof(reply)) != sizeof(reply)) {
+		printf("stream: GET_WIND_MODE failed\n");
+		return 1;
+	}
+	uint32_t samples=readLong(reply + 2);
+	uint32_t gaps=readLong(reply + 6);
+	uint32_t overruns=readLong(reply + 10);
+	uint32_t restarts=readLong(reply + 14);
+	int32_t drift=(int32_t)readLong(reply + 18);
+	uint32_t polled = wind.parserStats().sentences - polledBefore - samples;
+	printf("stream: %u S at %u Hz, then %u S polled; mode now %u\n", seconds / 2, rate, seconds / 2, reply[0]);
+	printf("  sensor       %u sentences streamed, %u garbled (clock %d ppm)\n", calypsoStreamed, calypsoGarbled,
+		CALYPSO_CLOCK_PPM);
+	printf("  GET_WIND_MODE %u samples, %u gaps, %u ring overruns, %u restarts, drift %d ppm\n", samples, gaps,
+		overruns, restarts, drift);
+	printf("  consumer     %u streamed samples (%u late), %u polled readings, %u timeouts\n", streamedConsumed,
+		consumedLate, consumed - streamedConsumed, wind.pollTimeouts);
+	// the sentence in flight at each switch may fall either side of it
+	uint32_t good = calypsoStreamed - calypsoGarbled;
+	bool accounted = samples <= good && samples + 2 >= good && gaps + 1 >= calypsoGarbled && gaps <= calypsoGarbled + 1;
+	bool driftOk = drift > CALYPSO_CLOCK_PPM - STREAM_MAX_DRIFT_ERROR && drift < CALYPSO_CLOCK_PPM + STREAM_MAX_DRIFT_ERROR;
+	return (accounted && driftOk && overruns == 0 && restarts == 0 && streamedConsumed == samples && polled > 0) ? 0 : 1;
+}
+
+// ---------------------------------------------------------------- configuration registers
+
+/*
+	The master writes the configuration registers (PM2_config.h) the way a site would be tuned:
+		- writes that would leave the block invalid are Nacked and change nothing
+		- a valid block is in force within a moment, without a reset (refresh interval, sampling, timeouts)
+		- with the anemometer unplugged each sample instant sends the poll and its retries, all timed out
+		- SAVE_CONFIG keeps the block across a reset; a save cut short by a power failure leaves the previous one
+		- the longest gust window streamed at the fastest rate averages all of its samples
+	Fails (exit status 1) on the first check that does not hold.
+*/
+static bool configCheck(bool ok, const char *what) {
+	printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static bool setConfig(uint8_t first, const uint16_t *values, uint8_t count) {
+	uint8_t cmd[2 + 2 * CONFIG_REGISTERS] = { SET_CONFIG, first };
+	for (uint8_t i=0; i<count; i++) {
+		cmd[2 + 2*i] = (uint8_t)values[i];
+		cmd[3 + 2*i] = (uint8_t)(values[i] >> 8);
+	}
+	uint8_t ack=0;
+	i2cSlave.masterWrite(cmd, 2 + 2 * count);
+	i2cSlave.masterRead(&ack, 1);
+	return ack == 1;
+}
+
+// GET_CONFIG: the registers; returns the saved flag (-1 if the reply was short)
+static int getConfig(uint16_t *values) {
+	uint8_t cmd = GET_CONFIG;
+	uint8_t reply[2 * CONFIG_REGISTERS + 1];
+	i2cSlave.masterWrite(&cmd, 1);
+	if (i2cSlave.masterRead(reply, sizeof(reply)) != sizeof(reply)) {
+		return -1;
+	}
+	for (uint8_t i=0; i<CONFIG_REGISTERS; i++) {
+		values[i] = reply[2*i] | (reply[2*i + 1] << 8);
+	}
+	return reply[2 * CONFIG_REGISTERS];
+}
+
+static bool saveConfig() {
+	uint8_t cmd = SAVE_CONFIG;
+	uint8_t ack=0;
+	i2cSlave.masterWrite(&cmd, 1);
+	i2cSlave.masterRead(&ack, 1);
+	streamRun(nativeClock() + 1000000);
+	return ack == 1;
+}
+
+#define GUST_TEST_SAMPLES 160
+
+static WindSample gustSamples[GUST_TEST_SAMPLES];	// streamed samples since the statistics were last reset
+static uint16_t gustRecorded=0;
+
+static void recordGust(const WindSample &sample) {
+	if (gustRecorded < GUST_TEST_SAMPLES) {
+		gustSamples[gustRecorded++]=sample;
+	}
+}
+
+// highest mean speed over the window ending at each recorded sample; inWindow: samples in the last one
+static double referenceGust(uint32_t windowMs, uint16_t &inWindow) {
+	double gust=0;
+	for (uint16_t i=0; i<gustRecorded; i++) {
+		double sum=0;
+		uint16_t n=0;
+		for (uint16_t j=i + 1; j-- > 0 && gustSamples[i].time - gustSamples[j].time < windowMs * 1000; ) {
+			sum += (double)gustSamples[j].reading.windspeed / WIND_SPEED_SCALE;
+			n++;
+		}
+		if (i == 0 || sum / n > gust) gust = sum / n;
+		inWindow=n;
+	}
+	return gust;
+}
+
+static int configTest(int /* argc */, char ** /* argv */) {
+	rainPort.deviceBaud=9600;
+	boardSetup();
+	halLog.enabled=false;
+	streamRun(nativeClock() + 5000000);		// bring-up
+	bool ok=true;
+	printf("config:\n");
+
+	uint16_t r[CONFIG_REGISTERS];
+	const uint16_t defaults[CONFIG_REGISTERS] = { 50, 10, 100, 6, 100, 0, 3000, 20, 600, 3, 1000, 0 };
+	int saved = getConfig(r);
+	ok &= configCheck(saved == 0 && memcmp(r, defaults, sizeof(r)) == 0, "GET_CONFIG: compiled in defaults, not saved");
+
+	const uint16_t zero=0, lowMax=5, slowTimeout=1000, gust=20000;
+	const uint16_t retries[2] = { 400, 2 };		// wind timeout 400 mS, 2 retries: 1.2 S > 1 S minimum
+	bool nacked = !setConfig(CONFIG_REFRESH, &zero, 1) && !setConfig(CONFIG_WIND_MAX, &lowMax, 1)
+		&& !setConfig(CONFIG_WIND_TIMEOUT, &slowTimeout, 1) && !setConfig(CONFIG_WIND_TIMEOUT, retries, 2)
+		&& !setConfig(CONFIG_WIND_GUST, &gust, 1) && !setConfig(CONFIG_REGISTERS, &zero, 1)
+		&& !setConfig(CONFIG_RAIN_RETRIES, retries, 2);
+	getConfig(r);
+	ok &= configCheck(nacked && memcmp(r, defaults, sizeof(r)) == 0, "invalid writes Nacked, registers unchanged");
+
+	const uint16_t site[CONFIG_REGISTERS] = { 20, 5, 20, 2, 150, 2, 5000, 10, 100, 2, 300, 1 };
+	ok &= configCheck(setConfig(CONFIG_REFRESH, site, CONFIG_REGISTERS), "SET_CONFIG of the whole block Acked");
+	streamRun(nativeClock() + 3000000);
+	SamplingLimits windLimits;
+	wind.rate.limits.read(windLimits);
+	ok &= configCheck(readingRefreshInterval == 2000000 && wind.responseTimeout == 150 && wind.retries == 2
+		&& wind.stats.gustWindow == 5000 && rain.responseTimeout == 300 && rain.retries == 1
+		&& windLimits.minInterval == 500000 && windLimits.maxInterval == 2000000 && windLimits.hysteresis == 2,
+		"in force without a reset");
+	ok &= configCheck(wind.readingInterval <= 2000000 && rain.readingInterval <= 10000000,
+		"sensors sampling within the new limits");
+
+	uint32_t timeouts=wind.pollTimeouts;
+	uint32_t written=windPort.bytesWritten;
+	windPort.setResponder(nullptr);			// anemometer unplugged
+	streamRun(nativeClock() + 20000000);
+	while (wind.awaitingReply) {
+		streamRun(nativeClock() + 10000);	// end on a sample instant's last retry, not part way through
+	}
+	uint32_t polls = (windPort.bytesWritten - written) / 10;		// "$ULPI*00\r\n"
+	timeouts = wind.pollTimeouts - timeouts;
+	printf("  unplugged for 20 S: %u polls, %u timed out\n", polls, timeouts);
+	ok &= configCheck(polls > 0 && polls % 3 == 0 && timeouts + 3 >= polls && timeouts <= polls,
+		"each sample instant sends the poll and 2 retries");
+	windPort.setResponder(calypsoRespond);
+	streamRun(nativeClock() + 3000000);
+
+	ok &= configCheck(saveConfig() && getConfig(r) == 1 && memcmp(r, site, sizeof(r)) == 0, "SAVE_CONFIG: saved flag set");
+	Config rebooted;
+	ConfigBlock loaded;
+	ok &= configCheck(rebooted.begin(loaded) && memcmp(loaded.reg, site, sizeof(site)) == 0, "loaded after a reset");
+
+	const uint16_t refresh=100;
+	setConfig(CONFIG_REFRESH, &refresh, 1);
+	ok &= configCheck(getConfig(r) == 0, "changed after the save: saved flag cleared");
+	nativeFlashPowerFail=12;
+	saveConfig();
+	nativeFlashPowerFail=-1;
+	Config cut;
+	ok &= configCheck(nativeFlashFailed && cut.begin(loaded) && memcmp(loaded.reg, site, sizeof(site)) == 0,
+		"save cut short by a power failure: previous block loaded");
+	nativeFlashFailed=false;
+	saveConfig();
+	Config again;
+	ok &= configCheck(again.begin(loaded) && loaded.reg[CONFIG_REFRESH] == refresh && getConfig(r) == 1,
+		"saved again");
+
+	const uint8_t sampling[7] = { SET_SAMPLING, 1, 30, 0, 200, 0, 4 };		// rain 3 - 20 S, hysteresis 4
+	uint8_t ack=0;
+	i2cSlave.masterWrite(sampling, sizeof(sampling));
+	i2cSlave.masterRead(&ack, 1);
+	streamRun(nativeClock() + 1000000);
+	SamplingLimits rainLimits;
+	rain.rate.limits.read(rainLimits);
+	ok &= configCheck(ack == 1 && getConfig(r) == 0 && r[CONFIG_RAIN_MIN] == 30 && r[CONFIG_RAIN_MAX] == 200
+		&& r[CONFIG_RAIN_HYSTERESIS] == 4 && rainLimits.minInterval == 3000000 && rainLimits.hysteresis == 4,
+		"SET_SAMPLING: in the registers and in force");
+	const uint16_t windHysteresis=3;
+	setConfig(CONFIG_WIND_HYSTERESIS, &windHysteresis, 1);
+	streamRun(nativeClock() + 1000000);
+	rain.rate.limits.read(rainLimits);
+	ok &= configCheck(rainLimits.minInterval == 3000000 && rainLimits.maxInterval == 20000000,
+		"not undone by a later SET_CONFIG");
+
+	const uint16_t longGust=CONFIG_GUST_MAX;
+	bool streaming = setConfig(CONFIG_WIND_GUST, &longGust, 1) && setWindMode(WIND_STREAMING, WIND_STREAM_RATE_MAX);
+	streamRun(nativeClock() + 2000000);
+	wind.onSample(recordGust);
+	wind.requestStatsReset();		// applied to the next sample, the first one recorded
+	gustRecorded=0;
+	streamRun(nativeClock() + 30000000);
+	WindStatistics windStats;
+	wind.statsSnapshot.read(windStats);
+	uint16_t inWindow=0;
+	double reference = referenceGust(CONFIG_GUST_MAX, inWindow);
+	printf("  %u S gust at %u Hz: %.3f m/s (%u samples, %u in the window; reference %.3f m/s)\n",
+		CONFIG_GUST_MAX / 1000, WIND_STREAM_RATE_MAX, windStats.gust, windStats.count, inWindow, reference);
+	ok &= configCheck(streaming && windStats.count == gustRecorded && inWindow >= CONFIG_GUST_MAX / 1000 * WIND_STREAM_RATE_MAX
+		&& fabs(windStats.gust - reference) < 0.01, "longest gust window at the fastest streaming rate");
+	printf("config: %s (%u flash row erases)\n", ok ? "all checks passed" : "FAILED", nativeFlash.erases);
+	return ok ? 0 : 1;
+}
+
+int flashSim(int argc, char **argv);
+int replayBench(int argc, char **argv);
+int rainWindowSim(int argc, char **argv);
+int windStatsSim(int argc, char **argv);
+int mwvBench(int argc, char **argv);
+int rg15Bench(int argc, char **argv);
+int encodingBench(int argc, char **argv);
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "flash") == 0) {
+		return flashSim(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "overlap") == 0) {
+		return overlapTest(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "replay") == 0) {
+		return replayBench(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "rainwindows") == 0) {
+		return rainWindowSim(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "windstats") == 0) {
+		return windStatsSim(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "stream") == 0) {
+		return streamTest(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "config") == 0) {
+		return configTest(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "mwv") == 0) {
+		return mwvBench(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "rg15") == 0) {
+		return rg15Bench(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "encoding") == 0) {
+		return encodingBench(argc, argv);
+	}
+	uint32_t seconds = (argc > 1) ? (uint32_t)atoi(argv[1]) : 60;
+	uint32_t masterInterval = (argc > 2) ? (uint32_t)atoi(argv[2]) : 10;
+	int rainMode = (argc > 3) ? atoi(argv[3]) : -1;		// SET_RAIN_MODE argument sent by the master at the start
+	rainPort.deviceBaud = (argc > 4) ? (uint32_t)atoi(argv[4]) : 9600;
+	if (rainPort.deviceBaud == 0) {
+		rg15Connected=false;		// plugged in at the reset time, if any
+		rainPort.deviceBaud=9600;
+	}
+	uint64_t resetTime = (argc > 6) ? (uint64_t)atoi(argv[6]) * 1000000 : 0;
+	uint64_t unplugTime = (argc > 7) ? (uint64_t)atoi(argv[7]) * 1000000 : 0;
+	rainPort.lineLimit = (argc > 5) ? (uint32_t)atoi(argv[5]) : 0;
+
+	boardSetup();
+	masterSensorStatus();			// the master's first request, straight after reset
+	halLog.println();
+	if (rainMode >= 0) {
+		uint8_t cmd[2] = { SET_RAIN_MODE, (uint8_t)rainMode };
+		uint8_t ack=0;
+		i2cSlave.masterWrite(cmd, 2);
+		i2cSlave.masterRead(&ack, 1);
+		printf("SET_RAIN_MODE %d: %s\n", rainMode, ack ? "Ack" : "Nack");
+	}
+
+	halLog.enabled=false;		// firmware debug output off while the master runs
+	uint64_t end = nativeClock() + (uint64_t)seconds * 1000000;
+	uint64_t nextPoll = nativeClock() + (uint64_t)masterInterval * 1000000;
+	nativeI2CWakeAt=nextPoll;
+	while (nativeClock() < end) {
+		METRIC_START(start);
+		scheduler.runDue();
+		METRIC_STOP(METRIC_LOOP, start);
+		eventLog.drain();
+		scheduler.idle();
+		rg15Tick(rainPort);
+		calypsoTick(windPort);
+		if (resetTime != 0 && nativeClock() >= resetTime) {
+			rainPort.deviceBaud=9600;
+			rainPort.setResponder(rg15Respond);
+			resetTime=0;
+		}
+		if (unplugTime != 0 && nativeClock() >= unplugTime) {
+			rainPort.setResponder(nullptr);
+			rg15Continuous=false;
+			unplugTime=0;
+		}
+		if (nativeClock() >= nextPoll) {
+			if (!history.timeSet()) {
+				uint8_t cmd[5] = { SET_TIME, 0x00, 0xF1, 0x53, 0x65 };	// 1700000000
+				uint8_t ack=0;
+				i2cSlave.masterWrite(cmd, 5);
+				i2cSlave.masterRead(&ack, 1);
+			}
+			masterPoll();
+			nextPoll += (uint64_t)masterInterval * 1000000;
+			nativeI2CWakeAt=nextPoll;
+		}
+	}
+	halLog.enabled=true;
+	masterDownload();
+
+	printf("\nwind: %u sentences, %u checksum errors, %u timeouts\n", wind.parserStats().sentences,
+		wind.parserStats().checksumErrors, wind.pollTimeouts);
+	printf("rain: %u readings, %u rejected lines, %u timeouts, %u ring overruns, %u bytes sent to the gauge\n",
+		rain.parserStats().readings, rain.parserStats().rejected, rain.pollTimeouts, rain.ringOverruns,
+		rainPort.bytesWritten);
+	uint8_t cmd = GET_RAIN_LINK;
+	uint8_t link[12];
+	i2cSlave.masterWrite(&cmd, 1);
+	if (i2cSlave.masterRead(link, sizeof(link)) == sizeof(link)) {
+		uint32_t v[3];
+		for (uint8_t i=0; i<3; i++) {
+			v[i] = link[4*i] | (link[4*i+1] << 8) | (link[4*i+2] << 16) | ((uint32_t)link[4*i+3] << 24);
+		}
+		printf("GET_RAIN_LINK: %u baud, probe %u uS, %u fallbacks\n", v[0], v[1], v[2]);
+	}
+	cmd = GET_POWER_STATS;
+	uint8_t power[4 * (WAKE_SOURCES + 4)];
+	i2cSlave.masterWrite(&cmd, 1);
+	if (i2cSlave.masterRead(power, sizeof(power)) == sizeof(power)) {
+		uint32_t v[WAKE_SOURCES + 4];
+		for (uint8_t i=0; i<WAKE_SOURCES + 4; i++) {
+			v[i] = power[4*i] | (power[4*i+1] << 8) | (power[4*i+2] << 16) | ((uint32_t)power[4*i+3] << 24);
+		}
+		printf("GET_POWER_STATS: standby %u of %u mS (%.1f %%), wakes rtc %u wind %u rain %u i2c %u other %u, "
+			"wake latency %u uS, %u bytes lost\n", v[1], v[0], v[0] ? v[1] * 100.0 / v[0] : 0.0,
+			v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+	}
+	cmd = GET_UART_STATS;
+	uint8_t uart[40];
+	i2cSlave.masterWrite(&cmd, 1);
+	if (i2cSlave.masterRead(uart, sizeof(uart)) == sizeof(uart)) {
+		for (uint8_t port=0; port<2; port++) {
+			uint32_t v[5];
+			for (uint8_t i=0; i<5; i++) {
+				const uint8_t *p = uart + 20 * port + 4 * i;
+				v[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+			}
+			printf("GET_UART_STATS %s: %u bytes in %u interrupts (%.1f bytes each), %u overruns, %u framing errors, "
+				"%u ring overruns\n", port ? "rain" : "wind", v[0], v[1], v[1] ? (double)v[0] / v[1] : 0.0, v[2], v[3],
+				v[4]);
+		}
+	}
+	cmd = GET_SAMPLING;
+	uint8_t sampling[26];
+	i2cSlave.masterWrite(&cmd, 1);
+	if (i2cSlave.masterRead(sampling, sizeof(sampling)) == sizeof(sampling)) {
+		for (uint8_t sensor=0; sensor<2; sensor++) {
+			const uint8_t *p = sampling + 13 * sensor;
+			printf("GET_SAMPLING %s: every %u mS (%u - %u mS, hysteresis %u)\n", sensor ? "rain" : "wind",
+				readLong(p), readLong(p + 4), readLong(p + 8), p[12]);
+		}
+	}
+	for (uint8_t w=0; w<3; w++) {
+		cmd = GET_RAIN_1MIN + w;
+		uint8_t window[2 * RAIN_VALUE_SIZE];
+		i2cSlave.masterWrite(&cmd, 1);
+		if (i2cSlave.masterRead(window, sizeof(window)) == sizeof(window)) {
+			printf("%s: %.3f mm, peak %.1f mm/hr\n", commandName(cmd), decodeValue(window, RAIN_VALUE_SIZE, RAIN_SCALE),
+				decodeValue(window + RAIN_VALUE_SIZE, RAIN_VALUE_SIZE, RAIN_SCALE));
+		}
+	}
+	masterMetrics();
+	masterSensorStatus();
+	eventLog.drain();
+	printf("flash: %u checkpoints (last total %d uM, event %d uM), %u row erases\n", flashLog.saves,
+		flashLog.last().totalacc, flashLog.last().eventacc, nativeFlash.erases);
+	scheduler.printStats();
+	return 0;
+}
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef ARDUINO
+
+/*
+	MWV parser benchmark (program mwv [sentences] [seed]).
+	Builds random MWV sentences the way the Calypso sends them (angle 0 - 359.9, speed 0 - 60 m/s with 1 - 3
+	decimals, M / N / K units, with and without the status field, CR LF or LF) plus one sentence in 16 with a
+	known fault: a bad checksum, status V, a missing field, a truncated sentence restarted by '$', or a field too
+	long. Every sentence is fed byte by byte through MWVParser (PM2_MWVparser.h) and the decoded angle and speed
+	are checked against the values written, and each fault against the counter it must raise.
+	The time is host time per sentence and per byte (and TSC cycles on x86): compare builds on the same machine;
+	on the board the SERCOM1 path costs several times more per byte.
+*/
+
+#include "../PM2_MWVparser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MWV_BENCH_TSC
+#endif
+
+struct MwvCase {
+	char text[MWV_MAX_SENTENCE + 16];
+	int32_t angle;			// deci-degrees expected
+	int32_t speed;			// hundredths of the unit expected
+	uint8_t fault;			// MwvFault
+};
+
+enum MwvFault : uint8_t {
+	MWV_OK,
+	MWV_BAD_CHECKSUM,		// checksumErrors
+	MWV_STATUS_V,			// formatErrors
+	MWV_MISSING_FIELD,		// formatErrors
+	MWV_TRUNCATED,			// truncated (the sentence that follows is good)
+	MWV_LONG_FIELD,			// overruns
+	MWV_FAULTS
+};
+
+static uint32_t benchState=1;
+
+static uint32_t benchRandom() {
+	benchState = benchState * 1664525 + 1013904223;
+	return benchState >> 8;
+}
+
+static uint64_t hostNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t hostCycles() {
+#ifdef MWV_BENCH_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// append "*hh" and the line end to the body that starts with '$'
+static void finishSentence(char *text, bool badChecksum) {
+	uint8_t sum=0;
+	for (const char *p=text + 1; *p; p++) {
+		sum ^= (uint8_t)*p;
+	}
+	if (badChecksum) {
+		sum ^= 0x5A;
+	}
+	size_t n = strlen(text);
+	snprintf(text + n, 8, "*%02X%s", sum, (benchRandom() % 4) ? "\r\n" : "\n");
+}
+
+static void makeCase(MwvCase &c) {
+	static const char units[3] = { 'M', 'N', 'K' };
+	static const int32_t powers[4] = { 1, 10, 100, 1000 };
+	c.angle = benchRandom() % 3600;
+	uint8_t decimals = 1 + benchRandom() % 3;
+	int32_t raw = benchRandom() % (60 * powers[decimals] + 1);		// 0 - 60 m/s at that many decimals
+	c.speed = (decimals >= 2) ? raw / powers[decimals - 2] : raw * 10;		// extra decimals are dropped, not rounded
+	c.fault = (benchRandom() % 16 == 0) ? (uint8_t)(1 + benchRandom() % (MWV_FAULTS - 1)) : (uint8_t)MWV_OK;
+	char unit = units[benchRandom() % 3];
+	bool status = (benchRandom() % 2) || c.fault == MWV_STATUS_V;
+	char speed[24];
+	snprintf(speed, sizeof(speed), "%d.%0*d", raw / powers[decimals], decimals, raw % powers[decimals]);
+	if (c.fault == MWV_LONG_FIELD) {
+		strcpy(speed, "0.00000000001");
+	}
+	char *p = c.text;
+	if (c.fault == MWV_TRUNCATED) {
+		p += snprintf(p, 16, "$WIMWV,12");			// cut off by the next sentence
+	}
+	if (c.fault == MWV_MISSING_FIELD) {
+		snprintf(p, MWV_MAX_SENTENCE, "$WIMWV,%d.%d,R,%s", c.angle / 10, c.angle % 10, speed);
+	} else {
+		snprintf(p, MWV_MAX_SENTENCE, "$WIMWV,%d.%d,R,%s,%c%s", c.angle / 10, c.angle % 10, speed, unit,
+			!status ? "" : (c.fault == MWV_STATUS_V) ? ",V" : ",A");
+	}
+	finishSentence(p, c.fault == MWV_BAD_CHECKSUM);
+}
+
+int mwvBench(int argc, char **argv) {
+	uint32_t count = (argc > 2) ? (uint32_t)atoi(argv[2]) : 100000;
+	benchState = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1;
+
+	std::vector<MwvCase> cases(count);
+	size_t bytes=0;
+	uint32_t expected[MWV_FAULTS] = {};
+	for (uint32_t i=0; i<count; i++) {
+		makeCase(cases[i]);
+		bytes += strlen(cases[i].text);
+		expected[cases[i].fault]++;
+	}
+
+	// correctness pass: every good sentence decodes to the values written, every fault is counted where it belongs
+	MWVParser parser;
+	uint32_t wrong=0;
+	for (uint32_t i=0; i<count; i++) {
+		const MwvCase &c = cases[i];
+		bool accepted=false;
+		for (const char *p=c.text; *p; p++) {
+			accepted |= parser.feed(*p);
+		}
+		bool good = (c.fault == MWV_OK || c.fault == MWV_TRUNCATED);
+		if (accepted != good || (good && (parser.sentence().angle != c.angle || parser.sentence().speed != c.speed))) {
+			if (wrong < 10) {
+				printf("mwv: wrong result for %s", c.text);
+			}
+			wrong++;
+		}
+	}
+	MWVParserStats s = parser.stats();		// copied: the timing pass counts on
+	uint32_t goodSentences = expected[MWV_OK] + expected[MWV_TRUNCATED];
+	bool countsOk = s.sentences == goodSentences && s.checksumErrors == expected[MWV_BAD_CHECKSUM]
+		&& s.formatErrors == expected[MWV_STATUS_V] + expected[MWV_MISSING_FIELD]
+		&& s.truncated == expected[MWV_TRUNCATED] && s.overruns == expected[MWV_LONG_FIELD];
+
+	// timing pass: the same stream again, nothing but the parser in the loop
+	const uint8_t passes=10;
+	uint32_t decoded=0;
+	uint64_t start = hostNs();
+	uint64_t startCycles = hostCycles();
+	for (uint8_t pass=0; pass<passes; pass++) {
+		for (uint32_t i=0; i<count; i++) {
+			for (const char *p=cases[i].text; *p; p++) {
+				decoded += parser.feed(*p);
+			}
+		}
+	}
+	uint64_t cycles = hostCycles() - startCycles;
+	uint64_t ns = hostNs() - start;
+	uint64_t fed = (uint64_t)count * passes;
+
+	printf("mwv: %u sentences (%zu bytes), %u with a fault; seed %s\n", count, bytes, count - expected[MWV_OK],
+		(argc > 3) ? argv[3] : "1");
+	printf("  decoded %u, checksum errors %u, format errors %u, truncated %u, overruns %u: %s\n", s.sentences,
+		s.checksumErrors, s.formatErrors, s.truncated, s.overruns, countsOk ? "as expected" : "WRONG");
+	printf("  %u sentences decoded to the wrong values or wrongly accepted / rejected\n", wrong);
+	printf("  %.1f ns per sentence, %.2f ns per byte", (double)ns / fed, (double)ns / (bytes * passes));
+	if (cycles != 0) {
+		printf(", %.0f TSC cycles per sentence", (double)cycles / fed);
+	}
+	printf(" (%u decoded in %u passes)\n", decoded, passes);
+	return (wrong == 0 && countsOk) ? 0 : 1;
+}
+
+#endif
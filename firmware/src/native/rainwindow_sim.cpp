@@ -0,0 +1,174 @@
+#ifndef ARDUINO
+
+/*
+	Rain window check (program rainwindows [storms] [seed]).
+	Replays synthetic storms through RainWindows (PM2_rainwindows.h) as the rain task would feed it: the gauge
+	accumulates in steps of RAIN_RESOLUTION and is read every 2 - 5 s while it rains and every 10 - 60 s while it
+	is dry. The storms are convective cells (a fast rise to 50 - 150 mm/hr and a slower decay), hours of steady
+	stratiform rain, bursts of showers and drizzle, separated by dry spells of up to 3 hours; millis() starts
+	10 minutes before it wraps. After every reading each window is checked against a brute force sum over all
+	the readings kept since the start, bucketed the same way: totals and peaks must match exactly. The difference
+	from a true sliding window (sum over exactly the last 1 / 10 / 60 minutes) is reported to show what the
+	bucketing costs.
+*/
+
+#include "../PM2_rainwindows.h"
+#include "../PM2_Raindriver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+struct SimReading {
+	uint64_t ms;			// since the first reading
+	int32_t acc;			// uM
+};
+
+static uint32_t simState=1;
+
+static uint32_t simRandom() {
+	simState = simState * 1664525 + 1013904223;
+	return simState >> 8;
+}
+
+static uint32_t simBetween(uint32_t low, uint32_t high) {
+	return low + simRandom() % (high - low + 1);
+}
+
+/*
+	Rain rate (uM/hr) of a storm at t seconds from its start, 0 after it ends; shape and scale are drawn per storm.
+*/
+struct Storm {
+	uint8_t kind;
+	uint32_t length;		// s
+	uint32_t rise;			// s (convective)
+	uint32_t peak;			// uM/hr
+	uint32_t burst;			// s (showers: wet then dry in each cycle)
+	uint32_t gap;			// s
+
+	void draw() {
+		kind = simRandom() % 4;
+		switch (kind) {
+			case 0: rise = simBetween(300, 900); length = rise + simBetween(1200, 2400); peak = simBetween(50000, 150000); break;
+			case 1: length = simBetween(3600, 10800); peak = simBetween(1000, 5000); break;
+			case 2: burst = simBetween(120, 600); gap = simBetween(300, 1800); length = (burst + gap) * simBetween(2, 6);
+					peak = simBetween(10000, 40000); break;
+			default: burst = simBetween(600, 1800); gap = simBetween(60, 900); length = (burst + gap) * simBetween(1, 4);
+					peak = simBetween(200, 1000); break;
+		}
+	}
+
+	uint32_t rate(uint32_t t) const {
+		if (t >= length) return 0;
+		switch (kind) {
+			case 0: return (t < rise) ? (uint32_t)((uint64_t)peak * t / rise)
+						: (uint32_t)((uint64_t)peak * (length - t) / (length - rise));
+			case 1: return peak;
+			default: return (t % (burst + gap) < burst) ? peak : 0;
+		}
+	}
+};
+
+static const char * const windowNames[RAIN_WINDOWS] = { "1 min", "10 min", "60 min" };
+
+int rainWindowSim(int argc, char **argv) {
+	uint32_t storms = (argc > 2) ? (uint32_t)atoi(argv[2]) : 200;
+	simState = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1;
+
+	RainWindows windows;
+	std::vector<SimReading> readings;
+	uint32_t startMs = 0xFFFFFFFFu - 600000;		// millis() wraps 10 minutes in
+	uint64_t ms=0;					// since the first reading (RainWindows counts from there)
+	bool first=true;
+	uint64_t gaugeFraction=0;		// uM * 3600000 not yet reported (rate in uM/hr times mS)
+	uint32_t checks=0, mismatches=0;
+	uint64_t sumError[RAIN_WINDOWS] = {0, 0, 0};
+	uint32_t maxError[RAIN_WINDOWS] = {0, 0, 0};
+	int32_t maxTotal[RAIN_WINDOWS] = {0, 0, 0};
+	int32_t maxPeak[RAIN_WINDOWS] = {0, 0, 0};
+	int64_t rained=0;
+
+	for (uint32_t s=0; s<storms; s++) {
+		Storm storm;
+		storm.draw();
+		uint32_t dry = simBetween(0, 10800);
+		uint32_t stormEnd = storm.length + dry;
+		for (uint32_t t=0; t<stormEnd; ) {
+			bool raining = storm.rate(t) > 0;
+			uint32_t step = raining ? simBetween(2000, 5000) : simBetween(10000, 60000);		// mS to the next reading
+			// the gauge accumulates (in 100 mS steps here) and reports whole RAIN_RESOLUTION steps
+			for (uint32_t i=0; i<step; i+=100) {
+				gaugeFraction += (uint64_t)storm.rate(t + i / 1000) * 100;
+			}
+			uint64_t perStep = (uint64_t)RAIN_RESOLUTION * 3600000;
+			int32_t acc = (int32_t)(gaugeFraction / perStep) * RAIN_RESOLUTION;
+			gaugeFraction %= perStep;
+			if (!first) {
+				ms += step;
+			}
+			first=false;
+			t += (step + 999) / 1000;
+			rained += acc;
+
+			SimReading r = { ms, acc };
+			readings.push_back(r);
+			windows.add(startMs + (uint32_t)ms, acc);
+			RainWindowResult got;
+			windows.results.read(got);
+
+			uint32_t now = (uint32_t)(ms / 1000);
+			for (uint8_t w=0; w<RAIN_WINDOWS; w++) {
+				uint32_t width = RainWindows::bucketSeconds[w];
+				uint32_t current = now / width;
+				uint32_t oldest = (current + 1 >= RainWindows::buckets[w]) ? current + 1 - RainWindows::buckets[w] : 0;
+				int32_t total=0, sliding=0;
+				int32_t bucketSum[RAIN_WINDOW_BUCKETS] = {};
+				uint64_t span = (uint64_t)width * RainWindows::buckets[w] * 1000;	// mS: 1, 10 or 60 minutes
+				for (size_t j=readings.size(); j-- > 0; ) {
+					uint32_t bucket = (uint32_t)(readings[j].ms / 1000) / width;
+					bool inSpan = readings[j].ms + span > ms;
+					if (bucket < oldest && !inSpan) {
+						break;
+					}
+					if (bucket >= oldest) {
+						total += readings[j].acc;
+						bucketSum[bucket - oldest] += readings[j].acc;
+					}
+					if (inSpan) {
+						sliding += readings[j].acc;
+					}
+				}
+				int32_t wettest=0;
+				for (uint8_t b=0; b<RAIN_WINDOW_BUCKETS; b++) {
+					if (bucketSum[b] > wettest) wettest = bucketSum[b];
+				}
+				int32_t peak = (int32_t)((int64_t)wettest * 3600 / width);
+				checks++;
+				if (got.total[w] != total || got.peak[w] != peak) {
+					if (mismatches < 10) {
+						printf("mismatch at %u s, %s window: total %d (reference %d), peak %d (reference %d)\n",
+							now, windowNames[w], got.total[w], total, got.peak[w], peak);
+					}
+					mismatches++;
+				}
+				uint32_t error = (uint32_t)abs(total - sliding);
+				sumError[w] += error;
+				if (error > maxError[w]) maxError[w] = error;
+				if (total > maxTotal[w]) maxTotal[w] = total;
+				if (peak > maxPeak[w]) maxPeak[w] = peak;
+			}
+		}
+	}
+
+	printf("rain windows: %u storms, %.1f hours, %zu readings, %.1f mm of rain\n", storms, ms / 3600000.0,
+		readings.size(), rained / 1000.0);
+	printf("  %u window checks against the brute force reference: %u mismatches\n", checks, mismatches);
+	for (uint8_t w=0; w<RAIN_WINDOWS; w++) {
+		printf("  %-6s  %2u x %3u s buckets  largest total %7.2f mm  peak %6.1f mm/hr  vs a true sliding window: "
+			"mean %.3f mm, max %.2f mm\n", windowNames[w], RainWindows::buckets[w], RainWindows::bucketSeconds[w],
+			maxTotal[w] / 1000.0, maxPeak[w] / 1000.0, (double)sumError[w] / readings.size() / 1000.0,
+			maxError[w] / 1000.0);
+	}
+	return mismatches == 0 ? 0 : 1;
+}
+
+#endif
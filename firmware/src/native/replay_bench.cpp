@@ -0,0 +1,408 @@
+#ifndef ARDUINO
+
+/*
+	Serial replay benchmark (program replay <wind capture> <rain capture> [seconds] [sample interval mS] [master period mS]).
+
+	Replays captured sensor output through the firmware with the timing of the wire. Each poll is answered with the
+	next line of the capture, wrapping round at the end. The bytes arrive one by one at 38400 baud from the
+	anemometer and 9600 baud from the gauge (the rate negotiation is capped at 9600 here). Malformed, truncated and
+	doubled lines therefore reach the parsers exactly as they were captured. A capture is the raw byte stream of
+	one sensor, one reply per line (CR LF as sent); native/captures/ holds two samples written to look like the
+	field logs: clean readings with one of each known fault every few dozen lines.
+
+	Both sensors are polled every sample interval (default 1000 mS). Meanwhile a scripted master sends the next
+	command of replayScript every master period (default 100 mS, default length 600 s); the script reads every
+	reading and status command. Reported:
+		latency		virtual time from the last byte of a reply on the wire to the value being published
+					(GET_WIND_* / GET_RAIN_*) and to the GET_ALL frame that carries it
+		NACKs		master transactions answered with a Nack, short, or with a bad CRC
+		CPU			host time spent in the firmware: receive handlers, I2C handlers and tasks, per call and as a
+					fraction of the simulated time. The virtual clock stands still while firmware code runs, so these
+					are host nanoseconds: compare them between builds on the same machine, not with the board.
+		worst ISR	the longest receiveEvent and requestEvent of each command, in the same host nanoseconds
+		GET_ALL		reads of a frame with a new reading, reads of one already read, and new frames replaced before
+					the master read them
+	A master period of 0 runs a master that waits for the data ready line (SET_ALERT ALERT_NEW_SET, PM2_alert.h)
+	and reads GET_ALL each time it is asserted, instead of the script.
+*/
+
+#include "../PM2_driver.h"
+#include "../PM2_log.h"
+#include "../PM2_metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern SerialPort windPort;
+extern SerialPort rainPort;
+void boardSetup();					// native/main_native.cpp
+bool masterSampling(const SamplingLimits &limits);
+
+#define REPLAY_WIND_DELAY 2000		// uS from the end of the poll to the first byte of the reply
+#define REPLAY_RAIN_DELAY 1000		// uS
+#define REPLAY_LINE 256				// longest reply replayed (longer lines are cut)
+
+// ---------------------------------------------------------------- captures
+
+struct Capture {
+	char *data;
+	size_t size;
+	size_t pos;
+	uint32_t replayed;			// replies sent
+};
+
+static Capture windCapture;
+static Capture rainCapture;
+
+static bool loadCapture(Capture &capture, const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		printf("replay: cannot open %s\n", path);
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	capture.data = (char *)malloc(size > 0 ? size : 1);
+	capture.size = (size > 0) ? fread(capture.data, 1, size, f) : 0;
+	capture.pos = 0;
+	capture.replayed = 0;
+	fclose(f);
+	if (capture.size == 0) {
+		printf("replay: %s is empty\n", path);
+		return false;
+	}
+	return true;
+}
+
+// send the next line of the capture (through its line feed) as the device's reply
+static void replayLine(Capture &capture, SerialPort &port, uint32_t delayUs) {
+	char line[REPLAY_LINE];
+	size_t len=0;
+	while (len < REPLAY_LINE - 1) {
+		char c = capture.data[capture.pos];
+		capture.pos = (capture.pos + 1) % capture.size;
+		if (c == '\0') {
+			continue;			// inject() takes a C string
+		}
+		line[len++] = c;
+		if (c == '\n' || capture.pos == 0) {
+			break;
+		}
+	}
+	line[len] = '\0';
+	capture.replayed++;
+	port.inject(line, delayUs);
+}
+
+// ---------------------------------------------------------------- replaying devices
+
+static void windReplay(SerialPort &port, const char *line) {
+	if (strcmp(line, "$ULPI*00") == 0) {
+		replayLine(windCapture, port, REPLAY_WIND_DELAY);
+	}
+}
+
+// 'R' gets the next captured line; the bring-up commands get the gauge's fixed answers
+static void rainReplay(SerialPort &port, const char *line) {
+	if (line[0] == 'B') {
+		port.inject("Baud 9600\r\n", REPLAY_RAIN_DELAY);
+		return;
+	}
+	if (line[0] == '\0' || line[1] != '\0') {
+		return;
+	}
+	switch (line[0]) {
+		case 'R': replayLine(rainCapture, port, REPLAY_RAIN_DELAY); break;
+		case 'P': port.inject("p\r\n", REPLAY_RAIN_DELAY); break;
+		case 'C': port.inject("c\r\n", REPLAY_RAIN_DELAY); break;
+		case 'H': port.inject("h\r\n", REPLAY_RAIN_DELAY); break;
+		case 'M': port.inject("m\r\n", REPLAY_RAIN_DELAY); break;
+	}
+}
+
+// ---------------------------------------------------------------- measurement
+
+struct Latency {
+	uint32_t count;
+	uint64_t sum;
+	uint32_t max;
+	void add(uint64_t us) {
+		count++;
+		sum += us;
+		if (us > max) max = (uint32_t)us;
+	}
+};
+
+enum ReplayCpu { CPU_WIND_RX, CPU_RAIN_RX, CPU_I2C_RECEIVE, CPU_I2C_REQUEST, CPU_TASKS, CPU_SLOTS };
+static const char * const cpuNames[CPU_SLOTS] = { "wind receive", "rain receive", "I2C receive", "I2C request", "tasks" };
+
+struct CpuAccount {
+	uint64_t ns;
+	uint32_t calls;
+	uint32_t max;
+};
+
+static CpuAccount cpu[CPU_SLOTS];
+static Latency windLatency, rainLatency, frameLatency;
+static uint64_t unframedSince=0;		// last byte of the oldest reply published but not yet in a frame (0: none)
+
+static uint64_t hostNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint8_t masterCmd=0;						// command of the transaction in progress
+static uint32_t commandWorst[METRIC_COMMANDS][2];	// host ns: receiveEvent, requestEvent
+
+static uint64_t account(ReplayCpu slot, uint64_t start) {
+	uint64_t ns = hostNs() - start;
+	cpu[slot].ns += ns;
+	cpu[slot].calls++;
+	if (ns > cpu[slot].max) cpu[slot].max = (uint32_t)ns;
+	return ns;
+}
+
+static void commandTime(uint8_t handler, uint64_t ns) {
+	if (masterCmd < METRIC_COMMANDS && ns > commandWorst[masterCmd][handler]) {
+		commandWorst[masterCmd][handler] = (uint32_t)ns;
+	}
+}
+
+static void published(Latency &latency, const SerialPort &port) {
+	latency.add(nativeClock() - port.lastByteTime);
+	if (unframedSince == 0) {
+		unframedSince = port.lastByteTime;
+	}
+}
+
+static void timedWindRx() {
+	uint32_t before = wind.snapshot.published;
+	uint64_t start = hostNs();
+	wind.serviceRx();
+	account(CPU_WIND_RX, start);
+	if (wind.snapshot.published != before) {
+		published(windLatency, windPort);
+	}
+}
+
+static void timedRainRx() {
+	uint32_t before = rain.snapshot.published;
+	uint64_t start = hostNs();
+	rain.serviceRx();
+	account(CPU_RAIN_RX, start);
+	if (rain.snapshot.published != before) {
+		published(rainLatency, rainPort);
+	}
+}
+
+static void timedReceive(int howMany) {
+	uint64_t start = hostNs();
+	receiveEvent(howMany);
+	commandTime(0, account(CPU_I2C_RECEIVE, start));
+}
+
+static void timedRequest() {
+	uint64_t start = hostNs();
+	requestEvent();
+	commandTime(1, account(CPU_I2C_REQUEST, start));
+}
+
+// ---------------------------------------------------------------- scripted master
+
+static const uint8_t replayScript[] = {
+	GET_ALL, GET_WIND_SPEED, GET_WIND_DIR, GET_RAIN_ACC, RAIN_CHECK, GET_ALL, GET_RAIN_INTVACC, GET_RAIN_TOTALACC,
+	GET_ALL, GET_RAIN_EVENTACC, GET_WIND_STATS, GET_SNAPSHOT_STATUS, GET_ALL, GET_RAIN_MODE, GET_RAIN_LINK,
+	HISTORY_STATUS, GET_ALL, HISTORY_READ, GET_POWER_STATS, GET_UART_STATS, GET_ALL, GET_METRICS, GET_SAMPLING,
+	GET_SENSOR_STATUS
+};
+
+static bool unreadSet=false;		// a frame with a new reading was published and has not been read
+static uint32_t freshReads=0;		// GET_ALL reads of a new frame
+static uint32_t repeatReads=0;		// GET_ALL reads of a frame already read
+static uint32_t missedSets=0;		// new frames replaced before the master read them
+
+// called as each frame is published
+static void framePublished() {
+	PM2Frame f;
+	frame.read(f);
+	if (f.b[4] & (FRAME_STATUS_WIND_NEW | FRAME_STATUS_RAIN_NEW)) {
+		if (unreadSet) {
+			missedSets++;
+		}
+		unreadSet = true;
+	}
+}
+
+// one transaction; false if it was Nacked, short, empty or failed its CRC
+static bool masterCommand(uint8_t cmd) {
+	uint8_t data[I2C_REPLY_MAX];
+	uint8_t expected;
+	switch (cmd) {
+		case GET_ALL: expected = FRAME_SIZE; break;
+		case GET_WIND_SPEED:
+		case GET_WIND_DIR: expected = WIND_VALUE_SIZE; break;
+		case RAIN_CHECK: expected = 1; break;
+		case GET_RAIN_ACC:
+		case GET_RAIN_EVENTACC:
+		case GET_RAIN_TOTALACC:
+		case GET_RAIN_INTVACC: expected = RAIN_VALUE_SIZE; break;
+		default: expected = 0; break;		// status replies: anything but nothing
+	}
+	masterCmd = cmd;
+	if (!i2cSlave.masterWrite(&cmd, 1)) {
+		return false;
+	}
+	if (expected == 0) {
+		return i2cSlave.masterRead(data, I2C_REPLY_MAX) > 0;
+	}
+	uint8_t n = i2cSlave.masterRead(data, expected);
+	if (n != expected) {
+		return false;
+	}
+	if (cmd == GET_ALL) {
+		if (unreadSet) {
+			freshReads++;
+		} else {
+			repeatReads++;
+		}
+		unreadSet = false;
+		return crc8(data, FRAME_SIZE - 1) == data[FRAME_SIZE - 1];
+	}
+	if (cmd == RAIN_CHECK) {
+		return data[0] == 1;
+	}
+	return true;
+}
+
+// ---------------------------------------------------------------- benchmark
+
+static void printLatency(const char *name, const Latency &latency) {
+	printf("  %-26s %6u  avg %7.0f uS  max %7u uS\n", name, latency.count,
+		latency.count ? (double)latency.sum / latency.count : 0.0, latency.max);
+}
+
+int replayBench(int argc, char **argv) {
+	if (argc < 4) {
+		printf("usage: program replay <wind capture> <rain capture> [seconds] [sample interval mS] [master period mS]\n");
+		return 1;
+	}
+	if (!loadCapture(windCapture, argv[2]) || !loadCapture(rainCapture, argv[3])) {
+		return 1;
+	}
+	uint32_t seconds = (argc > 4) ? (uint32_t)atoi(argv[4]) : 600;
+	uint32_t interval = (argc > 5) ? (uint32_t)atoi(argv[5]) * 1000 : 1000000;
+	uint32_t period = (argc > 6) ? (uint32_t)atoi(argv[6]) * 1000 : 100000;
+	bool dataReady = (period == 0);		// the master waits for the alert line
+	SamplingLimits fixed = { interval, interval, 1 };
+	if (!AdaptiveRate::valid(fixed)) {
+		printf("replay: sample interval out of range\n");
+		return 1;
+	}
+
+	boardSetup();
+	windPort.setResponder(windReplay);
+	rainPort.setResponder(rainReplay);
+	rainPort.deviceBaud=9600;
+	if (!masterSampling(fixed)) {		// before the timed handlers: not part of the measurement
+		printf("replay: sample interval not accepted by SET_CONFIG\n");
+		return 1;
+	}
+	windPort.setRxHandler(timedWindRx);
+	rainPort.setRxHandler(timedRainRx);
+	i2cSlave.onReceive(timedReceive);
+	i2cSlave.onRequest(timedRequest);
+	rain.maxBaudCode=RG15_DEFAULT_BAUD_CODE;	// 9600 as captured
+	rain.setMode(RAIN_POLLED);
+	halLog.enabled=false;
+	if (dataReady) {
+		uint8_t cmd[2] = { SET_ALERT, ALERT_NEW_SET };
+		uint8_t ack=0;
+		i2cSlave.masterWrite(cmd, 2);
+		i2cSlave.masterRead(&ack, 1);
+	}
+
+	uint32_t transactions=0, nacks=0, step=0;
+	uint32_t framesSeen = frame.published;
+	uint64_t start = nativeClock();
+	uint64_t end = start + (uint64_t)seconds * 1000000;
+	uint64_t nextCommand = start + period;
+	nativeI2CWakeAt=dataReady ? 0 : nextCommand;
+	while (nativeClock() < end) {
+		uint64_t t = hostNs();
+		scheduler.runDue();
+		account(CPU_TASKS, t);
+		eventLog.drain();
+		if (frame.published != framesSeen) {
+			framesSeen = frame.published;
+			if (unframedSince != 0) {
+				frameLatency.add(nativeClock() - unframedSince);
+				unframedSince = 0;
+			}
+			framePublished();
+		}
+		if (dataReady) {
+			if (nativeAlert) {
+				transactions++;
+				if (!masterCommand(GET_ALL)) {
+					nacks++;
+				}
+			}
+		}
+		scheduler.idle();
+		if (!dataReady && nativeClock() >= nextCommand) {
+			transactions++;
+			if (!masterCommand(replayScript[step])) {
+				nacks++;
+			}
+			step = (step + 1) % sizeof(replayScript);
+			nextCommand += period;
+			nativeI2CWakeAt=nextCommand;
+		}
+	}
+	halLog.enabled=true;
+
+	double simulated = (double)(nativeClock() - start);
+	const MWVParserStats &w = wind.parserStats();
+	const RG15ParserStats &r = rain.parserStats();
+	if (dataReady) {
+		printf("replay: %.0f s simulated, polls every %u mS, the master reads GET_ALL on the data ready line\n",
+			simulated / 1e6, interval / 1000);
+	} else {
+		printf("replay: %.0f s simulated, polls every %u mS, a master command every %u mS\n", simulated / 1e6,
+			interval / 1000, period / 1000);
+	}
+	printf("  wind: %u replies at %u baud: %u sentences, %u checksum, %u format, %u truncated, %u overruns, %u timeouts\n",
+		windCapture.replayed, windPort.baud(), w.sentences, w.checksumErrors, w.formatErrors, w.truncated, w.overruns,
+		wind.pollTimeouts);
+	printf("  rain: %u replies at %u baud: %u lines, %u readings, %u rejected, %u overruns, %u timeouts\n",
+		rainCapture.replayed, rainPort.baud(), r.lines, r.readings, r.rejected, r.overruns, rain.pollTimeouts);
+	printf("latency from the last byte on the wire\n");
+	printLatency("to the wind reading", windLatency);
+	printLatency("to the rain reading", rainLatency);
+	printLatency("to the GET_ALL frame", frameLatency);
+	printf("master: %u transactions, %u NACKs (%.2f %%)\n", transactions, nacks,
+		transactions ? 100.0 * nacks / transactions : 0.0);
+	printf("GET_ALL: %u reads of a new frame, %u of a frame already read, %u new frames never read\n",
+		freshReads, repeatReads, missedSets + (unreadSet ? 1 : 0));
+	printf("CPU (host ns)\n");
+	uint64_t busy=0;
+	for (uint8_t i=0; i<CPU_SLOTS; i++) {
+		busy += cpu[i].ns;
+		printf("  %-14s %8u calls  avg %7.0f  max %8u\n", cpuNames[i], cpu[i].calls,
+			cpu[i].calls ? (double)cpu[i].ns / cpu[i].calls : 0.0, cpu[i].max);
+	}
+	printf("  busy %.4f %% of the simulated time\n", simulated > 0 ? 100.0 * busy / (simulated * 1000.0) : 0.0);
+	printf("worst ISR (host ns)       receive  request\n");
+	for (uint8_t i=0; i<METRIC_COMMANDS; i++) {
+		if (commandWorst[i][0] != 0 || commandWorst[i][1] != 0) {
+			printf("  %-20s %9u %8u\n", commandName(i), commandWorst[i][0], commandWorst[i][1]);
+		}
+	}
+	// the faults in a capture are expected: only a replay that published nothing has failed
+	return (windLatency.count > 0 && rainLatency.count > 0) ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef ARDUINO
+
+/*
+	RG-15 decoder check and benchmark (program rg15 [passes]).
+	Feeds the test lines from the development notes in PM2_Raindriver.cpp, and lines for the other cases the
+	decoder must handle (inches, the XTB line, keys in any order, jumbled and doubled replies, noise, overlong
+	lines), through RG15Parser (PM2_RG15parser.h) and checks each result: accepted or rejected, which keys were
+	found and every value in uM. Then the readings are decoded again and again, by the parser and by the
+	sscanf + atof code it replaced (as it was, minus the String), and the host time per line is compared.
+*/
+
+#include "../PM2_RG15parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct Rg15Case {
+	const char *text;		// as sent, with its CR LF
+	bool reading;			// feed() returns true on the line feed
+	uint16_t fields;
+	int32_t acc, eventAcc, totalAcc, rInt;		// uM and uM per hour (when in fields)
+	int32_t xtbTips;
+};
+
+static const Rg15Case rg15Cases[] = {
+	// the test strings from the development notes
+	{ "Acc 1 mm, EventAcc 2 xm, TotalAcc 3 mm, RInt 4 mmph\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc 0.01 mm, EventAcc 0.02 xm, TotalAcc 0.03 mm, RInt 0.04 mmph\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc 99.010 mm, EventAcc 999.202 mm, TotalAcc 9998.033 mm, RInt 199.201 mmph\r\n", true, RG15_READING,
+		99010, 999202, 9998033, 199201, 0 },
+	{ "Acc 1.010 mm, EventAcc 199.202 mm, TotalAcc 898.033 mm, RInt 50.201 mmph\r\n", true, RG15_READING,
+		1010, 199202, 898033, 50201, 0 },
+	{ "Acc 9999.010 mm, EventAcc 9999.202 mm, TotalAcc 9999.033 mm, RInt 9999.201 mmph\r\n", true, RG15_READING,
+		9999010, 9999202, 9999033, 9999201, 0 },
+	// units, order, partial replies
+	{ "Acc 0.012 in, EventAcc 0.100 in, TotalAcc 1.250 in, RInt 0.500 iph\r\n", true, RG15_READING,
+		304, 2540, 31750, 12700, 0 },
+	{ "RInt 2.40 mmph, TotalAcc 12.6 mm, Acc 0.2 mm, EventAcc 3.4 mm\r\n", true, RG15_READING,
+		200, 3400, 12600, 2400, 0 },
+	{ "Acc 0.25 mm\r\n", true, RG15_ACC, 250, 0, 0, 0, 0 },
+	{ "XTBTips: 3, XTBEventAcc: 0.03 in, XTBTotalAcc: 0.120 in, XTBInt: 0.10 iph\r\n", true, RG15_XTB,
+		0, 0, 0, 0, 3 },
+	{ "Acc 1.5 mm, EventAcc 1.5 mm, TotalAcc 1.5 mm, RInt 36 mmph\n", true, RG15_READING,
+		1500, 1500, 1500, 36000, 0 },
+	// faults: each is rejected and the next good line still decodes
+	{ "Acc 0.01 mm, EventAcc 0.02 mm, TotAcc 0.00 mm, EventAcc 0.02 mm, TotalAcc 0.03 mm, RInt 0.04 mmph\r\n",
+		false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc 0.01 mm, EventAcc 0.02 mm, Acc 0.01 mm, EventAcc 0.02 mm\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc 0.01 in, EventAcc 0.02 mm, TotalAcc 0.03 mm, RInt 0.04 mmph\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc 123456.0 mm, EventAcc 0.02 mm, TotalAcc 0.03 mm, RInt 0.04 mmph\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc mm, EventAcc 0.02 mm, TotalAcc 0.03 mm, RInt 0.04 mmph\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "\x83\xF2\x11\x9C\xE0\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc 0.000 mm, EventAcc 0.000 mm, TotalAcc 0.000 mm, RInt 0.000 mmph, Acc 0.000 mm, EventAcc 0.000 mm, "
+		"TotalAcc 0.000 mm\r\n", false, 0, 0, 0, 0, 0, 0 },
+	{ "Acc 0.02 mm, EventAcc 0.40 mm, TotalAcc 7.35 mm, RInt 1.20 mmph\r\n", true, RG15_READING,
+		20, 400, 7350, 1200, 0 },
+};
+
+#define RG15_CASES (sizeof(rg15Cases) / sizeof(rg15Cases[0]))
+
+static uint64_t hostNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool feedLine(RG15Parser &parser, const char *text) {
+	bool reading=false;
+	for (const char *p=text; *p; p++) {
+		reading |= parser.feed(*p);
+	}
+	return reading;
+}
+
+static bool checkCase(RG15Parser &parser, const Rg15Case &c) {
+	bool reading = feedLine(parser, c.text);
+	if (reading != c.reading) {
+		return false;
+	}
+	if (!reading) {
+		return true;
+	}
+	const RG15Reading &r = parser.reading();
+	if (r.fields != c.fields) {
+		return false;
+	}
+	return (!(c.fields & RG15_ACC) || r.acc == c.acc)
+		&& (!(c.fields & RG15_EVENTACC) || r.eventAcc == c.eventAcc)
+		&& (!(c.fields & RG15_TOTALACC) || r.totalAcc == c.totalAcc)
+		&& (!(c.fields & RG15_RINT) || r.rInt == c.rInt)
+		&& (!(c.fields & RG15_XTBTIPS) || r.xtbTips == c.xtbTips);
+}
+
+/*
+	The decoder RadeonRain::getReading() used before the tokenizer, with the String replaced by the line read so
+	far: the same scan format, then the four atof calls. The buffers are larger than the originals so that the
+	benchmark does not overrun them.
+*/
+struct SscanfReading {
+	float acc, eventAcc, totalAcc, rInt;
+};
+
+static volatile float sscanfSink;
+
+static bool sscanfDecode(const char *response, SscanfReading &r) {
+	if (strncmp(response, "Acc", 3) != 0) {
+		return false;
+	}
+	char acc[24], eventAcc[24], totalAcc[24], rInt[24], unit[24], unit2[24], unit3[24], unit4[24];
+	char A[24], B[24], C[24], D[24];
+	sscanf(response, "%s %s %[^,] , %s %s %[^,] , %s %s %[^,] , %s %[0-9.]s %[mmph|mh|mAcc^\n]", A, acc, unit, B,
+		eventAcc, unit2, C, totalAcc, unit3, D, rInt, unit4);
+	r.acc = atof(acc);
+	r.eventAcc = atof(eventAcc);
+	r.totalAcc = atof(totalAcc);
+	r.rInt = atof(rInt);
+	return true;
+}
+
+int rg15Bench(int argc, char **argv) {
+	uint32_t passes = (argc > 2) ? (uint32_t)atoi(argv[2]) : 100000;
+
+	RG15Parser parser;
+	uint32_t failed=0;
+	for (uint8_t i=0; i<RG15_CASES; i++) {
+		if (!checkCase(parser, rg15Cases[i])) {
+			printf("rg15: wrong result for %s", rg15Cases[i].text);
+			failed++;
+		}
+	}
+	// an overlong line is dropped, and the decoder picks up again at the next line
+	char noise[3 * RG15_MAX_LINE];
+	memset(noise, 'x', sizeof(noise) - 2);
+	noise[sizeof(noise) - 2] = '\n';
+	noise[sizeof(noise) - 1] = '\0';
+	uint32_t overruns = parser.stats().overruns;
+	bool resync = !feedLine(parser, noise) && parser.stats().overruns == overruns + 1
+		&& checkCase(parser, rg15Cases[RG15_CASES - 1]);
+	if (!resync) {
+		printf("rg15: no resynchronisation after an overlong line\n");
+		failed++;
+	}
+
+	// timing: the good metric readings, which both decoders can read
+	const Rg15Case *timed[RG15_CASES];
+	uint8_t count=0;
+	for (uint8_t i=0; i<RG15_CASES; i++) {
+		if (rg15Cases[i].reading && rg15Cases[i].fields == RG15_READING && strstr(rg15Cases[i].text, " mm,")) {
+			timed[count++] = &rg15Cases[i];
+		}
+	}
+	uint32_t decoded=0;
+	uint64_t start = hostNs();
+	for (uint32_t pass=0; pass<passes; pass++) {
+		for (uint8_t i=0; i<count; i++) {
+			decoded += feedLine(parser, timed[i]->text);
+		}
+	}
+	uint64_t parserNs = hostNs() - start;
+	start = hostNs();
+	for (uint32_t pass=0; pass<passes; pass++) {
+		for (uint8_t i=0; i<count; i++) {
+			SscanfReading r;
+			if (sscanfDecode(timed[i]->text, r)) {
+				sscanfSink = r.acc + r.eventAcc + r.totalAcc + r.rInt;
+			}
+		}
+	}
+	uint64_t sscanfNs = hostNs() - start;
+	uint64_t lines = (uint64_t)passes * count;
+
+	printf("rg15: %u test lines and an overlong line: %u wrong\n", (uint32_t)RG15_CASES, failed);
+	printf("  %u readings x %u: tokenizer %.1f ns per line, sscanf + atof %.1f ns per line (%.1fx)\n", count, passes,
+		(double)parserNs / lines, (double)sscanfNs / lines, parserNs ? (double)sscanfNs / parserNs : 0.0);
+	return (failed == 0 && decoded == lines) ? 0 : 1;
+}
+
+#endif
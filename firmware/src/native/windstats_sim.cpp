@@ -0,0 +1,203 @@
+#ifndef ARDUINO
+
+/*
+	Wind statistics check (program windstats [series] [seed]).
+	Feeds synthetic wind series through WindStats (PM2_windstats.h) as CalypsoWind does: one sample per poll or
+	streamed sentence, 1 - 4 Hz with a little jitter, starting at a random millis() that may wrap in the middle of
+	a series. Each series is one of: steady wind veering through north (the case an arithmetic mean of the
+	direction gets wrong), wind backing and veering round a random direction, gusty wind with short squalls, light
+	and variable wind with the direction drawn at random, and a calm that turns breezy. Its length is drawn from
+	1 to 600 samples, so windows of a single sample and windows far longer than the gust window are both covered.
+	The result of every series is checked against a reference computed afterwards in double precision from all the
+	samples kept: mean direction from the mean unit vector, Yamartino standard deviation, scalar and vector mean
+	speed, two pass sample variance, and the highest and lowest mean over the gust window ending at each sample.
+*/
+
+#include "../PM2_windstats.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+struct WindSampleSim {
+	uint32_t ms;
+	float dir;			// deg
+	float speed;		// m/s
+};
+
+static uint32_t simState=1;
+
+static uint32_t simRandom() {
+	simState = simState * 1664525 + 1013904223;
+	return simState >> 8;
+}
+
+static double simUniform() {
+	return (simRandom() & 0xFFFFFF) / 16777216.0;
+}
+
+static uint32_t simBetween(uint32_t low, uint32_t high) {
+	return low + simRandom() % (high - low + 1);
+}
+
+static const char * const seriesNames[] = { "veering through north", "backing and veering", "gusty",
+	"light and variable", "calm to breezy" };
+
+#define WIND_SERIES_KINDS (sizeof(seriesNames) / sizeof(seriesNames[0]))
+
+static void makeSeries(uint8_t kind, std::vector<WindSampleSim> &samples) {
+	uint32_t count = simBetween(1, 600);
+	uint32_t period = 1000 / simBetween(1, 4);		// mS: 1 - 4 Hz
+	uint32_t ms = (simRandom() % 4 == 0) ? 0xFFFFFFFFu - simBetween(0, count * period) : simRandom();
+	double base = simUniform() * 360;
+	double speed = 1 + simUniform() * 8;
+	double squall=0;
+	samples.clear();
+	for (uint32_t i=0; i<count; i++) {
+		double dir, v;
+		switch (kind) {
+			case 0: dir = 340 + 40.0 * i / count + (simUniform() - 0.5) * 6; v = speed + (simUniform() - 0.5); break;
+			case 1: dir = base + 25 * sin(i / 20.0) + (simUniform() - 0.5) * 10; v = speed + (simUniform() - 0.5) * 2; break;
+			case 2: {
+				if (squall <= 0 && simRandom() % 40 == 0) squall = 4 + simUniform() * 10;
+				v = speed + squall + (simUniform() - 0.5) * 3;
+				squall = (squall > 0.5) ? squall * 0.85 : 0;
+				dir = base + (simUniform() - 0.5) * 40;
+				break;
+			}
+			case 3: dir = simUniform() * 360; v = simUniform() * 1.5; break;
+			default: dir = base + (simUniform() - 0.5) * 60; v = (i < count / 2) ? simUniform() * 0.3 : speed * simUniform(); break;
+		}
+		dir = fmod(dir + 360, 360);
+		if (v < 0) v = 0;
+		// as published: deci-degrees and centi-m/s (PM2_types.h)
+		WindSampleSim s = { ms, (float)(int)(dir * 10) / 10.0f, (float)(int)(v * 100) / 100.0f };
+		samples.push_back(s);
+		ms += period - period / 20 + simRandom() % (period / 10 + 1);
+	}
+}
+
+static WindStatistics reference(const std::vector<WindSampleSim> &samples, uint32_t gustWindow) {
+	const double toRad = M_PI / 180;
+	double n = samples.size();
+	double sumSin=0, sumCos=0, sumU=0, sumV=0, sum=0;
+	for (size_t i=0; i<samples.size(); i++) {
+		sumSin += sin(samples[i].dir * toRad);
+		sumCos += cos(samples[i].dir * toRad);
+		sumU += samples[i].speed * sin(samples[i].dir * toRad);
+		sumV += samples[i].speed * cos(samples[i].dir * toRad);
+		sum += samples[i].speed;
+	}
+	double mean = sum / n;
+	double squares=0, gust=0, lull=0;
+	for (size_t i=0; i<samples.size(); i++) {
+		squares += (samples[i].speed - mean) * (samples[i].speed - mean);
+		double windowSum=0;
+		uint32_t inWindow=0;
+		for (size_t j=i + 1; j-- > 0 && samples[i].ms - samples[j].ms < gustWindow; ) {
+			windowSum += samples[j].speed;
+			inWindow++;
+		}
+		double windowMean = windowSum / inWindow;
+		if (i == 0 || windowMean > gust) gust = windowMean;
+		if (i == 0 || windowMean < lull) lull = windowMean;
+	}
+	double sa = sumSin / n, ca = sumCos / n;
+	double meanDir = atan2(sa, ca) / toRad;
+	double e2 = 1 - (sa*sa + ca*ca);
+	double epsilon = (e2 > 0) ? sqrt(e2) : 0;
+	WindStatistics r;
+	r.count = (uint16_t)samples.size();
+	r.duration = samples.back().ms - samples.front().ms;
+	r.meanDir = (float)(meanDir < 0 ? meanDir + 360 : meanDir);
+	r.dirStdDev = (float)(asin(epsilon) * (1 + 0.1547 * epsilon * epsilon * epsilon) / toRad);
+	r.meanSpeed = (float)mean;
+	r.vectorSpeed = (float)(sqrt(sumU*sumU + sumV*sumV) / n);
+	r.speedVariance = (float)(samples.size() > 1 ? squares / (n - 1) : 0);
+	r.gust = (float)gust;
+	r.lull = (float)lull;
+	return r;
+}
+
+static double angleError(float a, float b) {
+	double d = fabs(a - b);
+	return (d > 180) ? 360 - d : d;
+}
+
+// worst difference from the reference seen for each statistic
+struct WindStatsErrors {
+	double meanDir, dirStdDev, meanSpeed, vectorSpeed, speedVariance, gust, lull;
+};
+
+int windStatsSim(int argc, char **argv) {
+	uint32_t series = (argc > 2) ? (uint32_t)atoi(argv[2]) : 2000;
+	simState = (argc > 3) ? (uint32_t)atoi(argv[3]) : 1;
+
+	WindStats stats;
+	std::vector<WindSampleSim> samples;
+	WindStatsErrors worst = {0, 0, 0, 0, 0, 0, 0};
+	uint32_t mismatches=0;
+	uint64_t total=0;
+	double naiveWorst=0;			// arithmetic mean of the directions veering through north
+	for (uint32_t n=0; n<series; n++) {
+		uint8_t kind = (uint8_t)(n % WIND_SERIES_KINDS);
+		makeSeries(kind, samples);
+		stats.reset();
+		for (size_t i=0; i<samples.size(); i++) {
+			stats.add(samples[i].ms, samples[i].dir, samples[i].speed);
+		}
+		total += samples.size();
+		WindStatistics got = stats.result();
+		WindStatistics ref = reference(samples, stats.gustWindow);
+
+		// the mean direction is only defined while the unit vectors do not cancel out
+		double resultant = cos(ref.dirStdDev * M_PI / 180);
+		WindStatsErrors e;
+		e.meanDir = (resultant > 0.2) ? angleError(got.meanDir, ref.meanDir) : 0;
+		e.dirStdDev = fabs(got.dirStdDev - ref.dirStdDev);
+		e.meanSpeed = fabs(got.meanSpeed - ref.meanSpeed);
+		e.vectorSpeed = fabs(got.vectorSpeed - ref.vectorSpeed);
+		e.speedVariance = fabs(got.speedVariance - ref.speedVariance) / (1 + ref.speedVariance);
+		e.gust = fabs(got.gust - ref.gust);
+		e.lull = fabs(got.lull - ref.lull);
+		bool ok = got.count == ref.count && got.duration == ref.duration && e.meanDir < 0.1 && e.dirStdDev < 0.1
+			&& e.meanSpeed < 0.001 && e.vectorSpeed < 0.001 && e.speedVariance < 0.001 && e.gust < 0.001
+			&& e.lull < 0.001;
+		if (!ok) {
+			if (mismatches < 10) {
+				printf("mismatch in series %u (%s, %zu samples): dir %.2f (reference %.2f) sd %.2f (%.2f) "
+					"speed %.3f (%.3f) vector %.3f (%.3f) variance %.4f (%.4f) gust %.3f (%.3f) lull %.3f (%.3f)\n",
+					n, seriesNames[kind], samples.size(), got.meanDir, ref.meanDir, got.dirStdDev, ref.dirStdDev,
+					got.meanSpeed, ref.meanSpeed, got.vectorSpeed, ref.vectorSpeed, got.speedVariance,
+					ref.speedVariance, got.gust, ref.gust, got.lull, ref.lull);
+			}
+			mismatches++;
+		}
+		if (e.meanDir > worst.meanDir) worst.meanDir = e.meanDir;
+		if (e.dirStdDev > worst.dirStdDev) worst.dirStdDev = e.dirStdDev;
+		if (e.meanSpeed > worst.meanSpeed) worst.meanSpeed = e.meanSpeed;
+		if (e.vectorSpeed > worst.vectorSpeed) worst.vectorSpeed = e.vectorSpeed;
+		if (e.speedVariance > worst.speedVariance) worst.speedVariance = e.speedVariance;
+		if (e.gust > worst.gust) worst.gust = e.gust;
+		if (e.lull > worst.lull) worst.lull = e.lull;
+		if (kind == 0) {
+			double sum=0;
+			for (size_t i=0; i<samples.size(); i++) {
+				sum += samples[i].dir;
+			}
+			double naive = angleError((float)(sum / samples.size()), ref.meanDir);
+			if (naive > naiveWorst) naiveWorst = naive;
+		}
+	}
+
+	printf("wind statistics: %u series, %llu samples, gust window %u mS\n", series, (unsigned long long)total,
+		stats.gustWindow);
+	printf("  %u series differ from the double precision reference\n", mismatches);
+	printf("  worst differences: direction %.4f deg, standard deviation %.4f deg, mean speed %.5f m/s, vector speed "
+		"%.5f m/s, variance %.6f (relative), gust %.5f m/s, lull %.5f m/s\n", worst.meanDir, worst.dirStdDev,
+		worst.meanSpeed, worst.vectorSpeed, worst.speedVariance, worst.gust, worst.lull);
+	printf("  an arithmetic mean of the direction veering through north is out by up to %.0f deg\n", naiveWorst);
+	return mismatches == 0 ? 0 : 1;
+}
+
+#endif
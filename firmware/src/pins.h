@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Arduino.h>
+#include "PM2_uartdma.h"
 
 /*
 BIG NOTE: The pin numbering in the file is what is used in the pinMode command.
@@ -38,6 +39,8 @@ const uint8_t POWER_PMS_B = 30;		// PB22
 const uint8_t ADC0 = 17; 			// PA04 - A3
 const uint8_t ADC1 = 18; 			// PA05 - A4
 
+const uint8_t pinALERT = ADC0;		// data ready / alert line to the master (open drain, active low: PM2_alert.h)
+
 // Groove ADC 2
 const uint8_t ADC2 = 19;			// PB02 - A5
 const uint8_t ADC3 = 14; 			// PA02 - A0
@@ -47,12 +50,12 @@ const uint8_t ADC3 = 14; 			// PA02 - A0
 const uint8_t GPIO0 = 22; 			// PA12 - SERCOM4_ALT/PAD[0] (Tx) UART_TX_PAD_0 
 const uint8_t GPIO1 = 38; 			// PA13 - SERCOM4_ALT/PAD[1] (Rx) SERCOM_RX_PAD_1
 
-extern Uart SerialGroveGPIO;
+extern DmaUart SerialGroveGPIO;
 
 // Groove UART
 
 const uint8_t RX0 = 34; 				// PA19 - SERCOM1/PAD[3]
 const uint8_t TX0 = 36; 				// PA18 - SERCOM1/PAD[2]
-extern Uart SerialGrove;
+extern DmaUart SerialGrove;
 
 void setupPins();